@@ -5,14 +5,14 @@
 #include "renderstate.h"
 
 //=====================================================================
-// Win32 ڼͼλƣΪ device ṩһ DibSection  FB
+// Win32 窗口及图形绘制：为 device 提供一个 DibSection 的 FB
 //=====================================================================
 int screen_w, screen_h, screen_exit = 0;
 int screen_mx = 0, screen_my = 0, screen_mb = 0;
-static HWND screen_handle = NULL;		//  HWND
-static HDC screen_dc = NULL;			// ׵ HDC
+static HWND screen_handle = NULL;		// 主窗口 HWND
+static HDC screen_dc = NULL;			// 配套的 HDC
 static HBITMAP screen_hb = NULL;		// DIB
-static HBITMAP screen_ob = NULL;		// ϵ BITMAP
+static HBITMAP screen_ob = NULL;		// 老的 BITMAP
 unsigned char *screen_fb = NULL;		// frame buffer
 long screen_pitch = 0;
 
@@ -24,7 +24,7 @@ long screen_pitch = 0;
 extern void set_key_state(int keyCode, int value);
 extern void set_key_quit();
 
-// ʼڲñ
+// 初始化窗口并设置标题
 int screen_init(int w, int h) {
 	WNDCLASS wc = { CS_BYTEALIGNCLIENT, (WNDPROC)screen_events, 0, 0, 0,
 		NULL, NULL, NULL, NULL, _T("SCREEN3.1415926") };
@@ -110,11 +110,50 @@ static void dispatch_key_event(WPARAM wKey)
 	{
 		if (device->function_state & FUNC_STATE_CULL_BACK)
 		{
-			device->function_state &= ~(FUNC_STATE_CULL_BACK);
+			device_disable_render_func_state(device, FUNC_STATE_CULL_BACK);
 		}
 		else
 		{
-			device->function_state |= FUNC_STATE_CULL_BACK;
+			device_enable_render_func_state(device, FUNC_STATE_CULL_BACK);
+		}
+
+		break;
+	}
+	case VK_F3:
+	{
+		if (device->raster_algorithm == RASTER_ALGORITHM_TRAPEZOID)
+		{
+			device_set_raster_algorithm(device, RASTER_ALGORITHM_HALFSPACE);
+		}
+		else
+		{
+			device_set_raster_algorithm(device, RASTER_ALGORITHM_TRAPEZOID);
+		}
+
+		break;
+	}
+	case VK_F4:
+	{
+		if (device->function_state & FUNC_STATE_HIERARCHICAL_Z)
+		{
+			device_disable_render_func_state(device, FUNC_STATE_HIERARCHICAL_Z);
+		}
+		else
+		{
+			device_enable_render_func_state(device, FUNC_STATE_HIERARCHICAL_Z);
+		}
+
+		break;
+	}
+	case VK_F5:
+	{
+		if (device->function_state & FUNC_STATE_DEPTH_PREPASS)
+		{
+			device_disable_render_func_state(device, FUNC_STATE_DEPTH_PREPASS);
+		}
+		else
+		{
+			device_enable_render_func_state(device, FUNC_STATE_DEPTH_PREPASS);
 		}
 
 		break;
@@ -208,7 +247,7 @@ void set_screen_title(TCHAR* title)
 
 void draw_screen_title(device_t *device)
 {
-	TCHAR title[128];
+	TCHAR title[256];
 	title[0] = _T('\0');
 	lstrcat(title, _T("GDIView "));
 	switch (device->render_state)
@@ -268,5 +307,24 @@ void draw_screen_title(device_t *device)
 		lstrcat(title, _T(" - FSAA"));
 	}
 
+	if (device->raster_algorithm == RASTER_ALGORITHM_HALFSPACE)
+	{
+		lstrcat(title, _T(" - halfspace"));
+	}
+
+	if (device->function_state & FUNC_STATE_HIERARCHICAL_Z)
+	{
+		lstrcat(title, _T(" - hiz"));
+	}
+
+	if (device->function_state & FUNC_STATE_DEPTH_PREPASS)
+	{
+		lstrcat(title, _T(" - prepass"));
+	}
+
+	TCHAR stats[64];
+	_stprintf_s(stats, 64, _T(" - shaded %u/%u"), device->frame_stats.shaded_pixel_num, device->frame_stats.covered_pixel_num);
+	lstrcat(title, stats);
+
 	set_screen_title(title);
 }
\ No newline at end of file
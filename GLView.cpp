@@ -143,8 +143,8 @@ GLuint complileShader(GLenum shaderType, const char* shaderSource)
 	glShaderSource(shader, 1, &shaderSource, NULL);
 	glCompileShader(shader);
 	GLint compileStatus = 0;
-	glGetShaderiv(shader, GL_COMPILE_STATUS, &compileStatus); // ״̬
-	if (compileStatus == GL_FALSE) // ȡ󱨸
+	glGetShaderiv(shader, GL_COMPILE_STATUS, &compileStatus); // 检查编译状态
+	if (compileStatus == GL_FALSE) // 获取错误报告
 	{
 		GLint maxLength = 0;
 		glGetShaderiv(shader, GL_INFO_LOG_LENGTH, &maxLength);
@@ -231,6 +231,36 @@ static void dispatch_key_event(int keyCode)
 			device_enable_render_func_state(device, FUNC_STATE_ANTI_ALIAS_FSAA);
 		}
 		break;
+	case GLFW_KEY_F3:
+		if (device->raster_algorithm == RASTER_ALGORITHM_TRAPEZOID)
+		{
+			device_set_raster_algorithm(device, RASTER_ALGORITHM_HALFSPACE);
+		}
+		else
+		{
+			device_set_raster_algorithm(device, RASTER_ALGORITHM_TRAPEZOID);
+		}
+		break;
+	case GLFW_KEY_F4:
+		if (device->function_state & FUNC_STATE_HIERARCHICAL_Z)
+		{
+			device_disable_render_func_state(device, FUNC_STATE_HIERARCHICAL_Z);
+		}
+		else
+		{
+			device_enable_render_func_state(device, FUNC_STATE_HIERARCHICAL_Z);
+		}
+		break;
+	case GLFW_KEY_F5:
+		if (device->function_state & FUNC_STATE_DEPTH_PREPASS)
+		{
+			device_disable_render_func_state(device, FUNC_STATE_DEPTH_PREPASS);
+		}
+		else
+		{
+			device_enable_render_func_state(device, FUNC_STATE_DEPTH_PREPASS);
+		}
+		break;
 	case GLFW_KEY_ESCAPE:
 	{
 		set_key_quit();
@@ -405,5 +435,22 @@ void drawGLTitle(device_t *device)
 		GLTitle += " - culling back";
 	}
 
+	if (device->raster_algorithm == RASTER_ALGORITHM_HALFSPACE)
+	{
+		GLTitle += " - halfspace";
+	}
+
+	if (device->function_state & FUNC_STATE_HIERARCHICAL_Z)
+	{
+		GLTitle += " - hiz";
+	}
+
+	if (device->function_state & FUNC_STATE_DEPTH_PREPASS)
+	{
+		GLTitle += " - prepass";
+	}
+
+	GLTitle += " - shaded " + to_string(device->frame_stats.shaded_pixel_num) + "/" + to_string(device->frame_stats.covered_pixel_num);
+
 	glfwSetWindowTitle(gl_window, GLTitle.c_str());
 }
\ No newline at end of file
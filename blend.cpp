@@ -17,36 +17,36 @@ IUINT32 blend_frame_buffer_color(device_t *device, IUINT32 srcColor, IUINT32 dst
 
 	color_t srcFactor, dstFactor;
 
-	if (device->blend_state.srcState == BLEND_ZERO)
+	if (device->pipeline_state.blend_state.srcState == BLEND_ZERO)
 	{
 		srcFactor = { 0.0f,0.0f,0.0f,0.0f };
 	}
-	else if (device->blend_state.srcState == BLEND_ONE)
+	else if (device->pipeline_state.blend_state.srcState == BLEND_ONE)
 	{
 		srcFactor = { 1.0f,1.0f,1.0f,1.0f };
 	}
-	else if (device->blend_state.srcState == BLEND_SRC_ALPHA)
+	else if (device->pipeline_state.blend_state.srcState == BLEND_SRC_ALPHA)
 	{
 		srcFactor = { alphaSrc, alphaSrc, alphaSrc, alphaSrc };
 	}
-	else if (device->blend_state.srcState == BLEND_ONE_MINUS_SRC_ALPHA)
+	else if (device->pipeline_state.blend_state.srcState == BLEND_ONE_MINUS_SRC_ALPHA)
 	{
 		srcFactor = { 1.0f - alphaSrc, 1.0f - alphaSrc, 1.0f - alphaSrc, 1.0f - alphaSrc };
 	}
 
-	if (device->blend_state.srcState == BLEND_ZERO)
+	if (device->pipeline_state.blend_state.srcState == BLEND_ZERO)
 	{
 		dstFactor = { 0.0f,0.0f,0.0f,0.0f };
 	}
-	else if (device->blend_state.srcState == BLEND_ONE)
+	else if (device->pipeline_state.blend_state.srcState == BLEND_ONE)
 	{
 		dstFactor = { 1.0f,1.0f,1.0f,1.0f };
 	}
-	else if (device->blend_state.srcState == BLEND_SRC_ALPHA)
+	else if (device->pipeline_state.blend_state.srcState == BLEND_SRC_ALPHA)
 	{
 		dstFactor = { alphaSrc, alphaSrc, alphaSrc, alphaSrc };
 	}
-	else if (device->blend_state.srcState == BLEND_ONE_MINUS_SRC_ALPHA)
+	else if (device->pipeline_state.blend_state.srcState == BLEND_ONE_MINUS_SRC_ALPHA)
 	{
 		dstFactor = { 1.0f - alphaSrc, 1.0f - alphaSrc, 1.0f - alphaSrc, 1.0f - alphaSrc };
 	}
@@ -29,7 +29,7 @@ unsigned int* read_bmp(const char* szPath, long& width, long& height)
 
 	unsigned int bfOffBits = 0;
 	bmpFileHeader(fpbmp, bfOffBits);
-	if (bfOffBits != NORMAL_BFOFFSET) // еɫ Ҫ⴦
+	if (bfOffBits != NORMAL_BFOFFSET) // 有调色板 要另外处理
 	{
 		return NULL;
 	}
@@ -0,0 +1,83 @@
+#include <string.h>
+
+#include "clip.h"
+
+int clip_check_guard_band(const vector_t *v)
+{
+	float w = v->w * CLIP_GUARD_BAND;
+	int check = 0;
+	if (v->z < 0.0f) check |= CLIP_PLANE_NEAR;
+	if (v->z > v->w) check |= CLIP_PLANE_FAR;
+	if (v->x < -w) check |= CLIP_PLANE_LEFT;
+	if (v->x > w) check |= CLIP_PLANE_RIGHT;
+	if (v->y < -w) check |= CLIP_PLANE_BOTTOM;
+	if (v->y > w) check |= CLIP_PLANE_TOP;
+	return check;
+}
+
+// 到平面的有向距离，内侧为正
+static float clip_plane_distance(int plane, const vector_t *v)
+{
+	switch (plane)
+	{
+	case CLIP_PLANE_NEAR: return v->z;
+	case CLIP_PLANE_FAR: return v->w - v->z;
+	case CLIP_PLANE_LEFT: return v->x + CLIP_GUARD_BAND * v->w;
+	case CLIP_PLANE_RIGHT: return CLIP_GUARD_BAND * v->w - v->x;
+	case CLIP_PLANE_BOTTOM: return v->y + CLIP_GUARD_BAND * v->w;
+	default: return CLIP_GUARD_BAND * v->w - v->y;
+	}
+}
+
+// 裁剪空间坐标插值，w 也需要插值，不能用 vector_interp
+static void clip_position_interp(vector_t *y, const vector_t *x1, const vector_t *x2, float t)
+{
+	y->x = x1->x + (x2->x - x1->x) * t;
+	y->y = x1->y + (x2->y - x1->y) * t;
+	y->z = x1->z + (x2->z - x1->z) * t;
+	y->w = x1->w + (x2->w - x1->w) * t;
+}
+
+int clip_polygon(int planes, vertex_t *vertices, vector_t *positions, int count)
+{
+	vertex_t out_vertices[CLIP_MAX_VERTEX_NUM];
+	vector_t out_positions[CLIP_MAX_VERTEX_NUM];
+
+	// 每个平面最多增加一个顶点
+	for (int k = 0; k < CLIP_PLANE_NUM && count >= 3; k++)
+	{
+		int plane = 1 << k;
+		if ((planes & plane) == 0)
+		{
+			continue;
+		}
+
+		int out = 0;
+		for (int i = 0; i < count; i++)
+		{
+			int j = i + 1 < count ? i + 1 : 0;
+			float di = clip_plane_distance(plane, &positions[i]);
+			float dj = clip_plane_distance(plane, &positions[j]);
+			if (di >= 0.0f)
+			{
+				out_vertices[out] = vertices[i];
+				out_positions[out] = positions[i];
+				out++;
+			}
+
+			// 边与平面相交，在边上插值出交点
+			if ((di >= 0.0f) != (dj >= 0.0f))
+			{
+				float t = di / (di - dj);
+				vertex_interp(&out_vertices[out], &vertices[i], &vertices[j], t);
+				clip_position_interp(&out_positions[out], &positions[i], &positions[j], t);
+				out++;
+			}
+		}
+
+		memcpy(vertices, out_vertices, out * sizeof(vertex_t));
+		memcpy(positions, out_positions, out * sizeof(vector_t));
+		count = out;
+	}
+	return count;
+}
@@ -0,0 +1,27 @@
+#pragma once
+
+#include "geometry.h"
+
+//=====================================================================
+// 三角形裁剪：近平面和远平面精确裁剪，x y 方向只裁剪超出保护带的三角形
+// 保护带内超出视口的部分不裁剪，由光栅化按视口直接跳过
+//=====================================================================
+
+#define CLIP_GUARD_BAND 4.0f	// 保护带为视口的倍数，NDC 的 x y 在 [-4, 4] 内时不裁剪
+#define CLIP_MAX_VERTEX_NUM 9	// 三角形经 6 个平面裁剪后最多 9 个顶点
+
+// 裁剪平面，顶点在平面外侧时置位，近平面和远平面与 transform_check_cvv 相同
+#define CLIP_PLANE_NEAR		1	// z < 0
+#define CLIP_PLANE_FAR		2	// z > w
+#define CLIP_PLANE_LEFT		4	// x < -CLIP_GUARD_BAND * w
+#define CLIP_PLANE_RIGHT	8	// x > CLIP_GUARD_BAND * w
+#define CLIP_PLANE_BOTTOM	16	// y < -CLIP_GUARD_BAND * w
+#define CLIP_PLANE_TOP		32	// y > CLIP_GUARD_BAND * w
+#define CLIP_PLANE_NUM		6
+
+// 裁剪空间坐标在各裁剪平面外侧的位
+int clip_check_guard_band(const vector_t *v);
+
+// 按 planes 中的平面依次裁剪凸多边形，vertices 和 positions 为顶点属性和裁剪空间坐标，容量为 CLIP_MAX_VERTEX_NUM
+// 顶点顺序保持不变，返回裁剪后的顶点数，少于 3 时不可见
+int clip_polygon(int planes, vertex_t *vertices, vector_t *positions, int count);
@@ -0,0 +1,198 @@
+#include <stdlib.h>
+#include <math.h>
+#include <emmintrin.h>
+#ifdef __AVX__
+#include <immintrin.h>
+#endif
+
+#include "cull.h"
+
+void cull_bounds_from_box(cull_bounds_t *bounds, const vector_t *box_min, const vector_t *box_max)
+{
+	bounds->center.x = (box_min->x + box_max->x) * 0.5f;
+	bounds->center.y = (box_min->y + box_max->y) * 0.5f;
+	bounds->center.z = (box_min->z + box_max->z) * 0.5f;
+	bounds->center.w = 1.0f;
+	bounds->extent.x = (box_max->x - box_min->x) * 0.5f;
+	bounds->extent.y = (box_max->y - box_min->y) * 0.5f;
+	bounds->extent.z = (box_max->z - box_min->z) * 0.5f;
+	bounds->extent.w = 0.0f;
+	bounds->radius = sqrtf(bounds->extent.x * bounds->extent.x + bounds->extent.y * bounds->extent.y + bounds->extent.z * bounds->extent.z);
+}
+
+void cull_bounds_from_sphere(cull_bounds_t *bounds, const vector_t *center, float radius)
+{
+	bounds->center = *center;
+	bounds->center.w = 1.0f;
+	bounds->extent.x = radius;
+	bounds->extent.y = radius;
+	bounds->extent.z = radius;
+	bounds->extent.w = 0.0f;
+	bounds->radius = radius;
+}
+
+void cull_frustum_init(cull_frustum_t *frustum, const matrix_t *view_projection)
+{
+	// 裁剪空间坐标为 p * m，每个平面是 m 的列的组合，如左平面 x + w >= 0
+	static const float column_weight[CULL_PLANE_NUM][4] = {
+		{ 0, 0, 1, 0 },
+		{ 0, 0, -1, 1 },
+		{ 1, 0, 0, 1 },
+		{ -1, 0, 0, 1 },
+		{ 0, 1, 0, 1 },
+		{ 0, -1, 0, 1 },
+	};
+
+	const matrix_t *m = view_projection;
+	for (int k = 0; k < CULL_PLANE_NUM; k++)
+	{
+		float p[4];
+		for (int i = 0; i < 4; i++)
+		{
+			p[i] = 0.0f;
+			for (int j = 0; j < 4; j++)
+			{
+				p[i] += column_weight[k][j] * m->m[i][j];
+			}
+		}
+
+		float length = sqrtf(p[0] * p[0] + p[1] * p[1] + p[2] * p[2]);
+		float inv = length > 0.0f ? 1.0f / length : 0.0f;
+		frustum->a[k] = p[0] * inv;
+		frustum->b[k] = p[1] * inv;
+		frustum->c[k] = p[2] * inv;
+		frustum->d[k] = p[3] * inv;
+	}
+}
+
+cull_list_t* cull_list_create(int capacity)
+{
+	int size = (capacity + CULL_BATCH_SIZE - 1) / CULL_BATCH_SIZE * CULL_BATCH_SIZE;
+	cull_list_t *list = (cull_list_t*)malloc(sizeof(cull_list_t));
+	float *data = (float*)calloc(7 * size, sizeof(float));	// 末尾不足一批的部分也可以读取
+	list->count = 0;
+	list->capacity = capacity;
+	list->center_x = data;
+	list->center_y = data + size;
+	list->center_z = data + 2 * size;
+	list->extent_x = data + 3 * size;
+	list->extent_y = data + 4 * size;
+	list->extent_z = data + 5 * size;
+	list->radius = data + 6 * size;
+	return list;
+}
+
+void cull_list_destroy(cull_list_t *list)
+{
+	free(list->center_x);
+	free(list);
+}
+
+void cull_list_clear(cull_list_t *list)
+{
+	list->count = 0;
+}
+
+int cull_list_add(cull_list_t *list, const cull_bounds_t *bounds, const matrix_t *world)
+{
+	if (list->count >= list->capacity)
+	{
+		return -1;
+	}
+
+	vector_t center;
+	matrix_apply(&center, &bounds->center, world);
+
+	// 变换后的半边长为 |M| 乘以原来的半边长，包围球半径按各轴缩放的最大值放大
+	const vector_t *e = &bounds->extent;
+	float extent[3];
+	float scale = 0.0f;
+	for (int j = 0; j < 3; j++)
+	{
+		extent[j] = fabsf(world->m[0][j]) * e->x + fabsf(world->m[1][j]) * e->y + fabsf(world->m[2][j]) * e->z;
+		float s = world->m[j][0] * world->m[j][0] + world->m[j][1] * world->m[j][1] + world->m[j][2] * world->m[j][2];
+		if (s > scale) scale = s;
+	}
+
+	int i = list->count++;
+	list->center_x[i] = center.x;
+	list->center_y[i] = center.y;
+	list->center_z[i] = center.z;
+	list->extent_x[i] = extent[0];
+	list->extent_y[i] = extent[1];
+	list->extent_z[i] = extent[2];
+	list->radius[i] = bounds->radius * sqrtf(scale);
+	return i;
+}
+
+#ifndef __AVX__
+// 第 first 个物体起 4 个物体，在某个平面外侧的位为 1
+static int cull_outside_mask4(const cull_list_t *list, const cull_frustum_t *frustum, int first)
+{
+	__m128 cx = _mm_loadu_ps(list->center_x + first);
+	__m128 cy = _mm_loadu_ps(list->center_y + first);
+	__m128 cz = _mm_loadu_ps(list->center_z + first);
+	__m128 ex = _mm_loadu_ps(list->extent_x + first);
+	__m128 ey = _mm_loadu_ps(list->extent_y + first);
+	__m128 ez = _mm_loadu_ps(list->extent_z + first);
+	__m128 radius = _mm_loadu_ps(list->radius + first);
+	__m128 zero = _mm_setzero_ps();
+	__m128 outside = zero;
+	for (int k = 0; k < CULL_PLANE_NUM; k++)
+	{
+		__m128 dist = _mm_add_ps(_mm_mul_ps(cx, _mm_set1_ps(frustum->a[k])), _mm_mul_ps(cy, _mm_set1_ps(frustum->b[k])));
+		dist = _mm_add_ps(dist, _mm_add_ps(_mm_mul_ps(cz, _mm_set1_ps(frustum->c[k])), _mm_set1_ps(frustum->d[k])));
+		__m128 r = _mm_add_ps(_mm_mul_ps(ex, _mm_set1_ps(fabsf(frustum->a[k]))), _mm_mul_ps(ey, _mm_set1_ps(fabsf(frustum->b[k]))));
+		r = _mm_add_ps(r, _mm_mul_ps(ez, _mm_set1_ps(fabsf(frustum->c[k]))));
+		r = _mm_min_ps(r, radius);
+		outside = _mm_or_ps(outside, _mm_cmplt_ps(_mm_add_ps(dist, r), zero));
+	}
+	return _mm_movemask_ps(outside);
+}
+#endif
+
+// 第 first 个物体起 8 个物体的可见掩码：中心到平面的距离加上包围体在平面法线方向的半径小于 0 时在外侧
+// 包围盒的半径为 |a| ex + |b| ey + |c| ez，与包围球的半径取较小值
+static int cull_visible_mask(const cull_list_t *list, const cull_frustum_t *frustum, int first)
+{
+#ifdef __AVX__
+	__m256 cx = _mm256_loadu_ps(list->center_x + first);
+	__m256 cy = _mm256_loadu_ps(list->center_y + first);
+	__m256 cz = _mm256_loadu_ps(list->center_z + first);
+	__m256 ex = _mm256_loadu_ps(list->extent_x + first);
+	__m256 ey = _mm256_loadu_ps(list->extent_y + first);
+	__m256 ez = _mm256_loadu_ps(list->extent_z + first);
+	__m256 radius = _mm256_loadu_ps(list->radius + first);
+	__m256 zero = _mm256_setzero_ps();
+	__m256 outside = zero;
+	for (int k = 0; k < CULL_PLANE_NUM; k++)
+	{
+		__m256 dist = _mm256_add_ps(_mm256_mul_ps(cx, _mm256_set1_ps(frustum->a[k])), _mm256_mul_ps(cy, _mm256_set1_ps(frustum->b[k])));
+		dist = _mm256_add_ps(dist, _mm256_add_ps(_mm256_mul_ps(cz, _mm256_set1_ps(frustum->c[k])), _mm256_set1_ps(frustum->d[k])));
+		__m256 r = _mm256_add_ps(_mm256_mul_ps(ex, _mm256_set1_ps(fabsf(frustum->a[k]))), _mm256_mul_ps(ey, _mm256_set1_ps(fabsf(frustum->b[k]))));
+		r = _mm256_add_ps(r, _mm256_mul_ps(ez, _mm256_set1_ps(fabsf(frustum->c[k]))));
+		r = _mm256_min_ps(r, radius);
+		outside = _mm256_or_ps(outside, _mm256_cmp_ps(_mm256_add_ps(dist, r), zero, _CMP_LT_OQ));
+	}
+	return ~_mm256_movemask_ps(outside) & 0xFF;
+#else
+	int outside = cull_outside_mask4(list, frustum, first) | (cull_outside_mask4(list, frustum, first + 4) << 4);
+	return ~outside & 0xFF;
+#endif
+}
+
+int cull_list_test(const cull_list_t *list, const cull_frustum_t *frustum, unsigned char *visible)
+{
+	int visible_num = 0;
+	for (int first = 0; first < list->count; first += CULL_BATCH_SIZE)
+	{
+		int mask = cull_visible_mask(list, frustum, first);
+		int n = list->count - first < CULL_BATCH_SIZE ? list->count - first : CULL_BATCH_SIZE;
+		for (int k = 0; k < n; k++)
+		{
+			visible[first + k] = (unsigned char)((mask >> k) & 1);
+			visible_num += visible[first + k];
+		}
+	}
+	return visible_num;
+}
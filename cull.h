@@ -0,0 +1,53 @@
+#pragma once
+
+#include "mathlib.h"
+
+//=====================================================================
+// 物体级视锥剔除：物体的包围体变换到世界空间后按 SoA 存放在剔除列表中
+// 每次用视锥的 6 个平面检查 8 个物体，定义 __AVX__ 时使用 AVX，否则拆成两组 SSE
+//=====================================================================
+
+#define CULL_PLANE_NUM 6	// 顺序同 CLIP_PLANE_*：近 远 左 右 下 上
+#define CULL_BATCH_SIZE 8
+
+// 包围盒和包围球的中心相同，物体在两者的交集内
+typedef struct {
+	vector_t center;
+	vector_t extent;	// 包围盒的半边长
+	float radius;		// 包围球的半径
+} cull_bounds_t;
+
+// 世界空间的平面 a x + b y + c z + d >= 0 为内侧，(a, b, c) 为单位矢量
+typedef struct {
+	float a[CULL_PLANE_NUM];
+	float b[CULL_PLANE_NUM];
+	float c[CULL_PLANE_NUM];
+	float d[CULL_PLANE_NUM];
+} cull_frustum_t;
+
+// 世界空间的包围体，每个分量一个数组，数组长度为 capacity 向上取到 CULL_BATCH_SIZE 的倍数
+typedef struct {
+	int count;
+	int capacity;
+	float *center_x, *center_y, *center_z;
+	float *extent_x, *extent_y, *extent_z;
+	float *radius;
+} cull_list_t;
+
+// 只有包围盒时包围球取外接球，只有包围球时包围盒取外切立方体
+void cull_bounds_from_box(cull_bounds_t *bounds, const vector_t *box_min, const vector_t *box_max);
+void cull_bounds_from_sphere(cull_bounds_t *bounds, const vector_t *center, float radius);
+
+// 从 view * projection 提取视锥平面，内侧与 transform_check_cvv 一致：0 <= z <= w，-w <= x, y <= w
+void cull_frustum_init(cull_frustum_t *frustum, const matrix_t *view_projection);
+
+cull_list_t* cull_list_create(int capacity);
+void cull_list_destroy(cull_list_t *list);
+void cull_list_clear(cull_list_t *list);
+
+// 模型空间的包围体经世界矩阵变换后加入列表，包围盒取变换后的轴对齐包围盒，包围球按最大缩放放大
+// 返回物体在列表中的编号，列表已满时返回 -1
+int cull_list_add(cull_list_t *list, const cull_bounds_t *bounds, const matrix_t *world);
+
+// visible[i] 为物体 i 是否可能在视锥内，包围体完全在某个平面外侧时为 0，返回可能可见的物体数
+int cull_list_test(const cull_list_t *list, const cull_frustum_t *frustum, unsigned char *visible);
@@ -1,13 +1,20 @@
 #include <stdio.h>
 #include <assert.h>
 #include <stdlib.h>
+#include <string.h>
 #include <tchar.h>
 
 #include "device.h"
 #include "renderstate.h"
 #include "comm_func.h"
-
-// 豸ʼfbΪⲿ֡棬 NULL ⲿ֡棨ÿ 4ֽڶ룩
+#include "tile_raster.h"
+#include "hiz.h"
+#include "shader.h"
+#include "blend.h"
+#include "raster_kernel.h"
+#include "texture.h"
+
+// 设备初始化，fb为外部帧缓存，非 NULL 将引用外部帧缓存（每行 4字节对齐）
 void device_init(device_t *device, int width, int height, void *fb) {
 	int need = sizeof(void*) * (MAX_FRAME_BUFFER_HEIGHT * 2 * (MAX_FRAME_BUFFER + 1) + 1024 * MAX_TEXTURE_NUM) + MAX_FRAME_BUFFER_WIDTH * MAX_FRAME_BUFFER_HEIGHT * 8 * (MAX_FRAME_BUFFER + 1);
 	char *ptr = (char*)malloc(need + 64);
@@ -55,7 +62,12 @@ void device_init(device_t *device, int width, int height, void *fb) {
 			device->framebuffer_array[i].zbuffer[j] = (float*)(zbuf + MAX_FRAME_BUFFER_WIDTH * 4 * j);
 			device->framebuffer_array[i].is_used = false;
 		}
+		device->framebuffer_array[i].width = 0;
+		device->framebuffer_array[i].height = 0;
+		device->framebuffer_array[i].depth_only = false;
+		device->framebuffer_array[i].hiz = hiz_create(device->framebuffer_array[i].zbuffer);
 	}
+	device->hiz = hiz_create(device->zbuffer);
 	
 	for (j = 0; j < MAX_TEXTURE_NUM; j++)
 	{
@@ -66,22 +78,82 @@ void device_init(device_t *device, int width, int height, void *fb) {
 		device->texture_array[j].height = 2;
 		device->texture_array[j].max_u = 1.0f;
 		device->texture_array[j].max_v = 1.0f;
+		device->texture_array[j].level[0].bits = device->texture_array[j].texture[0];
+		device->texture_array[j].level[0].pitch = 4;
+		device->texture_array[j].level[0].width = 2;
+		device->texture_array[j].level[0].height = 2;
+		device->texture_array[j].level[0].max_u = 1.0f;
+		device->texture_array[j].level[0].max_v = 1.0f;
+		device->texture_array[j].level_num = 1;
+		device->texture_array[j].layout = TEXTURE_LAYOUT_LINEAR;
+		device->texture_array[j].format = TEXTURE_FORMAT_RGBA8;
+		device->texture_array[j].texel_buffer = NULL;
+		device->texture_array[j].mip_buffer = NULL;
+		device->texture_array[j].framebuffer_id = RENDER_NO_SET_FRAMEBUFFER_INDEX;
+		device->texture_array[j].framebuffer_plane = FRAMEBUFFER_PLANE_COLOR;
 		device->texture_array[j].is_used = false;
 	}
 	
+	// 默认采样器与 device_texture_read 相同
+	memset(device->sampler_array, 0, sizeof(device->sampler_array));
+	device->sampler_array[DEFAULT_SAMPLER_ID].state.wrap_u = SAMPLER_WRAP_CLAMP;
+	device->sampler_array[DEFAULT_SAMPLER_ID].state.wrap_v = SAMPLER_WRAP_CLAMP;
+	device->sampler_array[DEFAULT_SAMPLER_ID].state.filter = SAMPLER_FILTER_NEAREST;
+	device->sampler_array[DEFAULT_SAMPLER_ID].state.mip_filter = SAMPLER_MIP_FILTER_NONE;
+	device->sampler_array[DEFAULT_SAMPLER_ID].is_used = true;
+	for (j = 0; j < MAX_TEXTURE_NUM; j++)
+	{
+		device->sampler_id[j] = DEFAULT_SAMPLER_ID;
+	}
+	
 	device->screen_width = width;
 	device->screen_height = height;
 	device->framebuffer_width = width;
 	device->framebuffer_height = height;
+	device->viewport_x = 0;
+	device->viewport_y = 0;
+	device->viewport_width = width;
+	device->viewport_height = height;
 	device->background = 0xc0c0c0ff;
 	device->foreground = 0;
+	device->uniform_vector_num = 0;
+	device->uniform_matrix_num = 0;
 	transform_init(&device->transform, device->framebuffer_width, device->framebuffer_height);
 	device->render_state = RENDER_STATE_BLINN_LIGHT_TEXTURE;
-	device->function_state = 0;
+	device->function_state = FUNC_STATE_HIERARCHICAL_Z;
 	device->bind_frame_buffer_idx = RENDER_NO_SET_FRAMEBUFFER_INDEX;
+	device->raster_mode = RASTER_MODE_TILE;
+	device->raster_algorithm = RASTER_ALGORITHM_TRAPEZOID;
+	device->raster_thread_num = tile_raster_default_thread_num();
+	device->tile_raster = tile_raster_create();
+	device_reset_raster_stats(device);
+	memset(&device->frame_stats, 0, sizeof(raster_stats_t));
+	device->blend_state.srcState = BLEND_ONE;
+	device->blend_state.dstState = BLEND_ZERO;
+	device->depth_func = DEPTH_FUNC_GEQUAL;
+	device->depth_write = true;
+	device->color_write = true;
+	device->pipeline_state_dirty = true;
+	device->vertex_cache = (vertex_cache_t*)malloc(sizeof(vertex_cache_t));
+	memset(device->vertex_cache->tag, 0, sizeof(device->vertex_cache->tag));
+	device->vertex_cache->draw_id = 0;
 }
 
 void device_destroy(device_t *device) {
+	tile_raster_destroy(device->tile_raster);
+	device->tile_raster = NULL;
+
+	free(device->vertex_cache);
+	device->vertex_cache = NULL;
+
+	hiz_destroy(device->hiz);
+	device->hiz = NULL;
+	for (int i = 0; i < MAX_FRAME_BUFFER; i++)
+	{
+		hiz_destroy(device->framebuffer_array[i].hiz);
+		device->framebuffer_array[i].hiz = NULL;
+	}
+
 	if (device->framebuffer)
 		free(device->framebuffer);
 	
@@ -90,29 +162,34 @@ void device_destroy(device_t *device) {
 
 	for (int i = 0; i < MAX_TEXTURE_NUM; i++)
 	{
+		texture_release(&device->texture_array[i]);
 		device->texture_array[i].texture = NULL;
 	}
 }
 
-// õǰ
+// 设置当前纹理
 void device_set_texture(device_t *device, void *bits, long pitch, int w, int h, int texture_id) {
-	char *ptr = (char*)bits;
-	int j;
-	assert(w <= 1024 && h <= 1024);
-	for (j = 0; j < h; ptr += pitch, j++) 	// ¼ÿָ
-	{
-		device->texture_array[texture_id].texture[j] = (IUINT32*)ptr;
-	}
-		
-	device->texture_array[texture_id].width = w;
-	device->texture_array[texture_id].height = h;
-	device->texture_array[texture_id].max_u = (float)(w - 1);
-	device->texture_array[texture_id].max_v = (float)(h - 1);
+	assert(w <= MAX_TEXTURE_SIZE && h <= MAX_TEXTURE_SIZE);
+	device_flush(device);
+	texture_set_data(&device->texture_array[texture_id], bits, pitch, w, h, TEXTURE_LAYOUT_LINEAR, TEXTURE_FORMAT_RGBA8);
+	device->texture_array[texture_id].framebuffer_id = RENDER_NO_SET_FRAMEBUFFER_INDEX;
+}
+
+void device_upload_texture(device_t *device, void *bits, long pitch, int w, int h, int texture_id) {
+	device_upload_texture_format(device, bits, pitch, w, h, TEXTURE_FORMAT_RGBA8, texture_id);
 }
 
-//  framebuffer  zbuffer
+void device_upload_texture_format(device_t *device, void *bits, long pitch, int w, int h, int format, int texture_id) {
+	assert(w <= MAX_TEXTURE_SIZE && h <= MAX_TEXTURE_SIZE);
+	device_flush(device);
+	texture_set_data(&device->texture_array[texture_id], bits, pitch, w, h, TEXTURE_LAYOUT_TILED, format);
+	device->texture_array[texture_id].framebuffer_id = RENDER_NO_SET_FRAMEBUFFER_INDEX;
+}
+
+// 清空 framebuffer 和 zbuffer
 void device_clear(device_t *device, int mode) {
 	int y, x, height = device->framebuffer_height;
+	device_flush(device);
 	for (y = 0; y < device->framebuffer_height; y++) {
 		IUINT32 *dst = device->framebuffer[y];
 		IUINT32 cc = (height - 1 - y) * 230 / (height - 1);
@@ -130,6 +207,7 @@ void device_clear(device_t *device, int mode) {
 		float *dst = device->zbuffer[y];
 		for (x = device->framebuffer_width; x > 0; dst++, x--) dst[0] = 0.0f;
 	}
+	hiz_clear(device->hiz, device->framebuffer_width, device->framebuffer_height, 0.0f);
 }
 
 int device_gen_frame_buffer(device_t* device)
@@ -139,6 +217,10 @@ int device_gen_frame_buffer(device_t* device)
 		if (device->framebuffer_array[i].is_used == false)
 		{
 			device->framebuffer_array[i].is_used = true;
+			device->framebuffer_array[i].width = 0;
+			device->framebuffer_array[i].height = 0;
+			device->framebuffer_array[i].depth_only = false;
+			device->pipeline_state_dirty = true;
 			return i;
 		}
 	}
@@ -146,6 +228,66 @@ int device_gen_frame_buffer(device_t* device)
 	return -1;
 }
 
+int device_gen_depth_frame_buffer(device_t* device, int width, int height)
+{
+	if (width <= 0 || height <= 0 || width > MAX_FRAME_BUFFER_WIDTH || height > MAX_FRAME_BUFFER_HEIGHT)
+	{
+		return -1;
+	}
+
+	int framebuffer_id = device_gen_frame_buffer(device);
+	if (framebuffer_id >= 0)
+	{
+		device->framebuffer_array[framebuffer_id].width = width;
+		device->framebuffer_array[framebuffer_id].height = height;
+		device->framebuffer_array[framebuffer_id].depth_only = true;
+	}
+	return framebuffer_id;
+}
+
+// framebuffer 的大小，没有自己的大小或为 RENDER_NO_SET_FRAMEBUFFER_INDEX 时为主 framebuffer 的大小
+static void device_get_framebuffer_size(const device_t* device, int framebuffer_id, int* width, int* height)
+{
+	if (framebuffer_id != RENDER_NO_SET_FRAMEBUFFER_INDEX && device->framebuffer_array[framebuffer_id].width > 0)
+	{
+		*width = device->framebuffer_array[framebuffer_id].width;
+		*height = device->framebuffer_array[framebuffer_id].height;
+		return;
+	}
+
+	int scale = (device->function_state & FUNC_STATE_ANTI_ALIAS_FSAA) ? 2 : 1;
+	*width = device->screen_width * scale;
+	*height = device->screen_height * scale;
+}
+
+// 渲染目标或 FSAA 改变后，framebuffer_width/height、视口和投影切换为渲染目标的大小
+static void device_update_render_target_size(device_t* device)
+{
+	int width, height;
+	device_get_framebuffer_size(device, device->bind_frame_buffer_idx, &width, &height);
+	device->framebuffer_width = width;
+	device->framebuffer_height = height;
+	device_set_viewport(device, 0, 0, width, height);
+}
+
+void device_set_viewport(device_t* device, int x, int y, int width, int height)
+{
+	int x1 = CMID(x + width, 0, device->framebuffer_width);
+	int y1 = CMID(y + height, 0, device->framebuffer_height);
+	x = CMID(x, 0, x1);
+	y = CMID(y, 0, y1);
+	if (x1 - x <= 0 || y1 - y <= 0)
+	{
+		return;
+	}
+
+	device->viewport_x = x;
+	device->viewport_y = y;
+	device->viewport_width = x1 - x;
+	device->viewport_height = y1 - y;
+	transform_set_viewport(&device->transform, x, y, x1 - x, y1 - y);
+}
+
 bool device_bind_framebuffer(device_t* device, int framebuffer_id)
 {
 	if (framebuffer_id < 0 || framebuffer_id >= MAX_FRAME_BUFFER)
@@ -158,7 +300,10 @@ bool device_bind_framebuffer(device_t* device, int framebuffer_id)
 		return false;
 	}
 
+	device_flush(device);
 	device->bind_frame_buffer_idx = framebuffer_id;
+	device_update_render_target_size(device);
+	device->pipeline_state_dirty = true;
 	return true;
 }
 
@@ -174,7 +319,69 @@ bool device_unbind_framebuffer(device_t* device, int framebuffer_id)
 		return false;
 	}
 
+	device_flush(device);
 	device->bind_frame_buffer_idx = RENDER_NO_SET_FRAMEBUFFER_INDEX;
+	device_update_render_target_size(device);
+	device->pipeline_state_dirty = true;
+	return true;
+}
+
+// 按 framebuffer 当前的大小引用其平面，framebuffer 的行连续存放
+static void device_attach_framebuffer_texture(device_t* device, texture_t* texture)
+{
+	framebuffer_t *framebuffer = &device->framebuffer_array[texture->framebuffer_id];
+	int width, height;
+	device_get_framebuffer_size(device, texture->framebuffer_id, &width, &height);
+	if (texture->framebuffer_plane == FRAMEBUFFER_PLANE_DEPTH)
+	{
+		texture_set_data(texture, framebuffer->zbuffer[0], MAX_FRAME_BUFFER_WIDTH * sizeof(float), width, height, TEXTURE_LAYOUT_LINEAR, TEXTURE_FORMAT_R32F);
+	}
+	else
+	{
+		texture_set_data(texture, framebuffer->framebuffer[0], MAX_FRAME_BUFFER_WIDTH * sizeof(IUINT32), width, height, TEXTURE_LAYOUT_LINEAR, TEXTURE_FORMAT_RGBA8);
+	}
+}
+
+// framebuffer 大小改变后更新引用 framebuffer 的纹理
+static void device_update_framebuffer_textures(device_t* device)
+{
+	device_flush(device);
+	for (int i = 0; i < MAX_TEXTURE_NUM; i++)
+	{
+		if (device->texture_array[i].framebuffer_id != RENDER_NO_SET_FRAMEBUFFER_INDEX)
+		{
+			device_attach_framebuffer_texture(device, &device->texture_array[i]);
+		}
+	}
+}
+
+bool device_set_framebuffer_texture(device_t* device, int texture_id, int framebuffer_id, int plane)
+{
+	if (texture_id < 0 || texture_id >= MAX_TEXTURE_NUM || device->texture_array[texture_id].is_used == false)
+	{
+		return false;
+	}
+
+	if (framebuffer_id < 0 || framebuffer_id >= MAX_FRAME_BUFFER)
+	{
+		return false;
+	}
+
+	if (device->framebuffer_array[framebuffer_id].is_used == false)
+	{
+		return false;
+	}
+
+	if (device->framebuffer_array[framebuffer_id].depth_only && plane != FRAMEBUFFER_PLANE_DEPTH)
+	{
+		return false;
+	}
+
+	device_flush(device);
+	texture_t *texture = &device->texture_array[texture_id];
+	texture->framebuffer_id = framebuffer_id;
+	texture->framebuffer_plane = plane;
+	device_attach_framebuffer_texture(device, texture);
 	return true;
 }
 
@@ -190,9 +397,13 @@ void device_clear_framebuffer(device_t* device,  int framebuffer_id, int mode)
 		return;
 	}
 
-	int y, x, height = device->framebuffer_height;
-	for (y = 0; y < device->framebuffer_height; y++) {
-		IUINT32 *dst = device->framebuffer_array[framebuffer_id].framebuffer[y];
+	device_flush(device);
+
+	framebuffer_t *framebuffer = &device->framebuffer_array[framebuffer_id];
+	int y, x, width, height;
+	device_get_framebuffer_size(device, framebuffer_id, &width, &height);
+	for (y = 0; y < height && !framebuffer->depth_only; y++) {
+		IUINT32 *dst = framebuffer->framebuffer[y];
 		IUINT32 cc = (height - 1 - y) * 230 / (height - 1);
 
 #ifdef USE_GDI_VIEW
@@ -202,12 +413,13 @@ void device_clear_framebuffer(device_t* device,  int framebuffer_id, int mode)
 #endif
 
 		if (mode == 0) cc = device->background;
-		for (x = device->framebuffer_width; x > 0; dst++, x--) dst[0] = cc;
+		for (x = width; x > 0; dst++, x--) dst[0] = cc;
 	}
-	for (y = 0; y < device->framebuffer_height; y++) {
-		float *dst = device->framebuffer_array[framebuffer_id].zbuffer[y];
-		for (x = device->framebuffer_width; x > 0; dst++, x--) dst[0] = 0.0f;
+	for (y = 0; y < height; y++) {
+		float *dst = framebuffer->zbuffer[y];
+		for (x = width; x > 0; dst++, x--) dst[0] = 0.0f;
 	}
+	hiz_clear(framebuffer->hiz, width, height, 0.0f);
 }
 
 void device_copy_framebuffer(device_t* device, int framebuffer_id, IUINT32** buffer)
@@ -222,6 +434,8 @@ void device_copy_framebuffer(device_t* device, int framebuffer_id, IUINT32** buf
 		return;
 	}
 	
+	device_flush(device);
+
 	int y, x, height = device->framebuffer_height;
 	for (y = 0; y < device->framebuffer_height; y++) {
 		;
@@ -244,6 +458,8 @@ void device_copy_framebuffer_z(device_t* device, int framebuffer_id, float** zbu
 		return;
 	}
 
+	device_flush(device);
+
 	int y, x, height = device->framebuffer_height;
 	for (y = 0; y < device->framebuffer_height; y++) {
 		;
@@ -254,9 +470,77 @@ void device_copy_framebuffer_z(device_t* device, int framebuffer_id, float** zbu
 	}
 }
 
+void device_copy_framebuffer_depth(device_t* device, int dst_framebuffer_id, int src_framebuffer_id, int x, int y, int width, int height)
+{
+	if (dst_framebuffer_id < 0 || dst_framebuffer_id >= MAX_FRAME_BUFFER || src_framebuffer_id < 0 || src_framebuffer_id >= MAX_FRAME_BUFFER)
+	{
+		return;
+	}
+
+	if (device->framebuffer_array[dst_framebuffer_id].is_used == false || device->framebuffer_array[src_framebuffer_id].is_used == false)
+	{
+		return;
+	}
+
+	device_flush(device);
+
+	framebuffer_t *dst = &device->framebuffer_array[dst_framebuffer_id];
+	const framebuffer_t *src = &device->framebuffer_array[src_framebuffer_id];
+	int dst_width, dst_height, src_width, src_height;
+	device_get_framebuffer_size(device, dst_framebuffer_id, &dst_width, &dst_height);
+	device_get_framebuffer_size(device, src_framebuffer_id, &src_width, &src_height);
+	int x1 = CMID(x + width, 0, dst_width < src_width ? dst_width : src_width);
+	int y1 = CMID(y + height, 0, dst_height < src_height ? dst_height : src_height);
+	x = CMID(x, 0, x1);
+	y = CMID(y, 0, y1);
+	if (x >= x1)
+	{
+		return;
+	}
+
+	for (int j = y; j < y1; j++) {
+		memcpy(dst->zbuffer[j] + x, src->zbuffer[j] + x, (x1 - x) * sizeof(float));
+		hiz_mark_dirty(dst->hiz, j, x, x1);
+	}
+}
+
+void device_clear_framebuffer_depth(device_t* device, int framebuffer_id, int x, int y, int width, int height)
+{
+	if (framebuffer_id < 0 || framebuffer_id >= MAX_FRAME_BUFFER)
+	{
+		return;
+	}
+
+	if (device->framebuffer_array[framebuffer_id].is_used == false)
+	{
+		return;
+	}
+
+	device_flush(device);
+
+	framebuffer_t *framebuffer = &device->framebuffer_array[framebuffer_id];
+	int framebuffer_width, framebuffer_height;
+	device_get_framebuffer_size(device, framebuffer_id, &framebuffer_width, &framebuffer_height);
+	int x1 = CMID(x + width, 0, framebuffer_width);
+	int y1 = CMID(y + height, 0, framebuffer_height);
+	x = CMID(x, 0, x1);
+	y = CMID(y, 0, y1);
+	if (x >= x1)
+	{
+		return;
+	}
+
+	for (int j = y; j < y1; j++) {
+		float *dst = framebuffer->zbuffer[j];
+		for (int i = x; i < x1; i++) dst[i] = 0.0f;
+		hiz_mark_dirty(framebuffer->hiz, j, x, x1);
+	}
+}
+
 void device_copy_colorbuffer(device_t* device, IUINT32** buffer)
 {
 	int y, x, height = device->framebuffer_height;
+	device_flush(device);
 	for (y = 0; y < device->framebuffer_height; y++) {;
 		for (x = 0; x < device->framebuffer_width; x++)
 		{
@@ -268,31 +552,32 @@ void device_copy_colorbuffer(device_t* device, IUINT32** buffer)
 void device_set_shader_state(device_t* device, int shader_state)
 {
 	device->shader_state = shader_state;
+	device->pipeline_state_dirty = true;
 }
 
-// ȡ
+// 根据坐标读取纹理
 IUINT32 device_texture_read(const device_t *device, float u, float v, int texture_id) {
-	int x, y;
-	u = u * device->texture_array[texture_id].max_u;
-	v = v * device->texture_array[texture_id].max_v;
-	x = (int)(u + 0.5f);
-	y = (int)(v + 0.5f);
-	x = CMID(x, 0, device->texture_array[texture_id].width - 1);
-	y = CMID(y, 0, device->texture_array[texture_id].height - 1);
-	return device->texture_array[texture_id].texture[y][x];
+	return texture_read(&device->texture_array[texture_id], u, v);
+}
+
+IUINT32 device_texture_sample(const device_t *device, int iIndex, float u, float v, float lod)
+{
+	return texture_sample(&device->texture_array[device->texture_id[iIndex]], &device->sampler_array[device->sampler_id[iIndex]].state, u, v, lod);
 }
 
 float device_texture_read_float(const device_t *device, float u, float v, int texture_id)
 {
-	int x, y;
-	u = u * device->texture_array[texture_id].max_u;
-	v = v * device->texture_array[texture_id].max_v;
-	x = (int)(u + 0.5f);
-	y = (int)(v + 0.5f);
-	x = CMID(x, 0, device->texture_array[texture_id].width - 1);
-	y = CMID(y, 0, device->texture_array[texture_id].height - 1);
-	float* ptr =  (float*)(&(device->texture_array[texture_id].texture[y][x]));
-	return *ptr;
+	return texture_read_float(&device->texture_array[texture_id], u, v);
+}
+
+float device_texture_sample_float(const device_t *device, int iIndex, float u, float v, float lod)
+{
+	return texture_sample_float(&device->texture_array[device->texture_id[iIndex]], &device->sampler_array[device->sampler_id[iIndex]].state, u, v, lod);
+}
+
+float device_texture_sample_compare(const device_t *device, int iIndex, float u, float v, float ref)
+{
+	return texture_sample_compare(&device->texture_array[device->texture_id[iIndex]], &device->sampler_array[device->sampler_id[iIndex]].state, u, v, ref);
 }
 
 void device_set_vertex_attrib_pointer(device_t* device, vertex_t* vertex_array)
@@ -305,6 +590,7 @@ void device_set_uniform_vector_value(device_t* device, int iUniformIndex, vector
 	if (iUniformIndex >= 0 && iUniformIndex < MAX_UNIFORM_NUM)
 	{
 		device->uniform_vector[iUniformIndex] = *(pVec);
+		if (iUniformIndex >= device->uniform_vector_num) device->uniform_vector_num = iUniformIndex + 1;
 	}
 }
 
@@ -313,6 +599,7 @@ void device_set_uniform_matrix_value(device_t* device, int iUniformIndex, matrix
 	if (iUniformIndex >= 0 && iUniformIndex < MAX_UNIFORM_NUM)
 	{
 		device->uniform_matrix[iUniformIndex] = *(pMat);
+		if (iUniformIndex >= device->uniform_matrix_num) device->uniform_matrix_num = iUniformIndex + 1;
 	}
 }
 
@@ -343,6 +630,63 @@ void device_bind_texture(device_t* device, int iIndex, int texture_id)
 	}
 }
 
+void device_generate_mipmap(device_t* device, int texture_id)
+{
+	if (texture_id < 0 || texture_id >= MAX_TEXTURE_NUM || device->texture_array[texture_id].is_used == false)
+	{
+		return;
+	}
+
+	// framebuffer 的内容随绘制改变，mipmap 会过期
+	if (device->texture_array[texture_id].framebuffer_id != RENDER_NO_SET_FRAMEBUFFER_INDEX)
+	{
+		return;
+	}
+
+	device_flush(device);
+	texture_generate_mipmap(&device->texture_array[texture_id]);
+}
+
+int device_gen_sampler(device_t* device)
+{
+	for (int i = 0; i < MAX_SAMPLER_NUM; i++)
+	{
+		if (device->sampler_array[i].is_used == false)
+		{
+			device->sampler_array[i].is_used = true;
+			device->sampler_array[i].state = device->sampler_array[DEFAULT_SAMPLER_ID].state;
+			return i;
+		}
+	}
+
+	return -1;
+}
+
+void device_set_sampler_state(device_t* device, int sampler_id, samplerstate_t sampler_state)
+{
+	if (sampler_id < 0 || sampler_id >= MAX_SAMPLER_NUM || device->sampler_array[sampler_id].is_used == false)
+	{
+		return;
+	}
+
+	// 分块光栅化绘制时直接读取采样器表，修改前先完成已提交的绘制
+	device_flush(device);
+	device->sampler_array[sampler_id].state = sampler_state;
+}
+
+void device_bind_sampler(device_t* device, int iIndex, int sampler_id)
+{
+	if (iIndex < 0 || iIndex >= MAX_TEXTURE_NUM || sampler_id < 0 || sampler_id >= MAX_SAMPLER_NUM)
+	{
+		return;
+	}
+
+	if (device->sampler_array[sampler_id].is_used == true)
+	{
+		device->sampler_id[iIndex] = sampler_id;
+	}
+}
+
 unsigned int device_get_framebuffer_data(device_t* device, int h, int w)
 {
 	if (device->function_state & FUNC_STATE_ANTI_ALIAS_FSAA)
@@ -397,6 +741,8 @@ unsigned int device_enable_render_func_state(device_t* device, int iState)
 		device->framebuffer_height = device->screen_height * 2;
 		transform_init(&device->transform, device->framebuffer_width, device->framebuffer_height);
 		device->function_state |= FUNC_STATE_ANTI_ALIAS_FSAA;
+		device_update_render_target_size(device);
+		device_update_framebuffer_textures(device);
 		return 0;
 	}
 	else if (iState == FUNC_STATE_CULL_BACK)
@@ -407,6 +753,29 @@ unsigned int device_enable_render_func_state(device_t* device, int iState)
 		}
 
 		device->function_state |= FUNC_STATE_CULL_BACK;
+		device->pipeline_state_dirty = true;
+		return 0;
+	}
+	else if (iState == FUNC_STATE_HIERARCHICAL_Z)
+	{
+		if (device->function_state & FUNC_STATE_HIERARCHICAL_Z)
+		{
+			return 1;
+		}
+
+		device_flush(device);
+		device->function_state |= FUNC_STATE_HIERARCHICAL_Z;
+		device->pipeline_state_dirty = true;
+		return 0;
+	}
+	else if (iState == FUNC_STATE_DEPTH_PREPASS)
+	{
+		if (device->function_state & FUNC_STATE_DEPTH_PREPASS)
+		{
+			return 1;
+		}
+
+		device->function_state |= FUNC_STATE_DEPTH_PREPASS;
 		return 0;
 	}
 
@@ -423,6 +792,8 @@ unsigned int device_disable_render_func_state(device_t* device, int iState)
 			device->framebuffer_height = device->screen_height;
 			transform_init(&device->transform, device->framebuffer_width, device->framebuffer_height);
 			device->function_state &= ~(FUNC_STATE_ANTI_ALIAS_FSAA);
+			device_update_render_target_size(device);
+			device_update_framebuffer_textures(device);
 			return 0;
 		}
 	}
@@ -431,6 +802,25 @@ unsigned int device_disable_render_func_state(device_t* device, int iState)
 		if (device->function_state & FUNC_STATE_CULL_BACK)
 		{
 			device->function_state &= ~(FUNC_STATE_CULL_BACK);
+			device->pipeline_state_dirty = true;
+			return 0;
+		}
+	}
+	else if (iState == FUNC_STATE_HIERARCHICAL_Z)
+	{
+		if (device->function_state & FUNC_STATE_HIERARCHICAL_Z)
+		{
+			device_flush(device);
+			device->function_state &= ~(FUNC_STATE_HIERARCHICAL_Z);
+			device->pipeline_state_dirty = true;
+			return 0;
+		}
+	}
+	else if (iState == FUNC_STATE_DEPTH_PREPASS)
+	{
+		if (device->function_state & FUNC_STATE_DEPTH_PREPASS)
+		{
+			device->function_state &= ~(FUNC_STATE_DEPTH_PREPASS);
 			return 0;
 		}
 	}
@@ -441,11 +831,30 @@ unsigned int device_disable_render_func_state(device_t* device, int iState)
 void device_set_blend_state(device_t* device, blendstate_t blend_state)
 {
 	device->blend_state = blend_state;
+	device->pipeline_state_dirty = true;
+}
+
+void device_set_depth_func(device_t* device, int depth_func)
+{
+	device->depth_func = depth_func & DEPTH_FUNC_ALWAYS;
+	device->pipeline_state_dirty = true;
+}
+
+void device_set_depth_write(device_t* device, bool depth_write)
+{
+	device->depth_write = depth_write;
+	device->pipeline_state_dirty = true;
+}
+
+void device_set_color_write(device_t* device, bool color_write)
+{
+	device->color_write = color_write;
+	device->pipeline_state_dirty = true;
 }
 
 int function_cull_back(device_t* device, point_t* p1, point_t* p2, point_t* p3)
 {
-	if (device->function_state & FUNC_STATE_CULL_BACK)
+	if (device->pipeline_state.cull_mode == CULL_MODE_BACK)
 	{
 		vector_t dirPrimitive, vec1, vec2;
 
@@ -471,4 +880,142 @@ device_t* get_device_inst()
 		g_pRenderDevice = new device_t;
 	}
 	return g_pRenderDevice;
+}
+
+void device_set_raster_mode(device_t* device, int raster_mode)
+{
+	device_flush(device);
+	device->raster_mode = raster_mode;
+}
+
+void device_set_raster_algorithm(device_t* device, int raster_algorithm)
+{
+	device_flush(device);
+	device->raster_algorithm = raster_algorithm;
+}
+
+void device_set_raster_thread_num(device_t* device, int thread_num)
+{
+	device_flush(device);
+	device->raster_thread_num = CMID(thread_num, 1, TILE_MAX_THREAD_NUM);
+}
+
+void device_reset_raster_stats(device_t* device)
+{
+	memset(&device->raster_stats, 0, sizeof(raster_stats_t));
+	memset(&device->frame_begin_stats, 0, sizeof(raster_stats_t));
+}
+
+void device_create_pipeline_state(device_t* device, pipeline_state_t* pipeline_state)
+{
+	const RenderComponent *component = get_render_component(device);
+	pipeline_state->vertex_shader = component ? component->p_vertex_shader : NULL;
+	pipeline_state->vertex_position_shader = component ? component->p_vertex_position : NULL;
+	pipeline_state->vertex_attribute_shader = component ? component->p_vertex_attribute : NULL;
+	pipeline_state->pixel_shader = component ? component->p_pixel_shader : NULL;
+	pipeline_state->pixel_shader_packet = component ? component->p_pixel_shader_packet : NULL;
+	pipeline_state->quad_shading = pipeline_state->pixel_shader_packet != NULL && (component->pixel_shader_flags & PIXEL_SHADER_FLAG_DERIVATIVE);
+
+	pipeline_state->framebuffer = device->framebuffer;
+	pipeline_state->zbuffer = device->zbuffer;
+	pipeline_state->hiz = device->hiz;
+	pipeline_state->color_write = device->color_write;
+	if (device->bind_frame_buffer_idx >= 0 && device->bind_frame_buffer_idx < MAX_FRAME_BUFFER && device->framebuffer_array[device->bind_frame_buffer_idx].is_used)
+	{
+		pipeline_state->framebuffer = device->framebuffer_array[device->bind_frame_buffer_idx].framebuffer;
+		pipeline_state->zbuffer = device->framebuffer_array[device->bind_frame_buffer_idx].zbuffer;
+		pipeline_state->hiz = device->framebuffer_array[device->bind_frame_buffer_idx].hiz;
+		if (device->framebuffer_array[device->bind_frame_buffer_idx].depth_only)
+		{
+			pipeline_state->color_write = false;
+		}
+	}
+
+	// 只写深度时只插值位置，没有对应的组件时插值全部属性
+	int varying_mask = component ? component->varying_mask : VARYING_ALL;
+	varying_layout_init(&pipeline_state->varying_layout, pipeline_state->color_write ? varying_mask : 0);
+	pipeline_state->texture_mask = pipeline_state->color_write && component ? component->texture_mask : 0;
+
+	pipeline_state->blend_state = device->blend_state;
+	pipeline_state->cull_mode = (device->function_state & FUNC_STATE_CULL_BACK) ? CULL_MODE_BACK : CULL_MODE_NONE;
+
+	pipeline_state->depth_func = device->depth_func;
+	pipeline_state->depth_write = device->depth_write;
+	pipeline_state->hiz_reject = (device->function_state & FUNC_STATE_HIERARCHICAL_Z) && !(device->depth_func & DEPTH_FUNC_LESS);
+	pipeline_state->hiz_accept = pipeline_state->hiz_reject && (device->depth_func & DEPTH_FUNC_GREATER);
+
+	raster_select_kernel(pipeline_state, false);
+}
+
+void device_bind_pipeline_state(device_t* device, const pipeline_state_t* pipeline_state)
+{
+	device->pipeline_state = *pipeline_state;
+	device->pipeline_state_dirty = false;
+}
+
+// 着色器读取的纹理引用了当前的渲染目标
+static bool device_framebuffer_feedback(const device_t* device)
+{
+	const pipeline_state_t *pso = &device->pipeline_state;
+	for (int i = 0; i < MAX_TEXTURE_NUM; i++)
+	{
+		if (!(pso->texture_mask & TEXTURE_UNIT_MASK(i)))
+		{
+			continue;
+		}
+
+		const texture_t *texture = &device->texture_array[device->texture_id[i]];
+		if (texture->framebuffer_id != RENDER_NO_SET_FRAMEBUFFER_INDEX && device->framebuffer_array[texture->framebuffer_id].zbuffer == pso->zbuffer)
+		{
+			return true;
+		}
+	}
+	return false;
+}
+
+bool device_begin_draw(device_t* device)
+{
+	if (device->pipeline_state_dirty)
+	{
+		device_create_pipeline_state(device, &device->pipeline_state);
+		device->pipeline_state_dirty = false;
+	}
+
+	if (device->pipeline_state.texture_mask && device_framebuffer_feedback(device))
+	{
+		return false;
+	}
+
+	if (device->tile_raster)
+	{
+		tile_raster_begin_draw(device->tile_raster);
+	}
+	return true;
+}
+
+void device_flush(device_t* device)
+{
+	if (device->tile_raster)
+	{
+		tile_raster_flush(device);
+	}
+}
+
+void device_end_frame(device_t* device)
+{
+	device_flush(device);
+
+	device->frame_stats = device->raster_stats;
+	device->frame_stats.vertex_shader_num -= device->frame_begin_stats.vertex_shader_num;
+	device->frame_stats.vertex_attribute_num -= device->frame_begin_stats.vertex_attribute_num;
+	device->frame_stats.triangle_num -= device->frame_begin_stats.triangle_num;
+	device->frame_stats.covered_pixel_num -= device->frame_begin_stats.covered_pixel_num;
+	device->frame_stats.shaded_pixel_num -= device->frame_begin_stats.shaded_pixel_num;
+	device->frame_stats.helper_pixel_num -= device->frame_begin_stats.helper_pixel_num;
+	device->frame_stats.hiz_triangle_test_num -= device->frame_begin_stats.hiz_triangle_test_num;
+	device->frame_stats.hiz_triangle_reject_num -= device->frame_begin_stats.hiz_triangle_reject_num;
+	device->frame_stats.hiz_block_test_num -= device->frame_begin_stats.hiz_block_test_num;
+	device->frame_stats.hiz_block_reject_num -= device->frame_begin_stats.hiz_block_reject_num;
+	device->frame_stats.hiz_block_accept_num -= device->frame_begin_stats.hiz_block_accept_num;
+	device->frame_begin_stats = device->raster_stats;
 }
\ No newline at end of file
@@ -6,103 +6,340 @@
 #include "geometry.h"
 
 //=====================================================================
-// Ⱦ豸
+// 渲染设备
 //=====================================================================
 
+#define MAX_TEXTURE_SIZE 1024
+#define MAX_TEXTURE_LEVEL 11	// 1024 到 1 共 11 层
+
+// 纹素排列
+#define TEXTURE_LAYOUT_LINEAR	0	// 按行排列，引用 device_set_texture 传入的数据
+#define TEXTURE_LAYOUT_TILED	1	// 复制为 4x4 的纹素块，块按行排列，一块 64 字节正好是一个缓存行
+#define TEXTURE_TILE_SHIFT		2
+#define TEXTURE_TILE_SIZE		(1 << TEXTURE_TILE_SHIFT)
+
+// 纹素格式
+#define TEXTURE_FORMAT_RGBA8	0	// 每个纹素 32 位，R G B A 从高到低
+#define TEXTURE_FORMAT_BC1		1	// 每个纹素块压缩为 8 字节，没有透明度
+#define TEXTURE_FORMAT_BC3		2	// 每个纹素块压缩为 16 字节，透明度单独压缩
+#define TEXTURE_FORMAT_R8		3	// 单通道 8 位，如遮罩
+#define TEXTURE_FORMAT_RG8		4
+#define TEXTURE_FORMAT_RGB565	5	// 没有透明度的颜色，如光照图
+#define TEXTURE_FORMAT_R16F		6	// 单通道半精度浮点，如深度
+#define TEXTURE_FORMAT_R32F		7
+
 typedef struct {
-	IUINT32 **texture; //  ͬÿ
+	IUINT32 *bits;	// 第一行
+	int pitch;		// 每行占用的 IUINT32 数，RGBA8 时即纹素数，TILED 时为每行纹素块占用的 IUINT32 数
 	int width;
 	int height;
 	float max_u;
 	float max_v;
+} texture_level_t;
+
+typedef struct {
+	IUINT32 **texture; // 纹理数据 同样是每行索引，只在 LINEAR 时有效，其他排列为 NULL
+	int width;
+	int height;
+	float max_u;
+	float max_v;
+	texture_level_t level[MAX_TEXTURE_LEVEL];	// LINEAR 时 level[0] 即 texture
+	int level_num;			// 1 表示没有生成 mipmap
+	int layout;				// TEXTURE_LAYOUT_*，所有层相同
+	int format;				// TEXTURE_FORMAT_*，所有层相同
+	IUINT32 *texel_buffer;	// TILED 时 level 0 的数据
+	IUINT32 *mip_buffer;	// level 1 以后各层的数据
+	int framebuffer_id;		// 直接引用的 framebuffer，RENDER_NO_SET_FRAMEBUFFER_INDEX 表示纹理有自己的数据
+	int framebuffer_plane;	// FRAMEBUFFER_PLANE_*
 	bool is_used;
 } texture_t;
 
+// 纹理坐标超出 [0, 1] 时的处理
+#define SAMPLER_WRAP_REPEAT		0
+#define SAMPLER_WRAP_MIRROR		1
+#define SAMPLER_WRAP_CLAMP		2	// 截断到边缘的纹素
+
+// 层内的过滤方式
+#define SAMPLER_FILTER_NEAREST	0
+#define SAMPLER_FILTER_BILINEAR	1	// 8.8 定点权重
+
+// mipmap 层之间的过滤方式
+#define SAMPLER_MIP_FILTER_NONE		0	// 只读取 level 0
+#define SAMPLER_MIP_FILTER_NEAREST	1	// 选最接近的一层
+#define SAMPLER_MIP_FILTER_LINEAR	2	// 相邻两层分别采样后插值，与双线性过滤一起即三线性过滤
+
+// 比较采样（阴影图）读取的纹素，每个纹素与参考值比较后按权重混合比较结果
+#define SAMPLER_PCF_NONE	0	// 只比较最近的纹素
+#define SAMPLER_PCF_2X2		1	// 双线性过滤的 2x2 纹素，按双线性权重混合
+#define SAMPLER_PCF_3X3		2	// 以最近的纹素为中心的 3x3 纹素，权重相同
+#define SAMPLER_PCF_5X5		3
+
+typedef struct {
+	int wrap_u;		// SAMPLER_WRAP_*
+	int wrap_v;
+	int filter;		// SAMPLER_FILTER_*
+	int mip_filter;	// SAMPLER_MIP_FILTER_*
+	int pcf;		// SAMPLER_PCF_*，只用于比较采样
+} samplerstate_t;
+
+typedef struct {
+	samplerstate_t state;
+	bool is_used;
+} sampler_t;
+
+typedef struct hiz_buffer_t hiz_buffer_t;
+
 typedef struct {
 	IUINT32 **framebuffer;
 	float **zbuffer;
+	hiz_buffer_t *hiz;	// 深度缓存的层次深度
+	int width;			// 为 0 时与主 framebuffer 大小相同
+	int height;
+	bool depth_only;	// 只写深度，绑定时不执行片元着色
 	bool is_used;
 } framebuffer_t;
 
 #define MAX_UNIFORM_NUM 128
 #define MAX_TEXTURE_NUM 16
+#define MAX_SAMPLER_NUM 16
+#define DEFAULT_SAMPLER_ID 0	// CLAMP，最近点采样，不使用 mipmap
 #define MAX_VERTEX_NUM 4
+#define MAX_VERTEX_CACHE_NUM 1024	// 顶点变换缓存的大小，索引不小于该值的绘制不使用缓存
 #define MAX_FRAME_BUFFER 4
 #define RENDER_NO_SET_FRAMEBUFFER_INDEX -1
 
 #define MAX_FRAME_BUFFER_HEIGHT 1024
 #define MAX_FRAME_BUFFER_WIDTH 1024
 
+// 作为纹理绑定的 framebuffer 平面
+#define FRAMEBUFFER_PLANE_COLOR	0	// RGBA8，与 framebuffer 的像素相同
+#define FRAMEBUFFER_PLANE_DEPTH	1	// R32F，即深度缓存中的 rhw，没有绘制的位置为 0
+
+#define TEXTURE_UNIT_MASK(i)	(1 << (i))
+
 typedef struct {
 	int srcState;
 	int dstState;
 } blendstate_t;
 
+typedef struct tile_raster_t tile_raster_t;
+typedef struct device_t device_t;
+
+typedef void(*func_vertex_shader)(device_t* device, vertex_t* vertex, point_t* output);
+typedef void(*func_vertex_shader_batch)(device_t* device, vertex_t* vertices, point_t* outputs, int count);	// 对连续的 count 个顶点着色，裁剪空间坐标写入 outputs
+typedef void(*func_vertex_attribute_shader)(device_t* device, vertex_t** vertices, int count);	// 只计算 count 个顶点输出的插值属性，不计算位置
+typedef IUINT32 (*func_pixel_shader)(device_t* device, vertex_t* vertex);
+typedef void(*func_pixel_shader_packet)(device_t* device, const pixel_packet_t* packet, IUINT32* colors);	// 为 packet 中的每个片元输出颜色到 colors
+
+// 光栅化内核，按管线状态选择特化版本，见 raster_kernel.h
+typedef struct raster_region_t raster_region_t;
+typedef void(*func_scanline_kernel)(device_t *device, scanline_t *scanline, raster_region_t *region);
+typedef bool(*func_write_pixel)(device_t *device, IUINT32 *framebuffer, float *zbuffer, int x, float rhw, IUINT32 color);
+
+#define CULL_MODE_NONE		0
+#define CULL_MODE_BACK		1
+
+// 深度比较函数：比较片元与深度缓存中的 rhw，rhw 越大越近，按位组合 小于/等于/大于
+#define DEPTH_FUNC_NEVER	0
+#define DEPTH_FUNC_LESS		1
+#define DEPTH_FUNC_EQUAL	2
+#define DEPTH_FUNC_LEQUAL	3
+#define DEPTH_FUNC_GREATER	4
+#define DEPTH_FUNC_NOTEQUAL	5
+#define DEPTH_FUNC_GEQUAL	6	// 默认，更近或相等时通过
+#define DEPTH_FUNC_ALWAYS	7
+
+// 管线状态：绘制时用到的状态在状态改变后编译一次，光栅化内循环直接使用，不再查表
+typedef struct {
+	func_vertex_shader vertex_shader;
+	func_vertex_shader_batch vertex_position_shader;	// 不为 NULL 时顶点着色拆分为位置和属性两部分，先按位置剔除三角形
+	func_vertex_attribute_shader vertex_attribute_shader;	// 可见三角形的顶点再计算属性，着色器只输出位置时为 NULL
+	func_pixel_shader pixel_shader;
+	func_pixel_shader_packet pixel_shader_packet;	// 不为 NULL 时光栅化按片元包着色
+	bool quad_shading;		// 片元包按 2x2 像素块排列，着色器可以计算导数，只有边函数光栅化支持
+	varying_layout_t varying_layout;	// 片元着色器需要插值的属性
+	int texture_mask;		// 片元着色器读取的纹理单元 TEXTURE_UNIT_MASK(i)
+
+	// 渲染目标，已按绑定的 framebuffer 解析
+	IUINT32 **framebuffer;
+	float **zbuffer;
+	hiz_buffer_t *hiz;
+
+	blendstate_t blend_state;
+	int cull_mode;
+
+	bool color_write;	// 为 false 时不执行片元着色，只写深度
+
+	// 深度模式
+	int depth_func;
+	bool depth_write;
+	bool hiz_reject;	// 层次深度剔除，比较函数不含小于时有效
+	bool hiz_accept;	// 块内必定通过深度测试时跳过逐像素比较，比较函数含大于时有效
+
+	// 按深度测试、深度写入、混合模式和目标格式选出的光栅化内核
+	func_scanline_kernel scanline_kernel;
+	func_write_pixel write_pixel;
+} pipeline_state_t;
+
+#define RASTER_MODE_SERIAL		0	// 单线程整屏光栅化，作为参考实现
+#define RASTER_MODE_TILE		1	// 分块多线程光栅化
+
+#define RASTER_ALGORITHM_TRAPEZOID	0	// 梯形扫描线
+#define RASTER_ALGORITHM_HALFSPACE	1	// 边函数，按 8x8 块判断覆盖
+
+// 光栅化统计
 typedef struct {
-	transform_t transform;      // 任
-	int screen_width;                  // ڿ
-	int screen_height;                 // ڸ߶
-	int framebuffer_width;		// ʹõframebuffer
-	int framebuffer_height;		// ʹõframebuffer߶
-	IUINT32 **framebuffer;      // ػ棺framebuffer[y]  y
-	float **zbuffer;            // Ȼ棺zbuffer[y] Ϊ yָ
-	int render_state;           // Ⱦ״̬
-	int shader_state;			// shader״̬
-	IUINT32 background;         // ɫ
-	IUINT32 foreground;         // ߿ɫ
-	int function_state;			// ״̬		
+	unsigned int vertex_shader_num;		// 执行顶点着色的顶点数，拆分时为计算位置的顶点数
+	unsigned int vertex_attribute_num;	// 计算插值属性的顶点数
+	unsigned int triangle_num;			// 光栅化的三角形数
+	unsigned int covered_pixel_num;		// 三角形覆盖的像素数
+	unsigned int shaded_pixel_num;		// 执行片元着色的像素数
+	unsigned int helper_pixel_num;		// 2x2 像素块着色时只用于计算导数的辅助片元数
+	unsigned int hiz_triangle_test_num;	// 层次深度测试的三角形数，分块时每个块各算一次
+	unsigned int hiz_triangle_reject_num;	// 被层次深度剔除的三角形数
+	unsigned int hiz_block_test_num;	// 层次深度测试的 8x8 块数
+	unsigned int hiz_block_reject_num;	// 被层次深度剔除的 8x8 块数
+	unsigned int hiz_block_accept_num;	// 深度测试必定通过、跳过逐像素深度比较的 8x8 块数
+} raster_stats_t;
+
+// 顶点变换缓存，按索引保存一次绘制中已执行顶点着色的顶点和裁剪空间坐标
+// 单独申请而不放在 device_t 中，分块光栅化复制绘制状态时不需要复制缓存
+typedef struct {
+	vertex_t vertex[MAX_VERTEX_CACHE_NUM];
+	point_t clip[MAX_VERTEX_CACHE_NUM];
+	unsigned int tag[MAX_VERTEX_CACHE_NUM];	// 写入时的绘制编号，与 draw_id 相同时有效
+	unsigned int draw_id;
+} vertex_cache_t;
+
+struct device_t {
+	transform_t transform;      // 坐标变换器
+	int screen_width;                  // 窗口宽度
+	int screen_height;                 // 窗口高度
+	int framebuffer_width;		// 使用的framebuffer宽度，绑定了有自己大小的 framebuffer 时为其宽度
+	int framebuffer_height;		// 使用的framebuffer高度
+	int viewport_x;				// 视口，光栅化只写入视口内的像素，切换渲染目标后为整个渲染目标
+	int viewport_y;
+	int viewport_width;
+	int viewport_height;
+	IUINT32 **framebuffer;      // 像素缓存：framebuffer[y] 代表第 y行
+	float **zbuffer;            // 深度缓存：zbuffer[y] 为第 y行指针
+	hiz_buffer_t *hiz;			// 深度缓存的层次深度
+	int render_state;           // 渲染状态
+	int shader_state;			// shader的组合状态
+	IUINT32 background;         // 背景颜色
+	IUINT32 foreground;         // 线框颜色
+	int function_state;			// 功能状态		
 	texture_t texture_array[MAX_TEXTURE_NUM];// Texture
+	sampler_t sampler_array[MAX_SAMPLER_NUM];// Sampler
 	framebuffer_t framebuffer_array[MAX_FRAME_BUFFER]; // framebuffer
 
 	int bind_frame_buffer_idx;
 
-	//----------------------- shader Ϣ
+	//----------------------- shader 信息
 
 	// Attribute
-	vertex_t* vertex_array; // ӦһԴ ʵڴ浽Դcopy index洢
+	vertex_t* vertex_array; // 应该申请一份显存 实现内存到显存的copy 用index管理顶点存储
+
+	vertex_cache_t *vertex_cache;	// 顶点变换缓存，device_init 时申请
 
 	// Uniform
 	vector_t uniform_vector[MAX_UNIFORM_NUM];
 
 	matrix_t uniform_matrix[MAX_UNIFORM_NUM];
 
+	int uniform_vector_num;		// 设置过的最大下标加一
+	int uniform_matrix_num;
+
 	// Texture ID
 	int texture_id[MAX_TEXTURE_NUM];
 
+	// 与 texture_id 对应的采样器
+	int sampler_id[MAX_TEXTURE_NUM];
+
 	// Blend State
 	blendstate_t blend_state;
 
-}	device_t;
+	// Depth State
+	int depth_func;
+	bool depth_write;
+	bool color_write;
+
+	//----------------------- 光栅化
 
-#define FUNC_STATE_CULL_BACK		1		// ޳
-#define FUNC_STATE_ANTI_ALIAS_FSAA	2		// FSAA 
+	int raster_mode;			// 光栅化模式
+	int raster_algorithm;		// 三角形光栅化算法
+	int raster_thread_num;		// 分块光栅化的线程数
+	tile_raster_t* tile_raster;	// 分块光栅化上下文
+	raster_stats_t raster_stats; // 光栅化统计，device_flush 之后有效
+	raster_stats_t frame_stats;	// 上一帧的光栅化统计，device_end_frame 之后有效
+	raster_stats_t frame_begin_stats;
 
-void device_init(device_t *device, int width, int height, void *fb); //ʼȾ豸
-void device_destroy(device_t *device); // ɾ豸		   
-void device_set_texture(device_t *device, void *bits, long pitch, int w, int h, int texture_id);// õǰ
-void device_clear(device_t *device, int mode); //  framebuffer  zbuffer						   
-IUINT32 device_texture_read(const device_t *device, float u, float v, int texture_id); // ȡ
-void device_set_vertex_attrib_pointer(device_t* device, vertex_t* vertex_array); // ö
-float device_texture_read_float(const device_t *device, float u, float v, int texture_id);
+	//----------------------- 管线状态
+
+	pipeline_state_t pipeline_state;	// 当前绘制使用的管线状态
+	bool pipeline_state_dirty;			// 状态已改变，下次绘制前重新编译
+};
+
+#define FUNC_STATE_CULL_BACK		1		// 背部剔除
+#define FUNC_STATE_ANTI_ALIAS_FSAA	2		// FSAA 超采样反走样
+#define FUNC_STATE_HIERARCHICAL_Z	4		// 层次深度剔除
+#define FUNC_STATE_DEPTH_PREPASS	8		// 先只绘制深度，再只对深度相等的片元着色
+
+void device_init(device_t *device, int width, int height, void *fb); //初始化渲染设备
+void device_destroy(device_t *device); // 删除设备		   
+void device_set_texture(device_t *device, void *bits, long pitch, int w, int h, int texture_id);// 设置当前纹理
+void device_upload_texture(device_t *device, void *bits, long pitch, int w, int h, int texture_id); // 复制纹理数据并转为 TILED 排列，之后不再引用 bits
+void device_upload_texture_format(device_t *device, void *bits, long pitch, int w, int h, int format, int texture_id); // 同 device_upload_texture，复制时转为 format，R16F R32F 的 bits 为 float
+void device_clear(device_t *device, int mode); // 清空 framebuffer 和 zbuffer						   
+IUINT32 device_texture_read(const device_t *device, float u, float v, int texture_id); // 根据坐标读取纹理
+IUINT32 device_texture_sample(const device_t *device, int iIndex, float u, float v, float lod); // 用第 iIndex 个纹理单元的纹理和采样器读取纹理，没有导数时 lod 为 0
+void device_set_vertex_attrib_pointer(device_t* device, vertex_t* vertex_array); // 设置顶点数据
+float device_texture_read_float(const device_t *device, float u, float v, int texture_id); // 读取第一个通道，R16F R32F 直接返回，其他格式为 [0, 1]
+float device_texture_sample_float(const device_t *device, int iIndex, float u, float v, float lod); // 同 device_texture_sample，只读取第一个通道
+float device_texture_sample_compare(const device_t *device, int iIndex, float u, float v, float ref); // 比较采样，返回第一个通道小于 ref 的纹素比例
 
 void device_set_uniform_vector_value(device_t* device, int iUniformIndex, vector_t* pVec);
 void device_set_uniform_matrix_value(device_t* device, int iUniformIndex, matrix_t* pMat);
 
 int device_gen_texture(device_t* device);
 void device_bind_texture(device_t* device, int iIndex, int texture_id);
+void device_generate_mipmap(device_t* device, int texture_id); // 由纹理数据生成完整的 mipmap，纹理数据更新后需重新生成
+
+int device_gen_sampler(device_t* device);
+void device_set_sampler_state(device_t* device, int sampler_id, samplerstate_t sampler_state); // 修改前先完成等待中的光栅化
+void device_bind_sampler(device_t* device, int iIndex, int sampler_id);
 
 void device_set_blend_state(device_t* device, blendstate_t blend_state);
+void device_set_depth_func(device_t* device, int depth_func);
+void device_set_depth_write(device_t* device, bool depth_write);
+void device_set_color_write(device_t* device, bool color_write);
 
-int function_cull_back(device_t* device, point_t* p1, point_t* p2, point_t* p3); // ޳
+int function_cull_back(device_t* device, point_t* p1, point_t* p2, point_t* p3); // 背部剔除
 
 device_t* get_device_inst();
 
 int device_gen_frame_buffer(device_t* device);
+// 只有深度的渲染目标，有自己的大小，不超过 MAX_FRAME_BUFFER_WIDTH x MAX_FRAME_BUFFER_HEIGHT，如阴影图
+// 绑定后绘制只光栅化位置、写入深度，颜色写入和片元着色被跳过，framebuffer_width/height 和投影的宽高比切换为目标的大小
+int device_gen_depth_frame_buffer(device_t* device, int width, int height);
 void device_clear_framebuffer(device_t* device, int framebuffer_id, int mode);
 void device_copy_framebuffer(device_t* device, int framebuffer_id, IUINT32** buffer);
 void device_copy_framebuffer_z(device_t* device, int framebuffer_id, float** zbuffer);
+// 把 src 深度缓存的矩形 [x, x + width) x [y, y + height) 复制到 dst 的相同位置，矩形限制在两者大小之内
+// dst 的层次深度在下次查询时重新统计
+void device_copy_framebuffer_depth(device_t* device, int dst_framebuffer_id, int src_framebuffer_id, int x, int y, int width, int height);
+// 只清空深度缓存的矩形，深度为 0
+void device_clear_framebuffer_depth(device_t* device, int framebuffer_id, int x, int y, int width, int height);
 bool device_bind_framebuffer(device_t* device, int framebuffer_id);
 bool device_unbind_framebuffer(device_t* device, int framebuffer_id);
+// 视口限制在当前渲染目标内，归一化的坐标映射到视口，投影的宽高比随视口改变，视口之外的像素不被写入
+// 多个阴影图共用一个渲染目标时，每个阴影图绘制到自己的视口
+void device_set_viewport(device_t* device, int x, int y, int width, int height);
+// 纹理直接引用 framebuffer 的一个平面，不复制数据，之后绘制到该 framebuffer 的结果对纹理立即可见
+// 切换渲染目标时会完成等待中的光栅化，采样时 framebuffer 的内容总是完整的
+// 纹理所在的 framebuffer 是当前渲染目标、且着色器读取该纹理时，绘制被跳过
+// 纹理的宽高随 framebuffer 的大小更新，不生成 mipmap，重新设置纹理数据后不再引用 framebuffer
+bool device_set_framebuffer_texture(device_t* device, int texture_id, int framebuffer_id, int plane);
 
 void device_copy_colorbuffer(device_t* device, IUINT32** buffer);
 
@@ -111,4 +348,17 @@ void device_set_shader_state(device_t* device, int shader_state);
 unsigned int device_get_framebuffer_data(device_t* device, int h, int w);
 
 unsigned int device_enable_render_func_state(device_t* device, int iState);
-unsigned int device_disable_render_func_state(device_t* device, int iState);
\ No newline at end of file
+unsigned int device_disable_render_func_state(device_t* device, int iState);
+
+// 按当前的 shader、framebuffer、混合、剔除和深度状态编译管线状态
+void device_create_pipeline_state(device_t* device, pipeline_state_t* pipeline_state);
+// 直接使用已编译的管线状态，之后修改设备状态会重新编译
+void device_bind_pipeline_state(device_t* device, const pipeline_state_t* pipeline_state);
+
+void device_set_raster_mode(device_t* device, int raster_mode);
+void device_set_raster_algorithm(device_t* device, int raster_algorithm);
+void device_set_raster_thread_num(device_t* device, int thread_num);
+void device_reset_raster_stats(device_t* device);
+bool device_begin_draw(device_t* device); // 开始一次绘制调用，状态改变过时重新编译管线状态，读写同一个 framebuffer 时返回 false，不应绘制
+void device_flush(device_t* device); // 完成所有等待中的光栅化
+void device_end_frame(device_t* device); // 完成一帧的绘制，记录这一帧的光栅化统计
\ No newline at end of file
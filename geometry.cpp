@@ -1,4 +1,6 @@
 #include <stdio.h>
+#include <stddef.h>
+#include <emmintrin.h>
 #include "geometry.h"
 
 void vertex_rhw_init(vertex_t *v) {
@@ -82,7 +84,90 @@ void vertex_add(vertex_t *y, const vertex_t *x) {
 	}
 }
 
-//  0-2 ΣҷغϷε
+static void varying_layout_add(varying_layout_t *layout, size_t offset, int num)
+{
+	for (int i = 0; i < num; i++)
+	{
+		layout->offset[layout->num++] = (int)(offset / sizeof(float)) + i;
+	}
+}
+
+void varying_layout_init(varying_layout_t *layout, int varying_mask)
+{
+	layout->num = 0;
+	varying_layout_add(layout, offsetof(vertex_t, rhw), 1);
+	varying_layout_add(layout, offsetof(vertex_t, pos.x), 1);
+
+	if (varying_mask & VARYING_POSITION) varying_layout_add(layout, offsetof(vertex_t, pos.y), 3);
+	if (varying_mask & VARYING_TEXCOORD) varying_layout_add(layout, offsetof(vertex_t, tc), 2);
+	if (varying_mask & VARYING_COLOR) varying_layout_add(layout, offsetof(vertex_t, color), 4);
+	if (varying_mask & VARYING_NORMAL) varying_layout_add(layout, offsetof(vertex_t, normal), 4);
+	for (int i = 0; i < MAX_VS_SHADER_RESULT; i++)
+	{
+		if (varying_mask & VARYING_VS_RESULT(i)) varying_layout_add(layout, offsetof(vertex_t, vs_result) + sizeof(vector_t) * i, 4);
+	}
+	layout->stride = (layout->num + 3) & ~3;
+}
+
+void varying_pack(const varying_layout_t *layout, varying_t *y, const vertex_t *x)
+{
+	const float *src = (const float*)x;
+	int i;
+	for (i = 0; i < layout->num; i++)
+	{
+		y->f[i] = src[layout->offset[i]];
+	}
+	for (; i < layout->stride; i++)
+	{
+		y->f[i] = 0.0f;
+	}
+}
+
+void varying_unpack(const varying_layout_t *layout, vertex_t *y, const varying_t *x)
+{
+	float *dst = (float*)y;
+	for (int i = 0; i < layout->num; i++)
+	{
+		dst[layout->offset[i]] = x->f[i];
+	}
+}
+
+void varying_unpack_packet(const varying_layout_t *layout, pixel_packet_t *y, int lane, const varying_t *x)
+{
+	for (int i = 0; i < layout->num; i++)
+	{
+		y->f[layout->offset[i]][lane] = x->f[i];
+	}
+}
+
+void varying_division(const varying_layout_t *layout, varying_t *y, const varying_t *x1, const varying_t *x2, float w)
+{
+	__m128 inv = _mm_set1_ps(1.0f / w);
+	for (int i = 0; i < layout->stride; i += 4)
+	{
+		__m128 d = _mm_sub_ps(_mm_loadu_ps(&x2->f[i]), _mm_loadu_ps(&x1->f[i]));
+		_mm_storeu_ps(&y->f[i], _mm_mul_ps(d, inv));
+	}
+}
+
+void varying_add(const varying_layout_t *layout, varying_t *y, const varying_t *x)
+{
+	for (int i = 0; i < layout->stride; i += 4)
+	{
+		_mm_storeu_ps(&y->f[i], _mm_add_ps(_mm_loadu_ps(&y->f[i]), _mm_loadu_ps(&x->f[i])));
+	}
+}
+
+void varying_add_scaled(const varying_layout_t *layout, varying_t *y, const varying_t *x, float n)
+{
+	__m128 scale = _mm_set1_ps(n);
+	for (int i = 0; i < layout->stride; i += 4)
+	{
+		_mm_storeu_ps(&y->f[i], _mm_add_ps(_mm_loadu_ps(&y->f[i]), _mm_mul_ps(_mm_loadu_ps(&x->f[i]), scale)));
+	}
+}
+
+// 根据三角形生成 0-2 个梯形，并且返回合法梯形的数量
 int trapezoid_init_triangle(trapezoid_t *trap, const vertex_t *p1,
 	const vertex_t *p2, const vertex_t *p3) {
 	const vertex_t *p;
@@ -148,7 +233,7 @@ int trapezoid_init_triangle(trapezoid_t *trap, const vertex_t *p1,
 	return 2;
 }
 
-//  Y  Y Ķ
+// 按照 Y 坐标计算出左右两条边纵坐标等于 Y 的顶点
 void trapezoid_edge_interp(trapezoid_t *trap, float y) {
 	float s1 = trap->left.v2.pos.y - trap->left.v1.pos.y;
 	float s2 = trap->right.v2.pos.y - trap->right.v1.pos.y;
@@ -158,13 +243,13 @@ void trapezoid_edge_interp(trapezoid_t *trap, float y) {
 	vertex_interp(&trap->right.v, &trap->right.v1, &trap->right.v2, t2);
 }
 
-// ߵĶ˵㣬ʼɨߵͲ
-void trapezoid_init_scan_line(const trapezoid_t *trap, scanline_t *scanline, int y) {
-	float width = trap->right.v.pos.x - trap->left.v.pos.x;
-	scanline->x = (int)(trap->left.v.pos.x + 0.5f);
-	scanline->w = (int)(trap->right.v.pos.x + 0.5f) - scanline->x;
+// 根据左右两边打包后的端点，初始化计算出扫描线的起点和步长
+void trapezoid_init_scan_line(const varying_layout_t *layout, const varying_t *left, const varying_t *right, scanline_t *scanline, int y) {
+	float width = right->f[VARYING_POS_X_INDEX] - left->f[VARYING_POS_X_INDEX];
+	scanline->x = (int)(left->f[VARYING_POS_X_INDEX] + 0.5f);
+	scanline->w = (int)(right->f[VARYING_POS_X_INDEX] + 0.5f) - scanline->x;
 	scanline->y = y;
-	scanline->v = trap->left.v;
+	scanline->v = *left;
 	if (scanline->w < 0) scanline->w = 0;
-	vertex_division(&scanline->step, &trap->left.v, &trap->right.v, width);
+	varying_division(layout, &scanline->step, left, right, width);
 }
\ No newline at end of file
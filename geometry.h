@@ -1,9 +1,11 @@
 #pragma once
 
+#include <stddef.h>
+
 #include "mathlib.h"
 
 //=====================================================================
-// μ㣺㡢ɨߡԵΡ
+// 几何计算：顶点、扫描线、边缘、矩形、步长计算
 //=====================================================================
 typedef struct { float r, g, b, a; } color_t;
 typedef struct { float u, v; } texcoord_t;
@@ -21,9 +23,42 @@ typedef struct vertex_t{
 	vector_t vs_result[MAX_VS_SHADER_RESULT];
 }vertex_t;
 
+// 片元着色器需要插值的属性，rhw 和 pos.x 总是插值
+#define VARYING_POSITION		1		// pos.y pos.z pos.w
+#define VARYING_TEXCOORD		2
+#define VARYING_COLOR			4
+#define VARYING_NORMAL			8
+#define VARYING_VS_RESULT(i)	(16 << (i))
+#define VARYING_ALL				(VARYING_POSITION | VARYING_TEXCOORD | VARYING_COLOR | VARYING_NORMAL | (VARYING_VS_RESULT(MAX_VS_SHADER_RESULT) - VARYING_VS_RESULT(0)))
+
+#define MAX_VARYING_NUM 32		// vertex_t 的 float 数补齐到 4 的倍数
+#define VARYING_RHW_INDEX 0
+#define VARYING_POS_X_INDEX 1
+
+// 打包后的插值属性：只保留需要插值的 float，连续存放
+typedef struct { float f[MAX_VARYING_NUM]; } varying_t;
+
+typedef struct {
+	int num;						// 打包后的 float 数
+	int stride;						// num 补齐到 4 的倍数，步进时按 4 个一组计算，补齐部分为 0
+	int offset[MAX_VARYING_NUM];	// 每个打包属性在 vertex_t 中的 float 偏移
+} varying_layout_t;
+
 typedef struct { vertex_t v, v1, v2; } edge_t;
 typedef struct { float top, bottom; edge_t left, right; } trapezoid_t;
-typedef struct { vertex_t v, step; int x, y, w; } scanline_t;
+typedef struct { varying_t v, step; int x, y, w; } scanline_t;
+
+#define PIXEL_PACKET_SIZE 4		// 一次着色的片元数，对应一个 SSE 寄存器
+#define VERTEX_FLOAT_NUM ((int)(sizeof(vertex_t) / sizeof(float)))
+#define VERTEX_FLOAT_INDEX(member) ((int)(offsetof(vertex_t, member) / sizeof(float)))
+
+// SoA 排列的片元包：f[i][lane] 为第 lane 个片元 vertex_t 中的第 i 个 float，只有打包的属性有效
+// 按 2x2 像素块着色时 lane 0 1 2 3 依次为 (x, y) (x + 1, y) (x, y + 1) (x + 1, y + 1)，
+// mask 之外的片元是辅助片元，属性按三角形平面外插，只用于计算导数
+typedef struct {
+	float f[VERTEX_FLOAT_NUM][PIXEL_PACKET_SIZE];
+	int mask;	// 第 lane 位为 1 表示第 lane 个片元有效
+} pixel_packet_t;
 
 
 void vertex_rhw_init(vertex_t *v);
@@ -34,10 +69,27 @@ void vertex_division(vertex_t *y, const vertex_t *x1, const vertex_t *x2, float
 
 void vertex_add(vertex_t *y, const vertex_t *x);
 
+void varying_layout_init(varying_layout_t *layout, int varying_mask);
+
+void varying_pack(const varying_layout_t *layout, varying_t *y, const vertex_t *x);
+
+// 只写入打包的属性，其他属性保持不变
+void varying_unpack(const varying_layout_t *layout, vertex_t *y, const varying_t *x);
+
+// 把打包的属性写入片元包的第 lane 个片元
+void varying_unpack_packet(const varying_layout_t *layout, pixel_packet_t *y, int lane, const varying_t *x);
+
+void varying_division(const varying_layout_t *layout, varying_t *y, const varying_t *x1, const varying_t *x2, float w);
+
+void varying_add(const varying_layout_t *layout, varying_t *y, const varying_t *x);
+
+// y += x * n，一次跳过 n 步
+void varying_add_scaled(const varying_layout_t *layout, varying_t *y, const varying_t *x, float n);
+
 int trapezoid_init_triangle(trapezoid_t *trap, const vertex_t *p1, const vertex_t *p2, const vertex_t *p3);
 
-//  Y  Y Ķ
+// 按照 Y 坐标计算出左右两条边纵坐标等于 Y 的顶点
 void trapezoid_edge_interp(trapezoid_t *trap, float y);
 
-// ߵĶ˵㣬ʼɨߵͲ
-void trapezoid_init_scan_line(const trapezoid_t *trap, scanline_t *scanline, int y);
\ No newline at end of file
+// 根据左右两边打包后的端点，初始化计算出扫描线的起点和步长
+void trapezoid_init_scan_line(const varying_layout_t *layout, const varying_t *left, const varying_t *right, scanline_t *scanline, int y);
\ No newline at end of file
@@ -0,0 +1,190 @@
+#include <stdlib.h>
+#include <string.h>
+
+#include "hiz.h"
+
+hiz_buffer_t* hiz_create(float **zbuffer)
+{
+	hiz_buffer_t *hiz = (hiz_buffer_t*)malloc(sizeof(hiz_buffer_t));
+	hiz->zbuffer = zbuffer;
+	hiz_clear(hiz, MAX_FRAME_BUFFER_WIDTH, MAX_FRAME_BUFFER_HEIGHT, 0.0f);
+	return hiz;
+}
+
+void hiz_destroy(hiz_buffer_t *hiz)
+{
+	free(hiz);
+}
+
+void hiz_clear(hiz_buffer_t *hiz, int width, int height, float depth)
+{
+	hiz->width = width;
+	hiz->height = height;
+	for (int j = 0; j < HIZ_BLOCK_ROW_NUM; j++)
+	{
+		for (int i = 0; i < HIZ_BLOCK_COLUMN_NUM; i++)
+		{
+			hiz->block_min[j][i] = depth;
+			hiz->block_max[j][i] = depth;
+		}
+	}
+	for (int j = 0; j < HIZ_TILE_ROW_NUM; j++)
+	{
+		for (int i = 0; i < HIZ_TILE_COLUMN_NUM; i++)
+		{
+			hiz->tile_min[j][i] = depth;
+			hiz->tile_max[j][i] = depth;
+		}
+	}
+	memset(hiz->block_dirty, 0, sizeof(hiz->block_dirty));
+	memset(hiz->tile_dirty, 0, sizeof(hiz->tile_dirty));
+}
+
+void hiz_mark_block_dirty(hiz_buffer_t *hiz, int block_x, int block_y)
+{
+	hiz->block_dirty[block_y][block_x] = 1;
+	hiz->tile_dirty[block_y * HIZ_BLOCK_SIZE / HIZ_TILE_SIZE][block_x * HIZ_BLOCK_SIZE / HIZ_TILE_SIZE] = 1;
+}
+
+void hiz_mark_dirty(hiz_buffer_t *hiz, int y, int x0, int x1)
+{
+	if (x0 >= x1)
+	{
+		return;
+	}
+
+	int by = y / HIZ_BLOCK_SIZE;
+	int bx0 = x0 / HIZ_BLOCK_SIZE;
+	int bx1 = (x1 - 1) / HIZ_BLOCK_SIZE;
+	for (int bx = bx0; bx <= bx1; bx++)
+	{
+		hiz->block_dirty[by][bx] = 1;
+	}
+
+	int ty = y / HIZ_TILE_SIZE;
+	for (int tx = x0 / HIZ_TILE_SIZE; tx <= (x1 - 1) / HIZ_TILE_SIZE; tx++)
+	{
+		hiz->tile_dirty[ty][tx] = 1;
+	}
+}
+
+// 重新统计块内深度，只统计 framebuffer 范围内的像素
+static void hiz_update_block(hiz_buffer_t *hiz, int block_x, int block_y)
+{
+	int x0 = block_x * HIZ_BLOCK_SIZE;
+	int y0 = block_y * HIZ_BLOCK_SIZE;
+	int x1 = x0 + HIZ_BLOCK_SIZE;
+	int y1 = y0 + HIZ_BLOCK_SIZE;
+	if (x1 > hiz->width) x1 = hiz->width;
+	if (y1 > hiz->height) y1 = hiz->height;
+
+	float depth_min = hiz->block_min[block_y][block_x];
+	float depth_max = hiz->block_max[block_y][block_x];
+	if (x0 < x1 && y0 < y1)
+	{
+		depth_min = hiz->zbuffer[y0][x0];
+		depth_max = depth_min;
+		for (int y = y0; y < y1; y++)
+		{
+			const float *zbuffer = hiz->zbuffer[y];
+			for (int x = x0; x < x1; x++)
+			{
+				if (zbuffer[x] < depth_min) depth_min = zbuffer[x];
+				if (zbuffer[x] > depth_max) depth_max = zbuffer[x];
+			}
+		}
+	}
+
+	hiz->block_min[block_y][block_x] = depth_min;
+	hiz->block_max[block_y][block_x] = depth_max;
+	hiz->block_dirty[block_y][block_x] = 0;
+}
+
+static void hiz_update_tile(hiz_buffer_t *hiz, int tile_x, int tile_y)
+{
+	const int n = HIZ_TILE_SIZE / HIZ_BLOCK_SIZE;
+	int bx0 = tile_x * n;
+	int by0 = tile_y * n;
+
+	float depth_min = 0.0f;
+	float depth_max = 0.0f;
+	for (int by = by0; by < by0 + n; by++)
+	{
+		for (int bx = bx0; bx < bx0 + n; bx++)
+		{
+			if (hiz->block_dirty[by][bx])
+			{
+				hiz_update_block(hiz, bx, by);
+			}
+
+			if ((by == by0 && bx == bx0) || hiz->block_min[by][bx] < depth_min) depth_min = hiz->block_min[by][bx];
+			if ((by == by0 && bx == bx0) || hiz->block_max[by][bx] > depth_max) depth_max = hiz->block_max[by][bx];
+		}
+	}
+
+	hiz->tile_min[tile_y][tile_x] = depth_min;
+	hiz->tile_max[tile_y][tile_x] = depth_max;
+	hiz->tile_dirty[tile_y][tile_x] = 0;
+}
+
+void hiz_get_block(hiz_buffer_t *hiz, int block_x, int block_y, float *depth_min, float *depth_max)
+{
+	if (hiz->block_dirty[block_y][block_x])
+	{
+		hiz_update_block(hiz, block_x, block_y);
+	}
+	*depth_min = hiz->block_min[block_y][block_x];
+	*depth_max = hiz->block_max[block_y][block_x];
+}
+
+bool hiz_test_occluded(hiz_buffer_t *hiz, int x0, int y0, int x1, int y1, float depth)
+{
+	if (x0 >= x1 || y0 >= y1)
+	{
+		return true;
+	}
+
+	depth += depth * HIZ_DEPTH_EPSILON;
+
+	// 完全在矩形内的 64x64 块直接用块的统计，其余只检查与矩形相交的 8x8 块
+	for (int ty = y0 / HIZ_TILE_SIZE; ty <= (y1 - 1) / HIZ_TILE_SIZE; ty++)
+	{
+		for (int tx = x0 / HIZ_TILE_SIZE; tx <= (x1 - 1) / HIZ_TILE_SIZE; tx++)
+		{
+			int tile_x0 = tx * HIZ_TILE_SIZE;
+			int tile_y0 = ty * HIZ_TILE_SIZE;
+			if (tile_x0 >= x0 && tile_y0 >= y0 && tile_x0 + HIZ_TILE_SIZE <= x1 && tile_y0 + HIZ_TILE_SIZE <= y1)
+			{
+				if (hiz->tile_dirty[ty][tx])
+				{
+					hiz_update_tile(hiz, tx, ty);
+				}
+				if (depth >= hiz->tile_min[ty][tx])
+				{
+					return false;
+				}
+				continue;
+			}
+
+			int bx0 = (tile_x0 > x0 ? tile_x0 : x0) / HIZ_BLOCK_SIZE;
+			int by0 = (tile_y0 > y0 ? tile_y0 : y0) / HIZ_BLOCK_SIZE;
+			int bx1 = ((tile_x0 + HIZ_TILE_SIZE < x1 ? tile_x0 + HIZ_TILE_SIZE : x1) - 1) / HIZ_BLOCK_SIZE;
+			int by1 = ((tile_y0 + HIZ_TILE_SIZE < y1 ? tile_y0 + HIZ_TILE_SIZE : y1) - 1) / HIZ_BLOCK_SIZE;
+			for (int by = by0; by <= by1; by++)
+			{
+				for (int bx = bx0; bx <= bx1; bx++)
+				{
+					if (hiz->block_dirty[by][bx])
+					{
+						hiz_update_block(hiz, bx, by);
+					}
+					if (depth >= hiz->block_min[by][bx])
+					{
+						return false;
+					}
+				}
+			}
+		}
+	}
+	return true;
+}
@@ -0,0 +1,44 @@
+#pragma once
+
+#include "device.h"
+
+//=====================================================================
+// 层次深度缓存：记录每个 8x8 块和 64x64 块内深度(rhw)的最小值和最大值
+// rhw 越大越近，最小值即块内最远的深度
+//=====================================================================
+
+#define HIZ_BLOCK_SIZE 8
+#define HIZ_TILE_SIZE 64	// 与 TILE_SIZE 一致，分块光栅化时每个线程只访问自己块内的数据
+#define HIZ_BLOCK_COLUMN_NUM (MAX_FRAME_BUFFER_WIDTH / HIZ_BLOCK_SIZE)
+#define HIZ_BLOCK_ROW_NUM (MAX_FRAME_BUFFER_HEIGHT / HIZ_BLOCK_SIZE)
+#define HIZ_TILE_COLUMN_NUM (MAX_FRAME_BUFFER_WIDTH / HIZ_TILE_SIZE)
+#define HIZ_TILE_ROW_NUM (MAX_FRAME_BUFFER_HEIGHT / HIZ_TILE_SIZE)
+#define HIZ_DEPTH_EPSILON 1e-5f	// 插值误差余量
+
+struct hiz_buffer_t {
+	float **zbuffer;
+	int width;
+	int height;
+	float block_min[HIZ_BLOCK_ROW_NUM][HIZ_BLOCK_COLUMN_NUM];
+	float block_max[HIZ_BLOCK_ROW_NUM][HIZ_BLOCK_COLUMN_NUM];
+	unsigned char block_dirty[HIZ_BLOCK_ROW_NUM][HIZ_BLOCK_COLUMN_NUM];
+	float tile_min[HIZ_TILE_ROW_NUM][HIZ_TILE_COLUMN_NUM];
+	float tile_max[HIZ_TILE_ROW_NUM][HIZ_TILE_COLUMN_NUM];
+	unsigned char tile_dirty[HIZ_TILE_ROW_NUM][HIZ_TILE_COLUMN_NUM];
+};
+
+hiz_buffer_t* hiz_create(float **zbuffer);
+void hiz_destroy(hiz_buffer_t *hiz);
+
+// 深度缓存被清为 depth 后调用
+void hiz_clear(hiz_buffer_t *hiz, int width, int height, float depth);
+
+// 第 y 行 [x0, x1) 的深度被写入，所在块在下次查询时重新统计
+void hiz_mark_dirty(hiz_buffer_t *hiz, int y, int x0, int x1);
+void hiz_mark_block_dirty(hiz_buffer_t *hiz, int block_x, int block_y);
+
+// 获取 8x8 块的最小/最大深度
+void hiz_get_block(hiz_buffer_t *hiz, int block_x, int block_y, float *depth_min, float *depth_max);
+
+// 矩形 [x0, x1) x [y0, y1) 内所有深度都比 depth 更近时返回 true，即 depth 处的片元全部无法通过深度测试
+bool hiz_test_occluded(hiz_buffer_t *hiz, int x0, int y0, int x1, int y1, float depth);
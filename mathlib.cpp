@@ -5,7 +5,7 @@ int CMID(int x, int min, int max) {
 	return (x < min) ? min : ((x > max) ? max : x); 
 }
 
-// ֵt Ϊ [0, 1] ֵ֮
+// 计算插值：t 为 [0, 1] 之间的数值
 float interp(float x1, float x2, float t) { 
 	return x1 + (x2 - x1) * t; 
 }
@@ -32,12 +32,12 @@ void vector_sub(vector_t *z, const vector_t *x, const vector_t *y) {
 	z->w = 1.0;
 }
 
-// ʸ
+// 矢量点乘
 float vector_dotproduct(const vector_t *x, const vector_t *y) {
 	return x->x * y->x + x->y * y->y + x->z * y->z;
 }
 
-// ʸ
+// 矢量叉乘
 void vector_crossproduct(vector_t *z, const vector_t *x, const vector_t *y) {
 	float m1, m2, m3;
 	m1 = x->y * y->z - x->z * y->y;
@@ -49,7 +49,7 @@ void vector_crossproduct(vector_t *z, const vector_t *x, const vector_t *y) {
 	z->w = 1.0f;
 }
 
-// ʸֵtȡֵ [0, 1]
+// 矢量插值，t取值 [0, 1]
 void vector_interp(vector_t *z, const vector_t *x1, const vector_t *x2, float t) {
 	z->x = interp(x1->x, x2->x, t);
 	z->y = interp(x1->y, x2->y, t);
@@ -57,7 +57,7 @@ void vector_interp(vector_t *z, const vector_t *x1, const vector_t *x2, float t)
 	z->w = 1.0f;
 }
 
-// ʸһ
+// 矢量归一化
 void vector_normalize(vector_t *v) {
 	float length = vector_length(v);
 	if (length != 0.0f) {
@@ -68,7 +68,7 @@ void vector_normalize(vector_t *v) {
 	}
 }
 
-// ʸԱ
+// 矢量乘以标量
 void vector_scale(vector_t *z, float scale)
 {
 	z->x = z->x * scale;
@@ -152,7 +152,7 @@ void matrix_set_zero(matrix_t *m) {
 	m->m[3][0] = m->m[3][1] = m->m[3][2] = m->m[3][3] = 0.0f;
 }
 
-// ƽƱ任
+// 平移变换
 void matrix_set_translate(matrix_t *m, float x, float y, float z) {
 	matrix_set_identity(m);
 	m->m[3][0] = x;
@@ -160,7 +160,7 @@ void matrix_set_translate(matrix_t *m, float x, float y, float z) {
 	m->m[3][2] = z;
 }
 
-// ű任
+// 缩放变换
 void matrix_set_scale(matrix_t *m, float x, float y, float z) {
 	matrix_set_identity(m);
 	m->m[0][0] = x;
@@ -168,7 +168,7 @@ void matrix_set_scale(matrix_t *m, float x, float y, float z) {
 	m->m[2][2] = z;
 }
 
-// ת
+// 旋转矩阵
 void matrix_set_rotate(matrix_t *m, float x, float y, float z, float theta) {
 	float qsin = (float)sin(theta * 0.5f);
 	float qcos = (float)cos(theta * 0.5f);
@@ -192,7 +192,7 @@ void matrix_set_rotate(matrix_t *m, float x, float y, float z, float theta) {
 	m->m[3][3] = 1.0f;
 }
 
-// 
+// 设置摄像机
 void matrix_set_lookat(matrix_t *m, const vector_t *eye, const vector_t *at, const vector_t *up) {
 	vector_t xaxis, yaxis, zaxis;
 
@@ -232,7 +232,7 @@ void matrix_set_perspective(matrix_t *m, float fovy, float aspect, float zn, flo
 	m->m[2][3] = 1;
 }
 
-// 
+// 矩阵求逆
 void matrix_inverse(matrix_t *src, matrix_t *dst)
 {
 	float a0 = src->m[0][0] * src->m[1][1] - src->m[0][1] * src->m[1][0];
@@ -1,7 +1,7 @@
 #pragma once
 
 //=====================================================================
-// ѧ⣺˲Ӧò⣬Ϥ D3D 任
+// 数学库：此部分应该不用详解，熟悉 D3D 矩阵变换即可
 //=====================================================================
 typedef struct { float m[4][4]; } matrix_t;
 typedef struct { float x, y, z, w; } vector_t;
@@ -19,16 +19,16 @@ void vector_add(vector_t *z, const vector_t *x, const vector_t *y);
 // z = x - y
 void vector_sub(vector_t *z, const vector_t *x, const vector_t *y);
 
-// ʸ
+// 矢量点乘
 float vector_dotproduct(const vector_t *x, const vector_t *y);
 
-// ʸ
+// 矢量叉乘
 void vector_crossproduct(vector_t *z, const vector_t *x, const vector_t *y);
 
-// ʸֵtȡֵ [0, 1]
+// 矢量插值，t取值 [0, 1]
 void vector_interp(vector_t *z, const vector_t *x1, const vector_t *x2, float t);
 
-// ʸһ
+// 矢量归一化
 void vector_normalize(vector_t *v);
 
 void vector_scale(vector_t *z, float scale);
@@ -55,22 +55,22 @@ void matrix_set_identity(matrix_t *m);
 
 void matrix_set_zero(matrix_t *m);
 
-// ƽƱ任
+// 平移变换
 void matrix_set_translate(matrix_t *m, float x, float y, float z);
-// ű任
+// 缩放变换
 void matrix_set_scale(matrix_t *m, float x, float y, float z);
 
-// ת
+// 旋转矩阵
 void matrix_set_rotate(matrix_t *m, float x, float y, float z, float theta);
 
-// 
+// 设置摄像机
 void matrix_set_lookat(matrix_t *m, const vector_t *eye, const vector_t *at, const vector_t *up);
 
 // D3DXMatrixPerspectiveFovLH
 void matrix_set_perspective(matrix_t *m, float fovy, float aspect, float zn, float zf);
 
-// 
+// 矩阵求逆
 void matrix_inverse(matrix_t *src, matrix_t *dst);
 
-// ת
+// 矩阵转置
 void matrix_transpose(matrix_t *src, matrix_t *dst);
\ No newline at end of file
@@ -0,0 +1,240 @@
+#pragma once
+
+#include <emmintrin.h>
+
+#include "mathlib.h"
+
+//=====================================================================
+// SIMD 数学库：一次计算 4 组数据，矢量按 SoA 排列，每个分量占一个 SSE 寄存器
+// 只使用 SSE2 指令
+//=====================================================================
+typedef struct { __m128 x, y, z, w; } vector_packet_t;
+
+static inline __m128 simd_select(__m128 mask, __m128 a, __m128 b)
+{
+	return _mm_or_ps(_mm_and_ps(mask, a), _mm_andnot_ps(mask, b));
+}
+
+// 4 个分量之和
+static inline float simd_sum(__m128 x)
+{
+	x = _mm_add_ps(x, _mm_movehl_ps(x, x));
+	x = _mm_add_ss(x, _mm_shuffle_ps(x, x, _MM_SHUFFLE(1, 1, 1, 1)));
+	return _mm_cvtss_f32(x);
+}
+
+// 向零取整
+static inline __m128 simd_trunc(__m128 x)
+{
+	return _mm_cvtepi32_ps(_mm_cvttps_epi32(x));
+}
+
+// 以 e 为底的对数，x <= 0 时结果无意义，算法同 Cephes logf
+static inline __m128 simd_log(__m128 x)
+{
+	const __m128 one = _mm_set1_ps(1.0f);
+	x = _mm_max_ps(x, _mm_castsi128_ps(_mm_set1_epi32(0x00800000)));	// 最小的规格化数
+
+	__m128i exponent = _mm_sub_epi32(_mm_srli_epi32(_mm_castps_si128(x), 23), _mm_set1_epi32(0x7f));
+	__m128 e = _mm_add_ps(_mm_cvtepi32_ps(exponent), one);
+
+	// 尾数归一到 [0.5, 1)，小于 sqrt(0.5) 时再乘 2，使 x - 1 落在 [sqrt(0.5) - 1, sqrt(2) - 1)
+	x = _mm_or_ps(_mm_and_ps(x, _mm_castsi128_ps(_mm_set1_epi32(~0x7f800000))), _mm_set1_ps(0.5f));
+	__m128 mask = _mm_cmplt_ps(x, _mm_set1_ps(0.707106781186547524f));
+	__m128 tmp = _mm_and_ps(x, mask);
+	x = _mm_sub_ps(x, one);
+	e = _mm_sub_ps(e, _mm_and_ps(one, mask));
+	x = _mm_add_ps(x, tmp);
+
+	__m128 z = _mm_mul_ps(x, x);
+	__m128 y = _mm_set1_ps(7.0376836292E-2f);
+	y = _mm_add_ps(_mm_mul_ps(y, x), _mm_set1_ps(-1.1514610310E-1f));
+	y = _mm_add_ps(_mm_mul_ps(y, x), _mm_set1_ps(1.1676998740E-1f));
+	y = _mm_add_ps(_mm_mul_ps(y, x), _mm_set1_ps(-1.2420140846E-1f));
+	y = _mm_add_ps(_mm_mul_ps(y, x), _mm_set1_ps(1.4249322787E-1f));
+	y = _mm_add_ps(_mm_mul_ps(y, x), _mm_set1_ps(-1.6668057665E-1f));
+	y = _mm_add_ps(_mm_mul_ps(y, x), _mm_set1_ps(2.0000714765E-1f));
+	y = _mm_add_ps(_mm_mul_ps(y, x), _mm_set1_ps(-2.4999993993E-1f));
+	y = _mm_add_ps(_mm_mul_ps(y, x), _mm_set1_ps(3.3333331174E-1f));
+	y = _mm_mul_ps(_mm_mul_ps(y, x), z);
+
+	y = _mm_add_ps(y, _mm_mul_ps(e, _mm_set1_ps(-2.12194440e-4f)));
+	y = _mm_sub_ps(y, _mm_mul_ps(z, _mm_set1_ps(0.5f)));
+	x = _mm_add_ps(x, y);
+	return _mm_add_ps(x, _mm_mul_ps(e, _mm_set1_ps(0.693359375f)));
+}
+
+// e 的 x 次方，算法同 Cephes expf
+static inline __m128 simd_exp(__m128 x)
+{
+	const __m128 one = _mm_set1_ps(1.0f);
+	x = _mm_min_ps(x, _mm_set1_ps(88.3762626647949f));
+	x = _mm_max_ps(x, _mm_set1_ps(-88.3762626647949f));
+
+	// x = n * ln2 + r，n 向下取整
+	__m128 fx = _mm_add_ps(_mm_mul_ps(x, _mm_set1_ps(1.44269504088896341f)), _mm_set1_ps(0.5f));
+	__m128 n = simd_trunc(fx);
+	n = _mm_sub_ps(n, _mm_and_ps(_mm_cmpgt_ps(n, fx), one));
+	x = _mm_sub_ps(x, _mm_mul_ps(n, _mm_set1_ps(0.693359375f)));
+	x = _mm_sub_ps(x, _mm_mul_ps(n, _mm_set1_ps(-2.12194440e-4f)));
+
+	__m128 z = _mm_mul_ps(x, x);
+	__m128 y = _mm_set1_ps(1.9875691500E-4f);
+	y = _mm_add_ps(_mm_mul_ps(y, x), _mm_set1_ps(1.3981999507E-3f));
+	y = _mm_add_ps(_mm_mul_ps(y, x), _mm_set1_ps(8.3334519073E-3f));
+	y = _mm_add_ps(_mm_mul_ps(y, x), _mm_set1_ps(4.1665795894E-2f));
+	y = _mm_add_ps(_mm_mul_ps(y, x), _mm_set1_ps(1.6666665459E-1f));
+	y = _mm_add_ps(_mm_mul_ps(y, x), _mm_set1_ps(5.0000001201E-1f));
+	y = _mm_add_ps(_mm_add_ps(_mm_mul_ps(y, z), x), one);
+
+	// 乘以 2 的 n 次方
+	__m128i pow2n = _mm_slli_epi32(_mm_add_epi32(_mm_cvttps_epi32(n), _mm_set1_epi32(0x7f)), 23);
+	return _mm_mul_ps(y, _mm_castsi128_ps(pow2n));
+}
+
+// x 的 y 次方，只处理 x >= 0，x 为 0 时结果为 0
+static inline __m128 simd_pow(__m128 x, __m128 y)
+{
+	__m128 positive = _mm_cmpgt_ps(x, _mm_setzero_ps());
+	return _mm_and_ps(simd_exp(_mm_mul_ps(simd_log(x), y)), positive);
+}
+
+// 1 / sqrt(x)，近似值再做一次牛顿迭代，x 为 0 时结果为 0
+static inline __m128 simd_rsqrt(__m128 x)
+{
+	__m128 r = _mm_rsqrt_ps(x);
+	r = _mm_mul_ps(_mm_mul_ps(_mm_set1_ps(0.5f), r), _mm_sub_ps(_mm_set1_ps(3.0f), _mm_mul_ps(_mm_mul_ps(x, r), r)));
+	return _mm_and_ps(r, _mm_cmpgt_ps(x, _mm_setzero_ps()));
+}
+
+// 2x2 像素块内的屏幕空间导数，lane 0 1 2 3 依次为 (x, y) (x + 1, y) (x, y + 1) (x + 1, y + 1)
+// ddx 在每行内取右减左，ddy 在每列内取下减上
+static inline __m128 simd_quad_ddx(__m128 v)
+{
+	return _mm_sub_ps(_mm_shuffle_ps(v, v, _MM_SHUFFLE(3, 3, 1, 1)), _mm_shuffle_ps(v, v, _MM_SHUFFLE(2, 2, 0, 0)));
+}
+
+static inline __m128 simd_quad_ddy(__m128 v)
+{
+	return _mm_sub_ps(_mm_shuffle_ps(v, v, _MM_SHUFFLE(3, 2, 3, 2)), _mm_shuffle_ps(v, v, _MM_SHUFFLE(1, 0, 1, 0)));
+}
+
+static inline vector_packet_t vector_packet_set(const vector_t *v)
+{
+	vector_packet_t p = { _mm_set1_ps(v->x), _mm_set1_ps(v->y), _mm_set1_ps(v->z), _mm_set1_ps(v->w) };
+	return p;
+}
+
+static inline vector_packet_t vector_packet_load(const float *x, const float *y, const float *z, const float *w)
+{
+	vector_packet_t p = { _mm_loadu_ps(x), _mm_loadu_ps(y), _mm_loadu_ps(z), _mm_loadu_ps(w) };
+	return p;
+}
+
+// 只计算 x y z 分量，与 vector_dotproduct 一致
+static inline __m128 vector_packet_dotproduct(const vector_packet_t *a, const vector_packet_t *b)
+{
+	return _mm_add_ps(_mm_add_ps(_mm_mul_ps(a->x, b->x), _mm_mul_ps(a->y, b->y)), _mm_mul_ps(a->z, b->z));
+}
+
+// z = x + y
+static inline void vector_packet_add(vector_packet_t *z, const vector_packet_t *x, const vector_packet_t *y)
+{
+	z->x = _mm_add_ps(x->x, y->x);
+	z->y = _mm_add_ps(x->y, y->y);
+	z->z = _mm_add_ps(x->z, y->z);
+	z->w = _mm_add_ps(x->w, y->w);
+}
+
+// z = x - y
+static inline void vector_packet_sub(vector_packet_t *z, const vector_packet_t *x, const vector_packet_t *y)
+{
+	z->x = _mm_sub_ps(x->x, y->x);
+	z->y = _mm_sub_ps(x->y, y->y);
+	z->z = _mm_sub_ps(x->z, y->z);
+	z->w = _mm_sub_ps(x->w, y->w);
+}
+
+static inline void vector_packet_scale(vector_packet_t *v, __m128 scale)
+{
+	v->x = _mm_mul_ps(v->x, scale);
+	v->y = _mm_mul_ps(v->y, scale);
+	v->z = _mm_mul_ps(v->z, scale);
+	v->w = _mm_mul_ps(v->w, scale);
+}
+
+// 用倒数平方根归一化 x y z 分量，长度为 0 的矢量变为 0
+static inline void vector_packet_normalize(vector_packet_t *v)
+{
+	__m128 inv = simd_rsqrt(vector_packet_dotproduct(v, v));
+	v->x = _mm_mul_ps(v->x, inv);
+	v->y = _mm_mul_ps(v->y, inv);
+	v->z = _mm_mul_ps(v->z, inv);
+}
+
+static inline __m128 vector_packet_apply_column(const vector_packet_t *x, const matrix_t *m, int j)
+{
+	__m128 sum = _mm_mul_ps(x->x, _mm_set1_ps(m->m[0][j]));
+	sum = _mm_add_ps(sum, _mm_mul_ps(x->y, _mm_set1_ps(m->m[1][j])));
+	sum = _mm_add_ps(sum, _mm_mul_ps(x->z, _mm_set1_ps(m->m[2][j])));
+	return _mm_add_ps(sum, _mm_mul_ps(x->w, _mm_set1_ps(m->m[3][j])));
+}
+
+// 读取 4 个相隔 stride 字节的矢量转置为 SoA，count 不足 4 时重复第一个矢量
+static inline vector_packet_t vector_packet_gather(const vector_t *v, int stride, int count)
+{
+	const char *base = (const char*)v;
+	__m128 x = _mm_loadu_ps(&v->x);
+	__m128 y = count > 1 ? _mm_loadu_ps((const float*)(base + stride)) : x;
+	__m128 z = count > 2 ? _mm_loadu_ps((const float*)(base + 2 * stride)) : x;
+	__m128 w = count > 3 ? _mm_loadu_ps((const float*)(base + 3 * stride)) : x;
+	_MM_TRANSPOSE4_PS(x, y, z, w);
+	vector_packet_t p = { x, y, z, w };
+	return p;
+}
+
+// 转置回 AoS，写入相隔 stride 字节的前 count 个矢量
+static inline void vector_packet_scatter(const vector_packet_t *p, vector_t *v, int stride, int count)
+{
+	__m128 x = p->x, y = p->y, z = p->z, w = p->w;
+	_MM_TRANSPOSE4_PS(x, y, z, w);
+	char *base = (char*)v;
+	_mm_storeu_ps(&v->x, x);
+	if (count > 1) _mm_storeu_ps((float*)(base + stride), y);
+	if (count > 2) _mm_storeu_ps((float*)(base + 2 * stride), z);
+	if (count > 3) _mm_storeu_ps((float*)(base + 3 * stride), w);
+}
+
+// 与 vector_packet_gather 相同，前 count 个矢量的地址由 v 给出
+static inline vector_packet_t vector_packet_gather_ptr(const vector_t *const *v, int count)
+{
+	__m128 x = _mm_loadu_ps(&v[0]->x);
+	__m128 y = count > 1 ? _mm_loadu_ps(&v[1]->x) : x;
+	__m128 z = count > 2 ? _mm_loadu_ps(&v[2]->x) : x;
+	__m128 w = count > 3 ? _mm_loadu_ps(&v[3]->x) : x;
+	_MM_TRANSPOSE4_PS(x, y, z, w);
+	vector_packet_t p = { x, y, z, w };
+	return p;
+}
+
+// 与 vector_packet_scatter 相同，前 count 个矢量的地址由 v 给出
+static inline void vector_packet_scatter_ptr(const vector_packet_t *p, vector_t *const *v, int count)
+{
+	__m128 x = p->x, y = p->y, z = p->z, w = p->w;
+	_MM_TRANSPOSE4_PS(x, y, z, w);
+	_mm_storeu_ps(&v[0]->x, x);
+	if (count > 1) _mm_storeu_ps(&v[1]->x, y);
+	if (count > 2) _mm_storeu_ps(&v[2]->x, z);
+	if (count > 3) _mm_storeu_ps(&v[3]->x, w);
+}
+
+// y = x * m，按 matrix_apply 的顺序累加
+static inline void vector_packet_apply(vector_packet_t *y, const vector_packet_t *x, const matrix_t *m)
+{
+	vector_packet_t r;
+	r.x = vector_packet_apply_column(x, m, 0);
+	r.y = vector_packet_apply_column(x, m, 1);
+	r.z = vector_packet_apply_column(x, m, 2);
+	r.w = vector_packet_apply_column(x, m, 3);
+	*y = r;
+}
@@ -35,12 +35,23 @@
 #include "bmpReader.h"
 #include "blend.h"
 #include "camera.h"
+#include "raster.h"
+#include "raster_kernel.h"
+#include "tile_raster.h"
+#include "texture.h"
+#include "clip.h"
+#include "shadow_atlas.h"
+#include "cull.h"
 
 static int default_texture_id = 0;
 static int texture_bmp1 = 0;
 static int texture_bmp2 = 0;
 static int texture_shadow = 0;
-static int framebuffer_shadow = 0;
+static int sampler_trilinear = DEFAULT_SAMPLER_ID;
+static int sampler_shadow = DEFAULT_SAMPLER_ID;
+static int framebuffer_shadow = RENDER_NO_SET_FRAMEBUFFER_INDEX;	// 阴影图集，所有光源的阴影图
+static int framebuffer_shadow_static = RENDER_NO_SET_FRAMEBUFFER_INDEX;	// 只有静态投射物的阴影图集，区域与阴影图集相同
+static shadow_atlas_t shadow_atlas;
 
 //=====================================================================
 // 绘制区域
@@ -101,85 +112,9 @@ void device_draw_line(device_t *device, int x1, int y1, int x2, int y2, IUINT32
 // 渲染实现
 //=====================================================================
 
-// 绘制扫描线
-void device_draw_scanline(device_t *device, scanline_t *scanline) {
-	IUINT32 *framebuffer = device->framebuffer[scanline->y];
-	float *zbuffer = device->zbuffer[scanline->y];
-	if (device->bind_frame_buffer_idx >= 0 && device->bind_frame_buffer_idx < MAX_FRAME_BUFFER && device->framebuffer_array[device->bind_frame_buffer_idx].is_used)
-	{
-		framebuffer = device->framebuffer_array[device->bind_frame_buffer_idx].framebuffer[scanline->y];
-		zbuffer = device->framebuffer_array[device->bind_frame_buffer_idx].zbuffer[scanline->y];
-	}
-
-	int x = scanline->x;
-	int w = scanline->w;
-	int width = device->framebuffer_width;
-	for (; w > 0; x++, w--) {
-		if (x >= 0 && x < width) {
-			float rhw = scanline->v.rhw;
-			if (rhw >= zbuffer[x]) {
-#ifdef USE_GDI_VIEW
-				func_pixel_shader p_shader = get_pixel_shader(device);
-				if (p_shader)
-				{
-					framebuffer[x] = p_shader(device, &(scanline->v));
-					zbuffer[x] = rhw;
-				}
-#else
-				func_pixel_shader p_shader = get_pixel_shader(device);
-				if (p_shader)
-				{
-					IUINT32 color = p_shader(device, &(scanline->v));
-					if (is_opaque_pixel_color(color))
-					{
-						framebuffer[x] = color;
-						zbuffer[x] = rhw;
-					}
-					else {
-						framebuffer[x] = blend_frame_buffer_color(device, color, framebuffer[x]);
-					}
-				}
-#endif
-			}
-		}
-		vertex_add(&scanline->v, &scanline->step);
-		if (x >= width) break;
-	}
-}
-
-// 主渲染函数
-void device_render_trap(device_t *device, trapezoid_t *trap) {
-	scanline_t scanline;
-	int j, top, bottom;
-	top = (int)(trap->top + 0.5f);
-	bottom = (int)(trap->bottom + 0.5f);
-
-	float left_height = trap->left.v2.pos.y - trap->left.v1.pos.y;
-	vertex_t left_vertex_step;
-	vertex_division(&left_vertex_step, &trap->left.v1, &trap->left.v2, left_height);
-
-	float right_height = trap->right.v2.pos.y - trap->right.v1.pos.y;
-	vertex_t right_vertex_step;
-	vertex_division(&right_vertex_step, &trap->right.v1, &trap->right.v2, right_height);
-
-	trapezoid_edge_interp(trap, (float)top + 0.5f);
-
-	for (j = top; j < bottom; j++) {
-		if (j >= 0 && j < device->framebuffer_height) {
-			//trapezoid_edge_interp(trap, (float)j + 0.5f);
-			trapezoid_init_scan_line(trap, &scanline, j);
-			device_draw_scanline(device, &scanline);
-		}
-		//if (j >= device->framebuffer_height) break;
-
-		vertex_add(&trap->left.v, &left_vertex_step);
-		vertex_add(&trap->right.v, &right_vertex_step);
-	}
-}
-
 static void device_draw_triangles(device_t *device, 
 	vector_t *k1, vector_t *k2, vector_t *k3,
-	vertex_t *s1, vertex_t *s2, vertex_t *s3)
+	const vertex_t *s1, const vertex_t *s2, const vertex_t *s3)
 {
 	point_t p1, p2, p3;
 	// 归一化
@@ -190,8 +125,6 @@ static void device_draw_triangles(device_t *device,
 	// 纹理或者色彩绘制
 	if (device->render_state != 0) {
 		vertex_t t1 = *s1, t2 = *s2, t3 = *s3;
-		trapezoid_t traps[2];
-		int n;
 
 		t1.pos = p1;
 		t2.pos = p2;
@@ -204,173 +137,129 @@ static void device_draw_triangles(device_t *device,
 		vertex_rhw_init(&t2);	// 初始化 w
 		vertex_rhw_init(&t3);	// 初始化 w
 
-		// 拆分三角形为0-2个梯形，并且返回可用梯形数量
-		n = trapezoid_init_triangle(traps, &t1, &t2, &t3);
+		device->raster_stats.triangle_num++;
 
-		if (n >= 1) device_render_trap(device, &traps[0]);
-		if (n >= 2) device_render_trap(device, &traps[1]);
+		if (device->raster_mode == RASTER_MODE_TILE)
+		{
+			// 不会写入任何像素时无需分箱
+			const pipeline_state_t *pso = &device->pipeline_state;
+			if (pso->color_write ? pso->pixel_shader != NULL : pso->depth_write)
+			{
+				tile_raster_bin_triangle(device, &t1, &t2, &t3);
+			}
+		}
+		else
+		{
+			raster_region_t region;
+			device_init_raster_region(device, &region);
+			device_render_triangle(device, &t1, &t2, &t3, &region);
+			raster_stats_add(&device->raster_stats, &region.stats);
+		}
 	}
 
 	if (device->render_state == RENDER_STATE_WIREFRAME) {		// 线框绘制
+		device_flush(device);
 		device_draw_line(device, (int)p1.x, (int)p1.y, (int)p2.x, (int)p2.y, device->foreground);
 		device_draw_line(device, (int)p1.x, (int)p1.y, (int)p3.x, (int)p3.y, device->foreground);
 		device_draw_line(device, (int)p3.x, (int)p3.y, (int)p2.x, (int)p2.y, device->foreground);
 	}
 }
 
-// 根据 render_state 绘制原始三角形
-void device_draw_primitive(device_t *device, vertex_t *v1, 
-	vertex_t *v2, vertex_t *v3) {
-	point_t c1, c2, c3;
-
-	func_vertex_shader p_shader = get_vertex_shader(device);
-	if (p_shader)
-	{
-		p_shader(device, v1, &c1);
-		p_shader(device, v2, &c2);
-		p_shader(device, v3, &c3);
-	}
-
+// 只根据裁剪空间坐标判断三角形是否不可见：背面、投影面积为 0、三个顶点都在视锥同一个平面外侧
+static bool device_cull_primitive(device_t *device, point_t *c1, point_t *c2, point_t *c3) {
 	// 背面剔除
-	if (function_cull_back(device, &c1, &c2, &c3) != 0) return;
+	if (function_cull_back(device, c1, c2, c3) != 0) return true;
 
-	// 裁剪，注意此处可以完善为具体判断几个点在 cvv内以及同cvv相交平面的坐标比例
-	// 进行进一步精细裁剪，将一个分解为几个完全处在 cvv内的三角形
-	int check1 = transform_check_cvv(&c1);
-	int check2 = transform_check_cvv(&c2);
-	int check3 = transform_check_cvv(&c3);
+	// (x, y, w) 线性相关时三个顶点投影到同一条直线上
+	float area = c1->x * (c2->y * c3->w - c3->y * c2->w) - c2->x * (c1->y * c3->w - c3->y * c1->w) + c3->x * (c1->y * c2->w - c2->y * c1->w);
+	if (area == 0.0f) return true;
 
-	int check_sum = 0;
-	check_sum += (check1 & 1);
-	check_sum += (check2 & 1);
-	check_sum += (check3 & 1);
+	return (transform_check_cvv(c1) & transform_check_cvv(c2) & transform_check_cvv(c3)) != 0;
+}
 
-	if (check_sum == 3) // 全在外侧
+// 未被剔除且已计算属性的三角形，c1 c2 c3 为裁剪空间坐标，裁剪后根据 render_state 绘制
+static void device_draw_visible_primitive(device_t *device, const vertex_t *v1,
+	const vertex_t *v2, const vertex_t *v3, point_t c1, point_t c2, point_t c3) {
+	// 近平面和远平面精确裁剪，x y 只在超出保护带时裁剪，保护带内超出视口的部分由光栅化跳过
+	int planes = clip_check_guard_band(&c1) | clip_check_guard_band(&c2) | clip_check_guard_band(&c3);
+	if (planes == 0)
 	{
+		device_draw_triangles(device, &c1, &c2, &c3, v1, v2, v3);
 		return;
 	}
 
-	float ratio;
-	vertex_t s1, s2, s3, s4;
-	vector_t k1, k2, k3, k4;
-	if (check_sum == 2)
+	// 裁剪为凸多边形后按扇形拆分为三角形
+	vertex_t vertices[CLIP_MAX_VERTEX_NUM];
+	vector_t positions[CLIP_MAX_VERTEX_NUM];
+	vertices[0] = *v1;
+	vertices[1] = *v2;
+	vertices[2] = *v3;
+	positions[0] = c1;
+	positions[1] = c2;
+	positions[2] = c3;
+	int count = clip_polygon(planes, vertices, positions, 3);
+	for (int i = 1; i + 1 < count; i++)
 	{
-		if ((check1 & 1) == 0)
-		{
-			s1 = *v1;
-			k1 = c1;
-
-			calc_cvv_cut_vertex_ratio(&c1, &c2, &ratio);
-			vertex_interp(&s2, v1, v2, ratio);
-			vector_interp(&k2, &c1, &c2, ratio);
-
-			calc_cvv_cut_vertex_ratio(&c1, &c3, &ratio);
-			vertex_interp(&s3, v1, v3, ratio);
-			vector_interp(&k3, &c1, &c3, ratio);
-		}
-		else if ((check2 & 1) == 0)
-		{
-			s2 = *v2;
-			k2 = c2;
+		device_draw_triangles(device, &positions[0], &positions[i], &positions[i + 1], &vertices[0], &vertices[i], &vertices[i + 1]);
+	}
+}
 
-			calc_cvv_cut_vertex_ratio(&c2, &c3, &ratio);
-			vertex_interp(&s3, v2, v3, ratio);
-			vector_interp(&k3, &c2, &c3, ratio);
+// 根据 render_state 绘制原始三角形
+void device_draw_primitive(device_t *device, vertex_t *v1, 
+	vertex_t *v2, vertex_t *v3) {
+	point_t c1, c2, c3;
 
-			calc_cvv_cut_vertex_ratio(&c2, &c1, &ratio);
-			vertex_interp(&s1, v2, v1, ratio);
-			vector_interp(&k1, &c2, &c1, ratio);
-		}
-		else if ((check3 & 1) == 0)
+	// 先只计算位置，剔除后再计算属性
+	func_vertex_shader_batch p_position = device->pipeline_state.vertex_position_shader;
+	if (p_position)
+	{
+		p_position(device, v1, &c1, 1);
+		p_position(device, v2, &c2, 1);
+		p_position(device, v3, &c3, 1);
+		device->raster_stats.vertex_shader_num += 3;
+		if (device_cull_primitive(device, &c1, &c2, &c3)) return;
+
+		func_vertex_attribute_shader p_attribute = device->pipeline_state.vertex_attribute_shader;
+		if (p_attribute)
 		{
-			s3 = *v3;
-			k3 = c3;
-
-			calc_cvv_cut_vertex_ratio(&c3, &c2, &ratio);
-			vertex_interp(&s2, v3, v2, ratio);
-			vector_interp(&k2, &c3, &c2, ratio);
-
-			calc_cvv_cut_vertex_ratio(&c3, &c1, &ratio);
-			vertex_interp(&s1, v3, v1, ratio);
-			vector_interp(&k1, &c3, &c1, ratio);
+			vertex_t *vertices[3] = { v1, v2, v3 };
+			p_attribute(device, vertices, 3);
+			device->raster_stats.vertex_attribute_num += 3;
 		}
-
-		device_draw_triangles(device, &k1, &k2, &k3, &s1, &s2, &s3);
 	}
-	else if (check_sum == 1)
+	else
 	{
-		if ((check1 & 1) == 1)
+		func_vertex_shader p_shader = device->pipeline_state.vertex_shader;
+		if (p_shader)
 		{
-			calc_cvv_cut_vertex_ratio(&c1, &c2, &ratio);
-			vertex_interp(&s1, v1, v2, ratio);
-			vector_interp(&k1, &c1, &c2, ratio);
-
-			s2 = *v2;
-			k2 = c2;
-
-			s3 = *v3;
-			k3 = c3;
-
-			calc_cvv_cut_vertex_ratio(&c1, &c3, &ratio);
-			vertex_interp(&s4, v1, v3, ratio);
-			vector_interp(&k4, &c1, &c3, ratio);
-
-			device_draw_triangles(device, &k1, &k2, &k3, &s1, &s2, &s3);
-			device_draw_triangles(device, &k1, &k3, &k4, &s1, &s3, &s4);
+			p_shader(device, v1, &c1);
+			p_shader(device, v2, &c2);
+			p_shader(device, v3, &c3);
+			device->raster_stats.vertex_shader_num += 3;
+			device->raster_stats.vertex_attribute_num += 3;
 		}
-		else if ((check2 & 1) == 1)
-		{
-			s1 = *v1;
-			k1 = c1;
-
-			calc_cvv_cut_vertex_ratio(&c2, &c1, &ratio);
-			vertex_interp(&s2, v2, v1, ratio);
-			vector_interp(&k2, &c2, &c1, ratio);
-
-			calc_cvv_cut_vertex_ratio(&c2, &c3, &ratio);
-			vertex_interp(&s3, v2, v3, ratio);
-			vector_interp(&k3, &c2, &c3, ratio);
+		if (device_cull_primitive(device, &c1, &c2, &c3)) return;
+	}
 
-			s4 = *v3;
-			k4 = c3;
+	device_draw_visible_primitive(device, v1, v2, v3, c1, c2, c3);
+}
 
-			device_draw_triangles(device, &k1, &k2, &k3, &s1, &s2, &s3);
-			device_draw_triangles(device, &k1, &k3, &k4, &s1, &s3, &s4);
-		}
-		else if ((check3 & 1) == 1)
+// 索引为 index 的顶点执行完整的顶点着色，结果写入顶点变换缓存，同一次绘制中已着色的顶点不再执行
+static void device_shade_cached_vertex(device_t *device, int index, unsigned int draw_id)
+{
+	vertex_cache_t *cache = device->vertex_cache;
+	if (cache->tag[index] != draw_id)
+	{
+		cache->vertex[index] = device->vertex_array[index];
+		func_vertex_shader p_shader = device->pipeline_state.vertex_shader;
+		if (p_shader)
 		{
-			s1 = *v1;
-			k1 = c1;
-
-			s2 = *v2;
-			k2 = c2;
-
-			calc_cvv_cut_vertex_ratio(&c3, &c2, &ratio);
-			vertex_interp(&s3, v3, v2, ratio);
-			vector_interp(&k3, &c3, &c2, ratio);
-
-			calc_cvv_cut_vertex_ratio(&c3, &c1, &ratio);
-			vertex_interp(&s4, v3, v1, ratio);
-			vector_interp(&k4, &c3, &c1, ratio);
-
-			device_draw_triangles(device, &k1, &k2, &k3, &s1, &s2, &s3);
-			device_draw_triangles(device, &k1, &k3, &k4, &s1, &s3, &s4);
+			p_shader(device, &cache->vertex[index], &cache->clip[index]);
+			device->raster_stats.vertex_shader_num++;
+			device->raster_stats.vertex_attribute_num++;
 		}
+		cache->tag[index] = draw_id;
 	}
-	else
-	{
-		s1 = *v1;
-		k1 = c1;
-
-		s2 = *v2;
-		k2 = c2;
-
-		s3 = *v3;
-		k3 = c3;
-
-		device_draw_triangles(device,&k1,&k2,&k3,&s1,&s2,&s3);
-	}
-
 }
 
 //=====================================================================
@@ -416,6 +305,7 @@ vertex_t mesh_panel[4] = {
 };
 
 #define TRIANGLES 1
+#define DRAW_PRIMITIVE_BATCH_NUM 256	// 索引绘制每批剔除的三角形数，批内可见三角形的顶点一起计算属性
 
 // 简单期间 索引全部用int
 void draw_elements(device_t* device,IUINT8 uElementType, IUINT32 uElementCount, int* index)
@@ -427,19 +317,126 @@ void draw_elements(device_t* device,IUINT8 uElementType, IUINT32 uElementCount,
 			return;
 		}
 
+		if (!device_begin_draw(device))
+		{
+			return;
+		}
+
+		if (uElementCount == 0)
+		{
+			return;
+		}
+
 		IUINT32 i;
-		for (i = 0; i < uElementCount; i++)
+		int index_min = index[0];
+		int index_max = index[0];
+		for (i = 1; i < uElementCount * 3; i++)
 		{
-			vertex_t p1 = device->vertex_array[index[i * 3]];
-			vertex_t p2 = device->vertex_array[index[i * 3 + 1]];
-			vertex_t p3 = device->vertex_array[index[i * 3 + 2]];
-			device_draw_primitive(device, &p1, &p2, &p3);
+			if (index[i] < index_min) index_min = index[i];
+			if (index[i] > index_max) index_max = index[i];
+		}
+
+		if (index_min < 0 || index_max >= MAX_VERTEX_CACHE_NUM)
+		{
+			for (i = 0; i < uElementCount; i++)
+			{
+				vertex_t p1 = device->vertex_array[index[i * 3]];
+				vertex_t p2 = device->vertex_array[index[i * 3 + 1]];
+				vertex_t p3 = device->vertex_array[index[i * 3 + 2]];
+				device_draw_primitive(device, &p1, &p2, &p3);
+			}
+			return;
+		}
+
+		// 每次绘制的顶点着色结果只在本次绘制内有效，编号回绕时清空缓存
+		vertex_cache_t *cache = device->vertex_cache;
+		unsigned int draw_id = ++cache->draw_id;
+		if (draw_id == 0)
+		{
+			memset(cache->tag, 0, sizeof(cache->tag));
+			draw_id = ++cache->draw_id;
+		}
+
+		func_vertex_shader_batch p_position = device->pipeline_state.vertex_position_shader;
+		if (p_position == NULL)
+		{
+			// 三角形共用的顶点只执行一次完整的顶点着色
+			for (i = 0; i < uElementCount * 3; i++)
+			{
+				device_shade_cached_vertex(device, index[i], draw_id);
+			}
+
+			for (i = 0; i < uElementCount; i++)
+			{
+				int i1 = index[i * 3];
+				int i2 = index[i * 3 + 1];
+				int i3 = index[i * 3 + 2];
+				if (!device_cull_primitive(device, &cache->clip[i1], &cache->clip[i2], &cache->clip[i3]))
+				{
+					device_draw_visible_primitive(device, &cache->vertex[i1], &cache->vertex[i2], &cache->vertex[i3],
+						cache->clip[i1], cache->clip[i2], cache->clip[i3]);
+				}
+			}
+			return;
+		}
+
+		// 索引范围内的顶点连续复制到缓存，按 SoA 批量计算位置
+		int count = index_max - index_min + 1;
+		memcpy(&cache->vertex[index_min], &device->vertex_array[index_min], count * sizeof(vertex_t));
+		p_position(device, &cache->vertex[index_min], &cache->clip[index_min], count);
+		device->raster_stats.vertex_shader_num += count;
+
+		// 每批三角形先按位置剔除，可见三角形用到的顶点计算一次属性后再绘制
+		func_vertex_attribute_shader p_attribute = device->pipeline_state.vertex_attribute_shader;
+		for (IUINT32 first = 0; first < uElementCount; first += DRAW_PRIMITIVE_BATCH_NUM)
+		{
+			IUINT32 last = first + DRAW_PRIMITIVE_BATCH_NUM < uElementCount ? first + DRAW_PRIMITIVE_BATCH_NUM : uElementCount;
+			IUINT32 visible[DRAW_PRIMITIVE_BATCH_NUM];
+			vertex_t *vertices[DRAW_PRIMITIVE_BATCH_NUM * 3];
+			int visible_num = 0;
+			int vertex_num = 0;
+			for (i = first; i < last; i++)
+			{
+				int *tri = &index[i * 3];
+				if (device_cull_primitive(device, &cache->clip[tri[0]], &cache->clip[tri[1]], &cache->clip[tri[2]]))
+				{
+					continue;
+				}
+				visible[visible_num++] = i;
+				for (int k = 0; k < 3; k++)
+				{
+					if (cache->tag[tri[k]] != draw_id)
+					{
+						cache->tag[tri[k]] = draw_id;
+						vertices[vertex_num++] = &cache->vertex[tri[k]];
+					}
+				}
+			}
+
+			if (p_attribute && vertex_num > 0)
+			{
+				p_attribute(device, vertices, vertex_num);
+				device->raster_stats.vertex_attribute_num += vertex_num;
+			}
+
+			for (int t = 0; t < visible_num; t++)
+			{
+				int i1 = index[visible[t] * 3];
+				int i2 = index[visible[t] * 3 + 1];
+				int i3 = index[visible[t] * 3 + 2];
+				device_draw_visible_primitive(device, &cache->vertex[i1], &cache->vertex[i2], &cache->vertex[i3],
+					cache->clip[i1], cache->clip[i2], cache->clip[i3]);
+			}
 		}
 	}
 }
 
 void draw_plane(device_t *device, int a, int b, int c, int d) {
 	vertex_t p1 = mesh[a], p2 = mesh[b], p3 = mesh[c], p4 = mesh[d];
+	if (!device_begin_draw(device))
+	{
+		return;
+	}
 	device_draw_primitive(device, &p1, &p2, &p3);
 	device_draw_primitive(device, &p3, &p4, &p1);
 }
@@ -456,7 +453,7 @@ void draw_backggroud(device_t *device)
 	draw_elements(device, TRIANGLES, 2, index_panel);
 }
 
-void draw_box(device_t *device, float theta, float box_x, float box_y, float box_z) {
+static void get_box_world(matrix_t *world, float theta, float box_x, float box_y, float box_z) {
 	matrix_t rotate;
 	matrix_set_rotate(&rotate, -1, -0.5, 1, theta);
 
@@ -468,7 +465,11 @@ void draw_box(device_t *device, float theta, float box_x, float box_y, float box
 
 	matrix_t model;
 	matrix_mul(&model, &scale, &rotate);
-	matrix_mul(&(device->transform.world), &model, &translate);
+	matrix_mul(world, &model, &translate);
+}
+
+void draw_box(device_t *device, float theta, float box_x, float box_y, float box_z) {
+	get_box_world(&(device->transform.world), theta, box_x, box_y, box_z);
 
 	matrix_inverse(&(device->transform.world), &(device->transform.worldInv));
 	transform_update(&device->transform);
@@ -485,12 +486,33 @@ static CCamera* g_mainCamera = NULL;
 static vector_t normal_light_energy = { 1.0,1.0,1.0,0.0 };// 入射光强
 static vector_t normal_light_direction = { 1.0,1.0,1.0,0.0 }; // 入射光方向
 
-static vector_t shadow_light_energy = { 1.0,1.0,1.0,0.0 };// 阴影入射光强
-static vector_t shadow_light_direction = { 0.0,5.0,0.0,0.0 }; // 阴影入射光方向
-static matrix_t shadow_light_transform_box;
-static matrix_t shadow_light_transform_panel;
-static IUINT32 **shadow_texture = NULL;
-static IUINT32 *shadow_texture_buffer = NULL;
+// 阴影投射物，同时也接收阴影，平面不会移动，盒子随旋转改变
+#define SHADOW_CASTER_PANEL	0
+#define SHADOW_CASTER_BOX	1
+#define SHADOW_CASTER_NUM	2
+static const bool shadow_caster_static[SHADOW_CASTER_NUM] = { true, false };
+
+// 各投射物世界矩阵的版本，改变时加一
+static unsigned int shadow_caster_version[SHADOW_CASTER_NUM] = { 1, 1 };
+
+// 投射阴影的光源，阴影图分配在阴影图集中
+typedef struct {
+	vector_t energy;	// 入射光强
+	vector_t direction;	// 入射光方向，光源视角位于该方向看向原点
+	int map_size;		// 阴影图的分辨率
+	int atlas_slot;		// 阴影图在图集中的区域，-1 为图集没有空间，不投射阴影
+	unsigned int version;	// 光源视角的版本，改变时加一
+	unsigned int map_version;	// 阴影图绘制时的版本，都没有改变时沿用上一帧的阴影图，0 为还没有绘制
+	unsigned int map_caster_version[SHADOW_CASTER_NUM];
+	matrix_t transform[SHADOW_CASTER_NUM];	// 各物体的光源变换矩阵
+	bool shadowed[SHADOW_CASTER_NUM];	// 物体可能在该光源的阴影中，为 false 时主视角不查找该光源的阴影图
+} shadow_light_t;
+
+// 前 SHADOW_LIGHT_NUM 个光源有效
+static shadow_light_t shadow_lights[MAX_SHADOW_LIGHT_NUM] = {
+	{ { 1.0,1.0,1.0,0.0 }, { 0.0,5.0,0.0,0.0 }, SHADOW_MAP_SIZE, -1, 1 },
+	{ { 0.3,0.3,0.4,0.0 }, { 3.0,4.0,-2.0,0.0 }, SHADOW_MAP_SIZE / 2, -1, 1 },
+};
 
 void setup_shader(device_t *device)
 {	
@@ -530,6 +552,10 @@ void setup_shader(device_t *device)
 
 void setup_shader_parma(device_t *device, vector_t eye)
 {	
+	// 只有半透明模式开启混合
+	blendstate_t opaque_blend_state = { BLEND_ONE, BLEND_ZERO };
+	device_set_blend_state(device, opaque_blend_state);
+
 	if (device->shader_state == SHADER_STATE_WIREFRAME)
 	{
 
@@ -537,6 +563,7 @@ void setup_shader_parma(device_t *device, vector_t eye)
 	else if (device->shader_state == SHADER_STATE_TEXTURE)
 	{
 		device_bind_texture(device, 0, default_texture_id);
+		device_bind_sampler(device, 0, sampler_trilinear);
 	}
 	else if (device->shader_state == SHADER_STATE_COLOR)
 	{
@@ -549,6 +576,7 @@ void setup_shader_parma(device_t *device, vector_t eye)
 		device_set_uniform_vector_value(device, 1, &normal_light_direction);
 
 		device_bind_texture(device, 0, default_texture_id);
+		device_bind_sampler(device, 0, sampler_trilinear);
 	}
 	else if (device->shader_state == SHADER_STATE_PHONG_LIGHT_TEXTURE)
 	{
@@ -562,10 +590,12 @@ void setup_shader_parma(device_t *device, vector_t eye)
 		device_set_uniform_vector_value(device, 3, &matrial);
 
 		device_bind_texture(device, 0, default_texture_id);
+		device_bind_sampler(device, 0, sampler_trilinear);
 	}
 	else if (device->shader_state == SHADER_STATE_TEXTURE_ALPHA)
 	{
 		device_bind_texture(device, 0, default_texture_id);
+		device_bind_sampler(device, 0, sampler_trilinear);
 		blendstate_t blendstate;
 		blendstate.srcState = BLEND_SRC_ALPHA;
 		blendstate.srcState = BLEND_ONE_MINUS_SRC_ALPHA;
@@ -575,15 +605,26 @@ void setup_shader_parma(device_t *device, vector_t eye)
 	{
 
 	}
-	else if (device->shader_state == SHADER_STATE_LIGHT_SHADOW)
+	else if (device->shader_state == SHADER_STATE_LIGHT_NO_SHADOW || device->shader_state == SHADER_STATE_LIGHT_SHADOW)
 	{
-		device_set_uniform_vector_value(device, 0, &shadow_light_energy);
+		vector_t light_num = { (float)SHADOW_LIGHT_NUM, 0.0f, 0.0f, 0.0f };
+		device_set_uniform_vector_value(device, SHADOW_UNIFORM_LIGHT_NUM, &light_num);
+		for (int i = 0; i < SHADOW_LIGHT_NUM; i++)
+		{
+			device_set_uniform_vector_value(device, SHADOW_UNIFORM_ENERGY(i), &shadow_lights[i].energy);
 
-		device_set_uniform_vector_value(device, 1, &shadow_light_direction);
+			device_set_uniform_vector_value(device, SHADOW_UNIFORM_DIRECTION(i), &shadow_lights[i].direction);
+		}
 
 		device_bind_texture(device, 0, default_texture_id);
+		device_bind_sampler(device, 0, sampler_trilinear);
 
-		device_bind_texture(device, 1, texture_shadow);
+		// 所有光源的阴影图在同一个图集中
+		if (device->shader_state == SHADER_STATE_LIGHT_SHADOW)
+		{
+			device_bind_texture(device, 1, texture_shadow);
+			device_bind_sampler(device, 1, sampler_shadow);
+		}
 	}
 	else if (device->shader_state == SHADER_STATE_BLINN_LIGHT_TEXTURE)
 	{
@@ -597,10 +638,20 @@ void setup_shader_parma(device_t *device, vector_t eye)
 		device_set_uniform_vector_value(device, 3, &matrial);
 
 		device_bind_texture(device, 0, default_texture_id);
+		device_bind_sampler(device, 0, sampler_trilinear);
 	}
 }
 
 void init_texture(device_t *device) {
+	// 颜色纹理三线性过滤，阴影图按最近点读取
+	samplerstate_t trilinear = { SAMPLER_WRAP_REPEAT, SAMPLER_WRAP_REPEAT, SAMPLER_FILTER_BILINEAR, SAMPLER_MIP_FILTER_LINEAR };
+	sampler_trilinear = device_gen_sampler(device);
+	device_set_sampler_state(device, sampler_trilinear, trilinear);
+
+	samplerstate_t shadow = { SAMPLER_WRAP_CLAMP, SAMPLER_WRAP_CLAMP, SAMPLER_FILTER_NEAREST, SAMPLER_MIP_FILTER_NONE, SHADOW_PCF };
+	sampler_shadow = device_gen_sampler(device);
+	device_set_sampler_state(device, sampler_shadow, shadow);
+
 	static IUINT32 texture[256][256];
 	int i, j;
 	for (j = 0; j < 256; j++) {
@@ -610,21 +661,26 @@ void init_texture(device_t *device) {
 		}
 	}
 	default_texture_id = device_gen_texture(device);
-	device_set_texture(device, texture, 256 * 4, 256, 256, default_texture_id);
+	device_upload_texture(device, texture, 256 * 4, 256, 256, default_texture_id);
+	device_generate_mipmap(device, default_texture_id);
 
-	long width, height;
+	long width = 0, height = 0;
 	unsigned int* bmp_texture = read_bmp("../res/1.bmp", width, height);
 	if (bmp_texture)
 	{
 		texture_bmp1 = device_gen_texture(device);
-		device_set_texture(device, bmp_texture, width * 4, width, height, texture_bmp1);
+		device_upload_texture(device, bmp_texture, width * 4, width, height, texture_bmp1);
+		device_generate_mipmap(device, texture_bmp1);
+		delete[] bmp_texture;
 	}
 
 	bmp_texture = read_bmp("../res/2.bmp", width, height);
 	if (bmp_texture)
 	{
 		texture_bmp2 = device_gen_texture(device);
-		device_set_texture(device, bmp_texture, width * 4, width, height, texture_bmp2);
+		device_upload_texture(device, bmp_texture, width * 4, width, height, texture_bmp2);
+		device_generate_mipmap(device, texture_bmp2);
+		delete[] bmp_texture;
 	}
 }
 
@@ -658,6 +714,736 @@ void set_key_quit()
 	key_quit = 1;
 }
 
+// 阴影模式下物体在所有光源的阴影区域之外时使用不查找阴影图的光照
+// 每个光源的光源变换矩阵和阴影图在图集中的位置，物体不在该光源的阴影中时不查找该光源的阴影图
+static void setup_shadow_receiver(device_t *device, int object)
+{
+	bool shadowed = false;
+	for (int i = 0; i < SHADOW_LIGHT_NUM; i++)
+	{
+		shadowed = shadowed || (shadow_lights[i].atlas_slot >= 0 && shadow_lights[i].shadowed[object]);
+	}
+
+	int shader_state = shadowed ? SHADER_STATE_LIGHT_SHADOW : SHADER_STATE_LIGHT_NO_SHADOW;
+	if (device->shader_state != shader_state)
+	{
+		device_set_shader_state(device, shader_state);
+		setup_shader_parma(device, g_mainCamera->get_eye());
+	}
+
+	// 过滤核的半径，区域向内收缩，不读取相邻区域的纹素
+	int pcf = device->sampler_array[sampler_shadow].state.pcf;
+	int border = pcf == SAMPLER_PCF_5X5 ? 2 : (pcf == SAMPLER_PCF_3X3 ? 1 : 0);
+	for (int i = 0; i < SHADOW_LIGHT_NUM; i++)
+	{
+		shadow_light_t *light = &shadow_lights[i];
+		vector_t atlas_uv = { 0.0f, 0.0f, 0.0f, 0.0f };
+		vector_t atlas_clamp = { 0.0f, 0.0f, 0.0f, 0.0f };
+		if (light->atlas_slot >= 0 && light->shadowed[object])
+		{
+			shadow_atlas_get_uv_transform(&shadow_atlas, light->atlas_slot, border, &atlas_uv, &atlas_clamp);
+		}
+		device_set_uniform_matrix_value(device, i, &light->transform[object]);
+		device_set_uniform_vector_value(device, SHADOW_UNIFORM_ATLAS_UV(i), &atlas_uv);
+		device_set_uniform_vector_value(device, SHADOW_UNIFORM_ATLAS_CLAMP(i), &atlas_clamp);
+	}
+}
+
+// 网格在模型空间的包围盒
+static void get_mesh_bounds(const vertex_t *vertices, int count, vector_t *box_min, vector_t *box_max)
+{
+	*box_min = vertices[0].pos;
+	*box_max = vertices[0].pos;
+	for (int i = 1; i < count; i++)
+	{
+		const point_t *p = &vertices[i].pos;
+		if (p->x < box_min->x) box_min->x = p->x;
+		if (p->y < box_min->y) box_min->y = p->y;
+		if (p->z < box_min->z) box_min->z = p->z;
+		if (p->x > box_max->x) box_max->x = p->x;
+		if (p->y > box_max->y) box_max->y = p->y;
+		if (p->z > box_max->z) box_max->z = p->z;
+	}
+}
+
+// 主视角下各物体在模型空间的包围体，物体编号同 SHADOW_CASTER_*
+static cull_bounds_t scene_object_bounds[SHADOW_CASTER_NUM];
+static cull_list_t *scene_cull_list = NULL;
+
+// 主视角的视锥剔除，visible[i] 为 0 时物体的包围体完全在视锥之外
+static void cull_scene_objects(device_t *device, float alpha, float box_x, float box_y, float box_z, unsigned char visible[SHADOW_CASTER_NUM])
+{
+	if (scene_cull_list == NULL)
+	{
+		vector_t box_min, box_max;
+		get_mesh_bounds(mesh_panel, sizeof(mesh_panel) / sizeof(mesh_panel[0]), &box_min, &box_max);
+		cull_bounds_from_box(&scene_object_bounds[SHADOW_CASTER_PANEL], &box_min, &box_max);
+		get_mesh_bounds(mesh, sizeof(mesh) / sizeof(mesh[0]), &box_min, &box_max);
+		cull_bounds_from_box(&scene_object_bounds[SHADOW_CASTER_BOX], &box_min, &box_max);
+		scene_cull_list = cull_list_create(SHADOW_CASTER_NUM);
+	}
+
+	matrix_t world[SHADOW_CASTER_NUM];
+	matrix_set_identity(&world[SHADOW_CASTER_PANEL]);
+	get_box_world(&world[SHADOW_CASTER_BOX], alpha, box_x, box_y, box_z);
+
+	cull_list_clear(scene_cull_list);
+	for (int i = 0; i < SHADOW_CASTER_NUM; i++)
+	{
+		cull_list_add(scene_cull_list, &scene_object_bounds[i], &world[i]);
+	}
+
+	matrix_t view_projection;
+	matrix_mul(&view_projection, &device->transform.view, &device->transform.projection);
+	cull_frustum_t frustum;
+	cull_frustum_init(&frustum, &view_projection);
+	cull_list_test(scene_cull_list, &frustum, visible);
+}
+
+// 主视角下的场景，视锥之外的物体不提交绘制
+static void draw_scene(device_t *device, float alpha, float box_x, float box_y, float box_z)
+{
+	unsigned char visible[SHADOW_CASTER_NUM];
+	cull_scene_objects(device, alpha, box_x, box_y, box_z, visible);
+
+	if (device->render_state == RENDER_STATE_SHADOW_MAP)
+	{
+		if (visible[SHADOW_CASTER_PANEL])
+		{
+			setup_shadow_receiver(device, SHADOW_CASTER_PANEL);
+			draw_backggroud(device);
+		}
+		if (visible[SHADOW_CASTER_BOX])
+		{
+			setup_shadow_receiver(device, SHADOW_CASTER_BOX);
+		}
+	}
+	if (visible[SHADOW_CASTER_BOX])
+	{
+		draw_box(device, alpha, box_x, box_y, box_z);
+	}
+}
+
+// 计算各物体的光源变换矩阵，包围盒在光源视锥之外的投射物不绘制到阴影图
+// 接收物只有在阴影图上与某个可见的投射物重叠、且该投射物离光源更近时才可能在阴影中
+static void cull_shadow_objects(const transform_t *light_view, shadow_light_t *shadow_light, float alpha, float box_x, float box_y, float box_z, bool visible[SHADOW_CASTER_NUM])
+{
+	transform_t light = *light_view;
+	transform_set_size(&light, shadow_light->map_size, shadow_light->map_size);
+
+	matrix_t world[SHADOW_CASTER_NUM];
+	vector_t box_min[SHADOW_CASTER_NUM], box_max[SHADOW_CASTER_NUM];
+	matrix_set_identity(&world[SHADOW_CASTER_PANEL]);
+	get_mesh_bounds(mesh_panel, sizeof(mesh_panel) / sizeof(mesh_panel[0]), &box_min[SHADOW_CASTER_PANEL], &box_max[SHADOW_CASTER_PANEL]);
+	get_box_world(&world[SHADOW_CASTER_BOX], alpha, box_x, box_y, box_z);
+	get_mesh_bounds(mesh, sizeof(mesh) / sizeof(mesh[0]), &box_min[SHADOW_CASTER_BOX], &box_max[SHADOW_CASTER_BOX]);
+
+	vector_t ndc_min[SHADOW_CASTER_NUM], ndc_max[SHADOW_CASTER_NUM];
+	for (int i = 0; i < SHADOW_CASTER_NUM; i++)
+	{
+		light.world = world[i];
+		transform_update(&light);
+		shadow_light->transform[i] = light.transform;
+		visible[i] = transform_check_box_cvv(&light.transform, &box_min[i], &box_max[i], &ndc_min[i], &ndc_max[i]) == 0;
+	}
+
+	for (int i = 0; i < SHADOW_CASTER_NUM; i++)
+	{
+		shadow_light->shadowed[i] = false;
+		for (int j = 0; j < SHADOW_CASTER_NUM && visible[i]; j++)
+		{
+			if (visible[j] && ndc_min[j].x <= ndc_max[i].x && ndc_min[i].x <= ndc_max[j].x && ndc_min[j].y <= ndc_max[i].y && ndc_min[i].y <= ndc_max[j].y && ndc_min[j].z < ndc_max[i].z)
+			{
+				shadow_light->shadowed[i] = true;
+				break;
+			}
+		}
+	}
+}
+
+// 光源视角下把一个光源的阴影图绘制到图集中的区域，视口限制为该区域，只绘制光源视锥内的投射物
+// 光源和投射物的版本都没有改变时沿用上一帧的阴影图
+static void draw_light_shadow_map(device_t *device, shadow_light_t *light, float alpha, float box_x, float box_y, float box_z)
+{
+	bool static_dirty = light->map_version != light->version;
+	bool dynamic_dirty = static_dirty;
+	for (int i = 0; i < SHADOW_CASTER_NUM; i++)
+	{
+		if (light->map_caster_version[i] != shadow_caster_version[i])
+		{
+			if (shadow_caster_static[i]) static_dirty = true;
+			else dynamic_dirty = true;
+		}
+	}
+	if (light->atlas_slot < 0 || (!static_dirty && !dynamic_dirty))
+	{
+		return;
+	}
+
+	int x, y, size;
+	shadow_atlas_get_rect(&shadow_atlas, light->atlas_slot, &x, &y, &size);
+
+	vector_t eye = { light->direction.x, light->direction.y, light->direction.z, 1 }, at = { 0, 0, 0, 1 }, up = { 0, 0, 1, 1 };
+	CCamera::makeup_view_matrix(&(device->transform.view), eye, at, up);
+
+	bool visible[SHADOW_CASTER_NUM];
+	cull_shadow_objects(&device->transform, light, alpha, box_x, box_y, box_z, visible);
+
+#ifdef SHADOW_MAP_PARTIAL_UPDATE
+	// 静态投射物另存一份深度，只有动态投射物改变时复制过来，不再绘制静态投射物
+	if (static_dirty)
+	{
+		device_bind_framebuffer(device, framebuffer_shadow_static);
+		device_set_viewport(device, x, y, size, size);
+		device_clear_framebuffer_depth(device, framebuffer_shadow_static, x, y, size, size);
+
+		setup_shader(device);
+		setup_shader_parma(device, eye);
+
+		if (visible[SHADOW_CASTER_PANEL])
+		{
+			draw_backggroud(device);
+		}
+
+		device_unbind_framebuffer(device, framebuffer_shadow_static);
+	}
+
+	device_copy_framebuffer_depth(device, framebuffer_shadow, framebuffer_shadow_static, x, y, size, size);
+	device_bind_framebuffer(device, framebuffer_shadow);
+	device_set_viewport(device, x, y, size, size);
+
+	setup_shader(device);
+	setup_shader_parma(device, eye);
+#else
+	device_bind_framebuffer(device, framebuffer_shadow);
+	device_set_viewport(device, x, y, size, size);
+	device_clear_framebuffer_depth(device, framebuffer_shadow, x, y, size, size);
+
+	setup_shader(device);
+	setup_shader_parma(device, eye);
+
+	if (visible[SHADOW_CASTER_PANEL])
+	{
+		draw_backggroud(device);
+	}
+#endif
+
+	if (visible[SHADOW_CASTER_BOX])
+	{
+		draw_box(device, alpha, box_x, box_y, box_z);
+	}
+
+	device_unbind_framebuffer(device, framebuffer_shadow);
+
+	light->map_version = light->version;
+	for (int i = 0; i < SHADOW_CASTER_NUM; i++)
+	{
+		light->map_caster_version[i] = shadow_caster_version[i];
+	}
+}
+
+// 只有深度的渲染目标，所有光源的阴影图按分辨率分配在同一个图集中
+static void create_shadow_atlas(device_t *device, int framebuffer_id)
+{
+	device_bind_framebuffer(device, framebuffer_id);
+	device_clear_framebuffer(device, framebuffer_id, 0);
+	device_unbind_framebuffer(device, framebuffer_id);
+}
+
+// 绘制所有光源的阴影图，图集和光源的区域在第一次绘制时分配
+static void draw_shadow_map(device_t *device, float alpha, float box_x, float box_y, float box_z)
+{
+	if (framebuffer_shadow == RENDER_NO_SET_FRAMEBUFFER_INDEX)
+	{
+		framebuffer_shadow = device_gen_depth_frame_buffer(device, SHADOW_ATLAS_SIZE, SHADOW_ATLAS_SIZE);
+		create_shadow_atlas(device, framebuffer_shadow);
+#ifdef SHADOW_MAP_PARTIAL_UPDATE
+		framebuffer_shadow_static = device_gen_depth_frame_buffer(device, SHADOW_ATLAS_SIZE, SHADOW_ATLAS_SIZE);
+		create_shadow_atlas(device, framebuffer_shadow_static);
+#endif
+
+		shadow_atlas_init(&shadow_atlas, SHADOW_ATLAS_SIZE);
+		for (int i = 0; i < SHADOW_LIGHT_NUM; i++)
+		{
+			shadow_lights[i].atlas_slot = shadow_atlas_alloc(&shadow_atlas, shadow_lights[i].map_size);
+		}
+	}
+
+	for (int i = 0; i < SHADOW_LIGHT_NUM; i++)
+	{
+		draw_light_shadow_map(device, &shadow_lights[i], alpha, box_x, box_y, box_z);
+	}
+
+	// 阴影图直接读取 framebuffer 的深度缓存
+	if (texture_shadow == 0)
+	{
+		texture_shadow = device_gen_texture(device);
+		device_set_framebuffer_texture(device, texture_shadow, framebuffer_shadow, FRAMEBUFFER_PLANE_DEPTH);
+	}
+}
+
+#ifdef BENCHMARK_RASTER_KERNEL
+// 各渲染模式下整屏绘制，比较通用扫描线和特化扫描线内核
+static void benchmark_raster_kernel(device_t *device)
+{
+	int states[] = { RENDER_STATE_TEXTURE, RENDER_STATE_COLOR, RENDER_STATE_LAMBERT_LIGHT_TEXTURE, RENDER_STATE_PHONG_LIGHT_TEXTURE, RENDER_STATE_BLINN_LIGHT_TEXTURE, RENDER_STATE_TEXTURE_ALPHA };
+	const char *names[] = { "texture", "color", "lambert", "phong", "blinn", "texture alpha" };
+	int render_state = device->render_state;
+
+	// 法线不经变换，光照着色器的片元都被照亮
+	matrix_set_identity(&(device->transform.world));
+	matrix_set_identity(&(device->transform.worldInv));
+
+	for (size_t i = 0; i < sizeof(states) / sizeof(states[0]); i++)
+	{
+		device->render_state = states[i];
+		setup_shader(device);
+		setup_shader_parma(device, g_mainCamera->get_eye());
+		device_clear(device, 1);
+		raster_kernel_benchmark(device, names[i], 20);
+	}
+
+	device_clear(device, 1);
+	device_set_color_write(device, false);
+	raster_kernel_benchmark(device, "depth only", 20);
+	device_set_color_write(device, true);
+
+	device->render_state = render_state;
+}
+#endif
+
+#if defined(TEXTURE_FETCH_STATS) || defined(BENCHMARK_SHADOW_PCF)
+// 基准测试一帧的绘制，frame 为帧序号
+typedef void (*benchmark_draw_func)(device_t *device, int frame);
+
+// 清屏后绘制 repeat 帧并等待光栅化完成，返回每帧的平均毫秒数
+// fetch_stats 非 NULL 时为每帧平均的纹素读取统计，只在定义 TEXTURE_FETCH_STATS 时统计
+static double benchmark_timed_frames(device_t *device, benchmark_draw_func draw, int repeat, texture_fetch_stats_t *fetch_stats)
+{
+	texture_fetch_stats_t total = { 0, 0 };
+	double milliseconds = 0.0;
+
+	// 每帧开始时清空模拟的缓存，未命中数即每帧读取的缓存行数
+	for (int k = 0; k < repeat; k++)
+	{
+		device_clear(device, 1);
+#ifdef TEXTURE_FETCH_STATS
+		texture_reset_fetch_stats();
+#endif
+		clock_t start = clock();
+		draw(device, k);
+		device_flush(device);
+		milliseconds += (double)(clock() - start) * 1000.0 / CLOCKS_PER_SEC;
+
+#ifdef TEXTURE_FETCH_STATS
+		texture_fetch_stats_t stats = texture_get_fetch_stats();
+		total.fetch_num += stats.fetch_num;
+		total.miss_num += stats.miss_num;
+#endif
+	}
+
+	if (fetch_stats)
+	{
+		fetch_stats->fetch_num = total.fetch_num / repeat;
+		fetch_stats->miss_num = total.miss_num / repeat;
+	}
+	return milliseconds / repeat;
+}
+#endif
+
+#if defined(TEXTURE_FETCH_STATS) || defined(BENCHMARK_SHADOW_PCF) || defined(BENCHMARK_OBJECT_CULLING)
+// 恢复主循环的光栅化线程数、渲染状态、视角和着色器参数
+static void benchmark_restore_main_view(device_t *device, int render_state, int thread_num)
+{
+	device_set_raster_thread_num(device, thread_num);
+	device->render_state = render_state;
+	g_mainCamera->makeup_view_matrix(&device->transform.view);
+	transform_update(&device->transform);
+	setup_shader(device);
+	setup_shader_parma(device, g_mainCamera->get_eye());
+}
+#endif
+
+#ifdef TEXTURE_FETCH_STATS
+// 单线程绘制纹理，纹素读取的统计不需要同步
+static void benchmark_begin_texture(device_t *device, int texture_id, int sampler_id)
+{
+	device_set_raster_thread_num(device, 1);
+	device->render_state = RENDER_STATE_TEXTURE;
+	setup_shader(device);
+	setup_shader_parma(device, g_mainCamera->get_eye());
+	device_bind_texture(device, 0, texture_id);
+	device_bind_sampler(device, 0, sampler_id);
+}
+#endif
+
+#if defined(BENCHMARK_TEXTURE_MIPMAP) || defined(BENCHMARK_TEXTURE_COMPRESSION)
+static void benchmark_draw_background(device_t *device, int frame)
+{
+	draw_backggroud(device);
+}
+#endif
+
+#ifdef BENCHMARK_TEXTURE_MIPMAP
+// 从远处斜看地面，纹理被大幅缩小，比较各 mip 过滤方式的耗时和读取的纹理缓存行数
+static void benchmark_texture_mipmap(device_t *device)
+{
+	const samplerstate_t states[] = {
+		{ SAMPLER_WRAP_CLAMP, SAMPLER_WRAP_CLAMP, SAMPLER_FILTER_NEAREST, SAMPLER_MIP_FILTER_NONE },
+		{ SAMPLER_WRAP_CLAMP, SAMPLER_WRAP_CLAMP, SAMPLER_FILTER_NEAREST, SAMPLER_MIP_FILTER_NEAREST },
+		{ SAMPLER_WRAP_CLAMP, SAMPLER_WRAP_CLAMP, SAMPLER_FILTER_BILINEAR, SAMPLER_MIP_FILTER_LINEAR },
+	};
+	const char *names[] = { "none", "nearest", "trilinear" };
+	const int repeat = 50;
+	int render_state = device->render_state;
+	int thread_num = device->raster_thread_num;
+	int texture_id = texture_bmp1 ? texture_bmp1 : default_texture_id;
+	int sampler_id = device_gen_sampler(device);
+	benchmark_begin_texture(device, texture_id, sampler_id);
+
+	vector_t eye = { 0, 1, 14, 1 }, at = { 0, -5, 0, 1 }, up = { 0, 1, 0, 1 };
+	CCamera::makeup_view_matrix(&(device->transform.view), eye, at, up);
+
+	for (size_t i = 0; i < sizeof(states) / sizeof(states[0]); i++)
+	{
+		device_set_sampler_state(device, sampler_id, states[i]);
+		texture_fetch_stats_t stats;
+		double milliseconds = benchmark_timed_frames(device, benchmark_draw_background, repeat, &stats);
+		printf("mip filter %s: %.2f ms, %lld texel fetches, %lld cache lines (%.1f KB) per frame\n", names[i], milliseconds,
+			stats.fetch_num, stats.miss_num, (double)stats.miss_num * 64.0 / 1024.0);
+	}
+
+	benchmark_restore_main_view(device, render_state, thread_num);
+}
+#endif
+
+#ifdef BENCHMARK_TEXTURE_LAYOUT
+static void benchmark_draw_rotating_box(device_t *device, int frame)
+{
+	draw_box(device, 0.05f * frame, 0.0f, 0.0f, 0.0f);
+}
+
+// 近处旋转的纹理盒子，纹素沿对角线读取，比较按行排列和 4x4 纹素块排列的耗时和读取的纹理缓存行数
+static void benchmark_texture_layout(device_t *device)
+{
+	long width = 0, height = 0;
+	unsigned int* bmp_texture = read_bmp("../res/1.bmp", width, height);
+	if (bmp_texture == NULL)
+	{
+		return;
+	}
+
+	const char *names[] = { "row pointer", "4x4 tiled" };
+	const int repeat = 60;
+	int render_state = device->render_state;
+	int thread_num = device->raster_thread_num;
+	int texture_id = device_gen_texture(device);
+	benchmark_begin_texture(device, texture_id, DEFAULT_SAMPLER_ID);
+
+	vector_t eye = { 1.5f, 1.5f, 1.5f, 1 }, at = { 0, 0, 0, 1 }, up = { 0, 0, 1, 1 };
+	CCamera::makeup_view_matrix(&(device->transform.view), eye, at, up);
+
+	for (int layout = TEXTURE_LAYOUT_LINEAR; layout <= TEXTURE_LAYOUT_TILED; layout++)
+	{
+		if (layout == TEXTURE_LAYOUT_LINEAR)
+		{
+			device_set_texture(device, bmp_texture, width * 4, width, height, texture_id);
+		}
+		else
+		{
+			device_upload_texture(device, bmp_texture, width * 4, width, height, texture_id);
+		}
+
+		texture_fetch_stats_t stats;
+		double milliseconds = benchmark_timed_frames(device, benchmark_draw_rotating_box, repeat, &stats);
+		printf("texture layout %s: %.2f ms, %lld texel fetches, %lld cache lines (%.1f KB) per frame\n", names[layout], milliseconds,
+			stats.fetch_num, stats.miss_num, (double)stats.miss_num * 64.0 / 1024.0);
+	}
+
+	// 最后一次上传已复制了数据
+	delete[] bmp_texture;
+	benchmark_restore_main_view(device, render_state, thread_num);
+}
+#endif
+
+#ifdef BENCHMARK_TEXTURE_COMPRESSION
+// 位图拼接为最大尺寸的纹理铺满地面，level 0 超出二级缓存，比较未压缩和 BC1 BC3 的耗时、内存和读取的纹理缓存行数
+static void benchmark_texture_compression(device_t *device)
+{
+	long width = 0, height = 0;
+	unsigned int* bmp_texture = read_bmp("../res/1.bmp", width, height);
+	if (bmp_texture == NULL)
+	{
+		return;
+	}
+
+	const int size = MAX_TEXTURE_SIZE;
+	IUINT32 *texels = new IUINT32[size * size];
+	for (int j = 0; j < size; j++)
+	{
+		for (int i = 0; i < size; i++)
+		{
+			texels[j * size + i] = bmp_texture[(j % height) * width + i % width];
+		}
+	}
+	delete[] bmp_texture;
+
+	const int formats[] = { TEXTURE_FORMAT_RGBA8, TEXTURE_FORMAT_BC1, TEXTURE_FORMAT_BC3 };
+	const char *names[] = { "rgba8", "bc1", "bc3" };
+	const samplerstate_t trilinear = { SAMPLER_WRAP_REPEAT, SAMPLER_WRAP_REPEAT, SAMPLER_FILTER_BILINEAR, SAMPLER_MIP_FILTER_LINEAR };
+	const int repeat = 30;
+	int render_state = device->render_state;
+	int thread_num = device->raster_thread_num;
+	int texture_id = device_gen_texture(device);
+	int sampler_id = device_gen_sampler(device);
+	device_set_sampler_state(device, sampler_id, trilinear);
+	benchmark_begin_texture(device, texture_id, sampler_id);
+
+	vector_t eye = { 0, -2, 4, 1 }, at = { 0, -5, 0, 1 }, up = { 0, 1, 0, 1 };
+	CCamera::makeup_view_matrix(&(device->transform.view), eye, at, up);
+
+	for (size_t i = 0; i < sizeof(formats) / sizeof(formats[0]); i++)
+	{
+		device_upload_texture_format(device, texels, size * 4, size, size, formats[i], texture_id);
+		device_generate_mipmap(device, texture_id);
+
+		const texture_t *texture = &device->texture_array[texture_id];
+		long bytes = 0;
+		for (int k = 0; k < texture->level_num; k++)
+		{
+			bytes += (long)texture->level[k].pitch * ((texture->level[k].height + TEXTURE_TILE_SIZE - 1) / TEXTURE_TILE_SIZE) * sizeof(IUINT32);
+		}
+
+		texture_fetch_stats_t stats;
+		double milliseconds = benchmark_timed_frames(device, benchmark_draw_background, repeat, &stats);
+		printf("texture format %s: %ld KB with mipmap, %.2f ms, %lld texel fetches, %lld cache lines (%.1f KB) per frame\n", names[i], bytes / 1024,
+			milliseconds, stats.fetch_num, stats.miss_num, (double)stats.miss_num * 64.0 / 1024.0);
+	}
+
+	// 上传时已复制了数据
+	delete[] texels;
+	benchmark_restore_main_view(device, render_state, thread_num);
+}
+#endif
+
+#ifdef BENCHMARK_SHADOW_PCF
+#define BENCHMARK_SHADOW_ALPHA -2.40f
+
+static void benchmark_draw_shadow_scene(device_t *device, int frame)
+{
+	draw_scene(device, BENCHMARK_SHADOW_ALPHA, 0.0f, 0.0f, 0.0f);
+}
+
+// 阴影图只绘制一次，比较主视角光照阴影在各过滤核下的耗时，阴影查找的开销为与 SAMPLER_PCF_NONE 的差
+static void benchmark_shadow_pcf(device_t *device)
+{
+	const int kernels[] = { SAMPLER_PCF_NONE, SAMPLER_PCF_2X2, SAMPLER_PCF_3X3, SAMPLER_PCF_5X5 };
+	const char *names[] = { "none", "2x2", "3x3", "5x5" };
+	const int repeat = 30;
+	int render_state = device->render_state;
+	samplerstate_t state = device->sampler_array[sampler_shadow].state;
+
+	device->render_state = RENDER_STATE_SHADOW_MAP;
+	draw_shadow_map(device, BENCHMARK_SHADOW_ALPHA, 0.0f, 0.0f, 0.0f);
+
+	// 与主循环初始的视角相同
+	vector_t eye = { 5, 5, 5, 1 }, at = { 0, 0, 0, 1 }, up = { 0, 0, 1, 1 };
+	CCamera::makeup_view_matrix(&(device->transform.view), eye, at, up);
+	transform_update(&device->transform);
+	setup_shader(device);
+	device_set_shader_state(device, SHADER_STATE_LIGHT_SHADOW);
+	setup_shader_parma(device, eye);
+
+	double baseline = 0.0;
+	for (size_t i = 0; i < sizeof(kernels) / sizeof(kernels[0]); i++)
+	{
+		samplerstate_t pcf = state;
+		pcf.pcf = kernels[i];
+		device_set_sampler_state(device, sampler_shadow, pcf);
+
+		double milliseconds = benchmark_timed_frames(device, benchmark_draw_shadow_scene, repeat, NULL);
+		if (i == 0)
+		{
+			baseline = milliseconds;
+		}
+		printf("shadow pcf %s: %.2f ms per frame, %.2f ms more than none\n", names[i], milliseconds, milliseconds - baseline);
+	}
+
+	device_set_sampler_state(device, sampler_shadow, state);
+	benchmark_restore_main_view(device, render_state, device->raster_thread_num);
+}
+#endif
+
+#ifdef BENCHMARK_VERTEX_SHADING
+// 顶点变换缓存大小的网格，只执行顶点着色，比较逐顶点调用和批量 SoA 着色（位置加全部顶点的属性）的耗时
+static void benchmark_vertex_shading(device_t *device)
+{
+	int states[] = { RENDER_STATE_TEXTURE, RENDER_STATE_BLINN_LIGHT_TEXTURE, RENDER_STATE_SHADOW_MAP };
+	const char *names[] = { "mvp", "blinn", "light shadow" };
+	const int repeat = 2000;
+	int render_state = device->render_state;
+	static vertex_t vertices[MAX_VERTEX_CACHE_NUM];
+	static point_t outputs[MAX_VERTEX_CACHE_NUM];
+	static vertex_t *vertex_ptrs[MAX_VERTEX_CACHE_NUM];
+	for (int i = 0; i < MAX_VERTEX_CACHE_NUM; i++)
+	{
+		vertices[i] = mesh[i % (sizeof(mesh) / sizeof(mesh[0]))];
+		vertex_ptrs[i] = &vertices[i];
+	}
+
+	get_box_world(&(device->transform.world), 1.0f, 0.0f, 0.0f, 0.0f);
+	transform_update(&device->transform);
+
+	for (size_t i = 0; i < sizeof(states) / sizeof(states[0]); i++)
+	{
+		device->render_state = states[i];
+		setup_shader(device);
+		if (states[i] == RENDER_STATE_SHADOW_MAP)
+		{
+			device_set_shader_state(device, SHADER_STATE_LIGHT_SHADOW);
+		}
+		setup_shader_parma(device, g_mainCamera->get_eye());
+		device_begin_draw(device);
+		func_vertex_shader p_shader = device->pipeline_state.vertex_shader;
+		func_vertex_shader_batch p_position = device->pipeline_state.vertex_position_shader;
+		func_vertex_attribute_shader p_attribute = device->pipeline_state.vertex_attribute_shader;
+
+		clock_t start = clock();
+		for (int k = 0; k < repeat; k++)
+		{
+			for (int v = 0; v < MAX_VERTEX_CACHE_NUM; v++)
+			{
+				p_shader(device, &vertices[v], &outputs[v]);
+			}
+		}
+		double single = (double)(clock() - start) * 1000.0 / CLOCKS_PER_SEC / repeat;
+
+		start = clock();
+		for (int k = 0; k < repeat; k++)
+		{
+			p_position(device, vertices, outputs, MAX_VERTEX_CACHE_NUM);
+			if (p_attribute)
+			{
+				p_attribute(device, vertex_ptrs, MAX_VERTEX_CACHE_NUM);
+			}
+		}
+		double batch = (double)(clock() - start) * 1000.0 / CLOCKS_PER_SEC / repeat;
+
+		printf("vertex shading %s: %d vertices, %.4f ms with one call per vertex, %.4f ms batched\n", names[i], MAX_VERTEX_CACHE_NUM, single, batch);
+	}
+
+	device->render_state = render_state;
+	setup_shader(device);
+	setup_shader_parma(device, g_mainCamera->get_eye());
+}
+#endif
+
+#ifdef BENCHMARK_OBJECT_CULLING
+// 视点周围随机摆放的盒子，视锥只占 1/6 左右的方向，大部分盒子在视锥之外
+// 比较视锥外的盒子提交绘制、逐个物体检查包围盒 8 个角和批量剔除的耗时
+#define BENCHMARK_CULL_BOX_NUM 10000
+static void benchmark_object_culling(device_t *device)
+{
+	const int repeat = 20;
+	int render_state = device->render_state;
+	static float boxes[BENCHMARK_CULL_BOX_NUM][4];	// 位置和旋转角
+	static unsigned char visible[BENCHMARK_CULL_BOX_NUM];
+	cull_list_t *list = cull_list_create(BENCHMARK_CULL_BOX_NUM);
+
+	vector_t box_min, box_max;
+	get_mesh_bounds(mesh, sizeof(mesh) / sizeof(mesh[0]), &box_min, &box_max);
+	cull_bounds_t bounds;
+	cull_bounds_from_box(&bounds, &box_min, &box_max);
+
+	srand(1);
+	for (int i = 0; i < BENCHMARK_CULL_BOX_NUM; i++)
+	{
+		for (int k = 0; k < 3; k++)
+		{
+			boxes[i][k] = (float)rand() / RAND_MAX * 200.0f - 100.0f;
+		}
+		boxes[i][3] = (float)rand() / RAND_MAX * 6.28f;
+	}
+
+	vector_t eye = { 0, 0, 0, 1 }, at = { 0, 0, 1, 1 }, up = { 0, 1, 0, 1 };
+	CCamera::makeup_view_matrix(&(device->transform.view), eye, at, up);
+	transform_update(&device->transform);
+	device->render_state = RENDER_STATE_TEXTURE;
+	setup_shader(device);
+	setup_shader_parma(device, eye);
+
+	matrix_t view_projection;
+	matrix_mul(&view_projection, &device->transform.view, &device->transform.projection);
+	cull_frustum_t frustum;
+	cull_frustum_init(&frustum, &view_projection);
+
+	// 逐个物体变换包围盒的 8 个角
+	int corner_visible_num = 0;
+	clock_t start = clock();
+	for (int k = 0; k < repeat; k++)
+	{
+		corner_visible_num = 0;
+		for (int i = 0; i < BENCHMARK_CULL_BOX_NUM; i++)
+		{
+			matrix_t world, transform;
+			vector_t ndc_min, ndc_max;
+			get_box_world(&world, boxes[i][3], boxes[i][0], boxes[i][1], boxes[i][2]);
+			matrix_mul(&transform, &world, &view_projection);
+			corner_visible_num += transform_check_box_cvv(&transform, &box_min, &box_max, &ndc_min, &ndc_max) == 0;
+		}
+	}
+	double corner = (double)(clock() - start) * 1000.0 / CLOCKS_PER_SEC / repeat;
+
+	// 包围体加入剔除列表后批量检查
+	int visible_num = 0;
+	start = clock();
+	for (int k = 0; k < repeat; k++)
+	{
+		cull_list_clear(list);
+		for (int i = 0; i < BENCHMARK_CULL_BOX_NUM; i++)
+		{
+			matrix_t world;
+			get_box_world(&world, boxes[i][3], boxes[i][0], boxes[i][1], boxes[i][2]);
+			cull_list_add(list, &bounds, &world);
+		}
+		visible_num = cull_list_test(list, &frustum, visible);
+	}
+	double batch = (double)(clock() - start) * 1000.0 / CLOCKS_PER_SEC / repeat;
+
+	// 不剔除时视锥外的盒子仍要执行顶点着色和逐三角形剔除，这部分耗时即物体级剔除省下的时间
+	double draw_outside = 0.0;
+	double draw_visible = 0.0;
+	for (int k = 0; k < repeat; k++)
+	{
+		device_clear(device, 1);
+		for (int pass = 0; pass < 2; pass++)
+		{
+			start = clock();
+			for (int i = 0; i < BENCHMARK_CULL_BOX_NUM; i++)
+			{
+				if (visible[i] == pass)
+				{
+					draw_box(device, boxes[i][3], boxes[i][0], boxes[i][1], boxes[i][2]);
+				}
+			}
+			device_flush(device);
+			double milliseconds = (double)(clock() - start) * 1000.0 / CLOCKS_PER_SEC;
+			if (pass == 0) draw_outside += milliseconds;
+			else draw_visible += milliseconds;
+		}
+	}
+	draw_outside /= repeat;
+	draw_visible /= repeat;
+
+	printf("object culling: %d boxes, %d visible by batch test, %d by corner test\n", BENCHMARK_CULL_BOX_NUM, visible_num, corner_visible_num);
+	printf("object culling: %.2f ms drawing visible boxes, %.2f ms submitting boxes outside the frustum, %.3f ms batch test, %.3f ms corner test\n",
+		draw_visible, draw_outside, batch, corner);
+
+	cull_list_destroy(list);
+	benchmark_restore_main_view(device, render_state, device->raster_thread_num);
+}
+#endif
+
 int main(void)
 {
 	int states[] = { RENDER_STATE_WIREFRAME, RENDER_STATE_TEXTURE, RENDER_STATE_COLOR, RENDER_STATE_LAMBERT_LIGHT_TEXTURE, RENDER_STATE_PHONG_LIGHT_TEXTURE, RENDER_STATE_TEXTURE_ALPHA, RENDER_STATE_SHADOW_MAP, RENDER_STATE_BLINN_LIGHT_TEXTURE };
@@ -698,6 +1484,34 @@ int main(void)
 	
 	init_texture(device);
 
+#ifdef BENCHMARK_RASTER_KERNEL
+	benchmark_raster_kernel(device);
+#endif
+
+#ifdef BENCHMARK_TEXTURE_MIPMAP
+	benchmark_texture_mipmap(device);
+#endif
+
+#ifdef BENCHMARK_TEXTURE_LAYOUT
+	benchmark_texture_layout(device);
+#endif
+
+#ifdef BENCHMARK_TEXTURE_COMPRESSION
+	benchmark_texture_compression(device);
+#endif
+
+#ifdef BENCHMARK_SHADOW_PCF
+	benchmark_shadow_pcf(device);
+#endif
+
+#ifdef BENCHMARK_VERTEX_SHADING
+	benchmark_vertex_shading(device);
+#endif
+
+#ifdef BENCHMARK_OBJECT_CULLING
+	benchmark_object_culling(device);
+#endif
+
 	clock_t start = clock();
 	int iFrame = 0;
 
@@ -706,16 +1520,23 @@ int main(void)
 #ifdef USE_GDI_VIEW
 		screen_dispatch();
 #endif		
+		vector_t light_direction = shadow_lights[0].direction;
+		float box_alpha = alpha;
+
 		if (get_key_state(MOVE_NEAR)) pos -= 0.01f;
 		if (get_key_state(MOVE_FAR)) pos += 0.01f;
 		if (get_key_state(ROTATE_LEFT)) alpha += 0.01f;
 		if (get_key_state(ROTATE_RIGHT)) alpha -= 0.01f;
-		if (get_key_state(MOVE_SHADOW_LIGHT_A)) shadow_light_direction.x -= 0.01f;
-		if (get_key_state(MOVE_SHADOW_LIGHT_D)) shadow_light_direction.x += 0.01f;
-		if (get_key_state(MOVE_SHADOW_LIGHT_W)) shadow_light_direction.z += 0.01f;
-		if (get_key_state(MOVE_SHADOW_LIGHT_S)) shadow_light_direction.z -= 0.01f;
-		if (get_key_state(MOVE_SHADOW_LIGHT_F)) shadow_light_direction.y += 0.01f;
-		if (get_key_state(MOVE_SHADOW_LIGHT_N)) shadow_light_direction.y -= 0.01f;
+		if (get_key_state(MOVE_SHADOW_LIGHT_A)) shadow_lights[0].direction.x -= 0.01f;
+		if (get_key_state(MOVE_SHADOW_LIGHT_D)) shadow_lights[0].direction.x += 0.01f;
+		if (get_key_state(MOVE_SHADOW_LIGHT_W)) shadow_lights[0].direction.z += 0.01f;
+		if (get_key_state(MOVE_SHADOW_LIGHT_S)) shadow_lights[0].direction.z -= 0.01f;
+		if (get_key_state(MOVE_SHADOW_LIGHT_F)) shadow_lights[0].direction.y += 0.01f;
+		if (get_key_state(MOVE_SHADOW_LIGHT_N)) shadow_lights[0].direction.y -= 0.01f;
+
+		// 光源或盒子改变时增加版本，阴影图据此判断是否需要重新绘制
+		if (memcmp(&light_direction, &shadow_lights[0].direction, sizeof(vector_t)) != 0) shadow_lights[0].version++;
+		if (box_alpha != alpha) shadow_caster_version[SHADOW_CASTER_BOX]++;
 
 		vector_t eye = { pos, pos, pos, 1 };
 		g_mainCamera->set_eye(eye);
@@ -734,45 +1555,7 @@ int main(void)
 		// 绘制shadowmap
 		if (device->render_state == RENDER_STATE_SHADOW_MAP)
 		{
-			if (framebuffer_shadow == 0)
-			{
-				framebuffer_shadow = device_gen_frame_buffer(device);
-			}
-
-			device_bind_framebuffer(device, framebuffer_shadow);
-
-			device->background = 0;
-			device_clear_framebuffer(device, framebuffer_shadow, 0);			
-			
-			vector_t eye = { shadow_light_direction.x, shadow_light_direction.y, shadow_light_direction.z, 1 }, at = { 0, 0, 0, 1 }, up = { 0, 0, 1, 1 };
-			CCamera::makeup_view_matrix(&(device->transform.view), eye, at, up);
-
-			setup_shader(device);
-			setup_shader_parma(device, eye);
-			
-			draw_backggroud(device);
-			shadow_light_transform_panel = device->transform.transform; // 获取平面的光源变换矩阵
-			draw_box(device, alpha, box_x, box_y, box_z);
-			shadow_light_transform_box = device->transform.transform; // 获取BOX的光源变换矩阵
-
-			if (NULL == shadow_texture)
-			{
-				shadow_texture = new IUINT32*[MAX_FRAME_BUFFER_HEIGHT];
-				shadow_texture_buffer = new IUINT32[MAX_FRAME_BUFFER_HEIGHT * MAX_FRAME_BUFFER_WIDTH];
-				for (int i = 0; i < MAX_FRAME_BUFFER_HEIGHT; i++)
-				{
-					shadow_texture[i] = shadow_texture_buffer + MAX_FRAME_BUFFER_WIDTH * i;
-				}
-			}
-
-			device_copy_framebuffer(device, framebuffer_shadow, shadow_texture); // 获取shadowmap
-			device_unbind_framebuffer(device, framebuffer_shadow);
-
-			if (texture_shadow == 0)
-			{
-				texture_shadow = device_gen_texture(device);
-			}
-			device_set_texture(device, shadow_texture_buffer, MAX_FRAME_BUFFER_WIDTH * 4, device->framebuffer_width, device->framebuffer_height, texture_shadow);
+			draw_shadow_map(device, alpha, box_x, box_y, box_z);
 		}
 
 		device_clear(device, 1);
@@ -787,13 +1570,28 @@ int main(void)
 			device_set_shader_state(device, SHADER_STATE_LIGHT_SHADOW);
 		}
 		setup_shader_parma(device, g_mainCamera->get_eye());
-		if (device->render_state == RENDER_STATE_SHADOW_MAP)
+
+		// 深度预渲染，线框和半透明模式不适用
+		if ((device->function_state & FUNC_STATE_DEPTH_PREPASS) && device->render_state != RENDER_STATE_WIREFRAME && device->render_state != RENDER_STATE_TEXTURE_ALPHA)
 		{
-			device_set_uniform_matrix_value(device, 0, &shadow_light_transform_panel);
-			draw_backggroud(device);
-			device_set_uniform_matrix_value(device, 0, &shadow_light_transform_box);
+			// 第一遍只写深度
+			device_set_color_write(device, false);
+			draw_scene(device, alpha, box_x, box_y, box_z);
+
+			// 第二遍只对深度相等的片元着色
+			device_set_color_write(device, true);
+			device_set_depth_func(device, DEPTH_FUNC_EQUAL);
+			device_set_depth_write(device, false);
+			draw_scene(device, alpha, box_x, box_y, box_z);
+
+			device_set_depth_func(device, DEPTH_FUNC_GEQUAL);
+			device_set_depth_write(device, true);
 		}
-		draw_box(device, alpha, box_x, box_y, box_z);
+		else
+		{
+			draw_scene(device, alpha, box_x, box_y, box_z);
+		}
+		device_end_frame(device);
 
 #ifdef USE_GDI_VIEW
 		draw_screen_title(device);
@@ -810,6 +1608,19 @@ int main(void)
 		if ((end - start) / CLOCKS_PER_SEC >= 1)
 		{
 			/*printf("Frame Rate is %d\n", iFrame);*/
+#ifdef SHOW_RENDER_STATS
+			float seconds = (float)(end - start) / CLOCKS_PER_SEC;
+			printf("Frame Rate is %d, %.2f Mpixel/s covered, %.2f Mpixel/s shaded, %u triangles, %u vertices shaded, %u vertex attributes shaded\n", iFrame,
+				device->raster_stats.covered_pixel_num / seconds / 1000000.0f,
+				device->raster_stats.shaded_pixel_num / seconds / 1000000.0f,
+				device->raster_stats.triangle_num, device->raster_stats.vertex_shader_num, device->raster_stats.vertex_attribute_num);
+			printf("Last frame %u pixels shaded, %u pixels covered, %u helper pixels\n", device->frame_stats.shaded_pixel_num, device->frame_stats.covered_pixel_num, device->frame_stats.helper_pixel_num);
+			printf("Hi-Z triangle %u/%u rejected, block %u/%u rejected, %u accepted\n",
+				device->raster_stats.hiz_triangle_reject_num, device->raster_stats.hiz_triangle_test_num,
+				device->raster_stats.hiz_block_reject_num, device->raster_stats.hiz_block_test_num,
+				device->raster_stats.hiz_block_accept_num);
+#endif
+			device_reset_raster_stats(device);
 			start = end;
 			iFrame = 0;
 		}
@@ -0,0 +1,246 @@
+#include <stdio.h>
+#include <string.h>
+#include <math.h>
+
+#include "raster.h"
+#include "renderstate.h"
+#include "blend.h"
+#include "hiz.h"
+
+bool raster_depth_test(int depth_func, float rhw, float depth)
+{
+	int result = rhw < depth ? DEPTH_FUNC_LESS : (rhw > depth ? DEPTH_FUNC_GREATER : (rhw == depth ? DEPTH_FUNC_EQUAL : 0));
+	return (depth_func & result) != 0;
+}
+
+bool device_write_pixel(device_t *device, IUINT32 *framebuffer, float *zbuffer, int x, float rhw, IUINT32 color)
+{
+	bool depth_write = device->pipeline_state.depth_write;
+#ifdef USE_GDI_VIEW
+	framebuffer[x] = color;
+	if (depth_write) zbuffer[x] = rhw;
+	return depth_write;
+#else
+	if (is_opaque_pixel_color(color))
+	{
+		framebuffer[x] = color;
+		if (depth_write) zbuffer[x] = rhw;
+		return depth_write;
+	}
+	else {
+		framebuffer[x] = blend_frame_buffer_color(device, color, framebuffer[x]);
+		return false;
+	}
+#endif
+}
+
+void device_draw_scanline(device_t *device, scanline_t *scanline, raster_region_t *region) {
+	device->pipeline_state.scanline_kernel(device, scanline, region);
+}
+
+// 绘制扫描线
+void device_draw_scanline_generic(device_t *device, scanline_t *scanline, raster_region_t *region) {
+	const pipeline_state_t *pso = &device->pipeline_state;
+	IUINT32 *framebuffer = pso->framebuffer[scanline->y];
+	float *zbuffer = pso->zbuffer[scanline->y];
+	func_pixel_shader p_shader = pso->pixel_shader;
+	bool depth_only = !pso->color_write;
+	const varying_layout_t *layout = &pso->varying_layout;
+
+	// 着色器只读取声明过的属性，其余属性不插值
+	vertex_t v;
+	memset(&v, 0, sizeof(vertex_t));
+
+	int x = scanline->x;
+	int w = scanline->w;
+	int x0 = region->clip.x0;
+	int x1 = region->clip.x1;
+	int write_x0 = x1, write_x1 = x0;	// 写入深度的范围，用于更新层次深度
+
+	// clip 左侧的像素只步进属性，右侧的像素直接截掉
+	for (; w > 0 && x < x0; x++, w--) {
+		varying_add(layout, &scanline->v, &scanline->step);
+	}
+	if (w > x1 - x) w = x1 - x;
+
+	for (; w > 0; x++, w--) {
+		float rhw = scanline->v.f[VARYING_RHW_INDEX];
+		region->stats.covered_pixel_num++;
+		if (raster_depth_test(pso->depth_func, rhw, zbuffer[x])) {
+			if (depth_only)
+			{
+				if (pso->depth_write)
+				{
+					zbuffer[x] = rhw;
+					if (x < write_x0) write_x0 = x;
+					write_x1 = x + 1;
+				}
+			}
+			else if (p_shader)
+			{
+				varying_unpack(layout, &v, &scanline->v);
+				IUINT32 color = p_shader(device, &v);
+				if (device_write_pixel(device, framebuffer, zbuffer, x, rhw, color))
+				{
+					if (x < write_x0) write_x0 = x;
+					write_x1 = x + 1;
+				}
+				region->stats.shaded_pixel_num++;
+			}
+		}
+		varying_add(layout, &scanline->v, &scanline->step);
+	}
+
+	hiz_mark_dirty(pso->hiz, scanline->y, write_x0, write_x1);
+}
+
+void raster_scissor_scanline(const varying_layout_t *layout, scanline_t *scanline, const rect_t *scissor)
+{
+	int skip = scissor->x0 - scanline->x;
+	if (skip > 0)
+	{
+		if (skip > scanline->w) skip = scanline->w;
+		varying_add_scaled(layout, &scanline->v, &scanline->step, (float)skip);
+		scanline->x += skip;
+		scanline->w -= skip;
+	}
+
+	int right = scissor->x1 - scanline->x;
+	if (scanline->w > right) scanline->w = right > 0 ? right : 0;
+}
+
+// 主渲染函数
+void device_render_trap(device_t *device, trapezoid_t *trap, raster_region_t *region) {
+	const varying_layout_t *layout = &device->pipeline_state.varying_layout;
+	func_scanline_kernel scanline_kernel = device->pipeline_state.scanline_kernel;
+	scanline_t scanline;
+	int j, top, bottom;
+	top = (int)(trap->top + 0.5f);
+	bottom = (int)(trap->bottom + 0.5f);
+
+	// 视口上方和下方的行直接跳过，从视口内的第一行开始步进
+	if (top < region->scissor.y0) top = region->scissor.y0;
+	if (bottom > region->scissor.y1) bottom = region->scissor.y1;
+	if (top >= bottom)
+	{
+		return;
+	}
+
+	// 边的端点和步长只保留片元着色器需要的属性
+	varying_t v1, v2;
+	float left_height = trap->left.v2.pos.y - trap->left.v1.pos.y;
+	varying_t left_step;
+	varying_pack(layout, &v1, &trap->left.v1);
+	varying_pack(layout, &v2, &trap->left.v2);
+	varying_division(layout, &left_step, &v1, &v2, left_height);
+
+	float right_height = trap->right.v2.pos.y - trap->right.v1.pos.y;
+	varying_t right_step;
+	varying_pack(layout, &v1, &trap->right.v1);
+	varying_pack(layout, &v2, &trap->right.v2);
+	varying_division(layout, &right_step, &v1, &v2, right_height);
+
+	trapezoid_edge_interp(trap, (float)top + 0.5f);
+	varying_t left, right;
+	varying_pack(layout, &left, &trap->left.v);
+	varying_pack(layout, &right, &trap->right.v);
+
+	// 分块时只绘制块内的行，但边的步进仍从视口内的第一行开始，保证与整屏绘制的插值结果一致
+	for (j = top; j < bottom; j++) {
+		if (j >= region->clip.y0 && j < region->clip.y1) {
+			//trapezoid_edge_interp(trap, (float)j + 0.5f);
+			trapezoid_init_scan_line(layout, &left, &right, &scanline, j);
+			raster_scissor_scanline(layout, &scanline, &region->scissor);
+			scanline_kernel(device, &scanline, region);
+		}
+		if (j >= region->clip.y1) break;
+
+		varying_add(layout, &left, &left_step);
+		varying_add(layout, &right, &right_step);
+	}
+}
+
+bool raster_triangle_bounds(const vertex_t *t1, const vertex_t *t2, const vertex_t *t3, const rect_t *clip, rect_t *bounds)
+{
+	// 向外扩一个像素，保证覆盖扫描线取整后的所有像素
+	float min_x = fminf(t1->pos.x, fminf(t2->pos.x, t3->pos.x)) - 1.0f;
+	float max_x = fmaxf(t1->pos.x, fmaxf(t2->pos.x, t3->pos.x)) + 1.0f;
+	float min_y = fminf(t1->pos.y, fminf(t2->pos.y, t3->pos.y)) - 1.0f;
+	float max_y = fmaxf(t1->pos.y, fmaxf(t2->pos.y, t3->pos.y)) + 1.0f;
+
+	min_x = fmaxf(min_x, (float)clip->x0);
+	min_y = fmaxf(min_y, (float)clip->y0);
+	max_x = fminf(max_x, (float)(clip->x1 - 1));
+	max_y = fminf(max_y, (float)(clip->y1 - 1));
+	if (!(min_x <= max_x && min_y <= max_y))
+	{
+		return false;
+	}
+
+	bounds->x0 = (int)min_x;
+	bounds->y0 = (int)min_y;
+	bounds->x1 = (int)max_x + 1;
+	bounds->y1 = (int)max_y + 1;
+	return true;
+}
+
+void device_render_triangle(device_t *device, const vertex_t *t1, const vertex_t *t2, const vertex_t *t3, raster_region_t *region)
+{
+	// 三角形最近的深度比包围盒内已写入的最远深度还远时，整个三角形都无法通过深度测试
+	if (device->pipeline_state.hiz_reject)
+	{
+		rect_t bounds;
+		if (!raster_triangle_bounds(t1, t2, t3, &region->clip, &bounds))
+		{
+			return;
+		}
+
+		float max_rhw = fmaxf(t1->rhw, fmaxf(t2->rhw, t3->rhw));
+		region->stats.hiz_triangle_test_num++;
+		if (hiz_test_occluded(device->pipeline_state.hiz, bounds.x0, bounds.y0, bounds.x1, bounds.y1, max_rhw))
+		{
+			region->stats.hiz_triangle_reject_num++;
+			return;
+		}
+	}
+
+	// 梯形扫描线一次只处理一行，需要 2x2 像素块着色时改用边函数光栅化
+	if (device->raster_algorithm == RASTER_ALGORITHM_HALFSPACE || device->pipeline_state.quad_shading)
+	{
+		device_render_triangle_halfspace(device, t1, t2, t3, region);
+		return;
+	}
+
+	trapezoid_t traps[2];
+
+	// 拆分三角形为0-2个梯形，并且返回可用梯形数量
+	int n = trapezoid_init_triangle(traps, t1, t2, t3);
+
+	if (n >= 1) device_render_trap(device, &traps[0], region);
+	if (n >= 2) device_render_trap(device, &traps[1], region);
+}
+
+void device_init_raster_region(const device_t *device, raster_region_t *region)
+{
+	region->clip.x0 = device->viewport_x;
+	region->clip.y0 = device->viewport_y;
+	region->clip.x1 = device->viewport_x + device->viewport_width;
+	region->clip.y1 = device->viewport_y + device->viewport_height;
+	region->scissor = region->clip;
+	memset(&region->stats, 0, sizeof(raster_stats_t));
+}
+
+void raster_stats_add(raster_stats_t *dst, const raster_stats_t *src)
+{
+	dst->vertex_shader_num += src->vertex_shader_num;
+	dst->vertex_attribute_num += src->vertex_attribute_num;
+	dst->triangle_num += src->triangle_num;
+	dst->covered_pixel_num += src->covered_pixel_num;
+	dst->shaded_pixel_num += src->shaded_pixel_num;
+	dst->helper_pixel_num += src->helper_pixel_num;
+	dst->hiz_triangle_test_num += src->hiz_triangle_test_num;
+	dst->hiz_triangle_reject_num += src->hiz_triangle_reject_num;
+	dst->hiz_block_test_num += src->hiz_block_test_num;
+	dst->hiz_block_reject_num += src->hiz_block_reject_num;
+	dst->hiz_block_accept_num += src->hiz_block_accept_num;
+}
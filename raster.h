@@ -0,0 +1,50 @@
+#pragma once
+
+#include "device.h"
+#include "geometry.h"
+
+//=====================================================================
+// 光栅化：梯形扫描线 / 边函数
+//=====================================================================
+
+// 裁剪矩形 [x0, x1) x [y0, y1)
+typedef struct { int x0, y0, x1, y1; } rect_t;
+
+// 光栅化区域：裁剪矩形及区域内的统计，每个线程各自持有
+struct raster_region_t {
+	rect_t clip;
+	rect_t scissor;	// 视口，三角形在视口外的行和像素直接跳过，不逐个步进属性
+	raster_stats_t stats;
+};
+
+// 绘制扫描线，只写入 clip 范围内的像素，使用管线状态选出的扫描线内核
+void device_draw_scanline(device_t *device, scanline_t *scanline, raster_region_t *region);
+
+// 扫描线在视口左侧的像素按步长一次跳过，右侧的像素直接截掉
+void raster_scissor_scanline(const varying_layout_t *layout, scanline_t *scanline, const rect_t *scissor);
+
+// 绘制梯形，只写入 clip 范围内的像素
+void device_render_trap(device_t *device, trapezoid_t *trap, raster_region_t *region);
+
+// 边函数光栅化，按 8x8 块判断完全覆盖/完全在外/部分覆盖，部分覆盖的块用 SIMD 一次判断多个像素
+void device_render_triangle_halfspace(device_t *device, const vertex_t *t1, const vertex_t *t2, const vertex_t *t3, raster_region_t *region);
+
+// 三角形在 clip 内的整数包围盒 [x0, x1) x [y0, y1)，不相交时返回 false
+bool raster_triangle_bounds(const vertex_t *t1, const vertex_t *t2, const vertex_t *t3, const rect_t *clip, rect_t *bounds);
+
+// 按 device->raster_algorithm 光栅化三角形，开启层次深度时先整体剔除被遮挡的三角形，顶点需已经过 vertex_rhw_init
+void device_render_triangle(device_t *device, const vertex_t *t1, const vertex_t *t2, const vertex_t *t3, raster_region_t *region);
+
+// 按深度比较函数比较片元与深度缓存中的 rhw
+bool raster_depth_test(int depth_func, float rhw, float depth);
+
+// 通用的扫描线绘制，每个像素按管线状态判断深度比较、混合和目标格式，没有特化内核的状态使用
+void device_draw_scanline_generic(device_t *device, scanline_t *scanline, raster_region_t *region);
+
+// 写入已通过深度测试的片元颜色，半透明颜色与 framebuffer 混合，返回是否写入了深度
+bool device_write_pixel(device_t *device, IUINT32 *framebuffer, float *zbuffer, int x, float rhw, IUINT32 color);
+
+// 以视口为裁剪矩形初始化光栅化区域
+void device_init_raster_region(const device_t *device, raster_region_t *region);
+
+void raster_stats_add(raster_stats_t *dst, const raster_stats_t *src);
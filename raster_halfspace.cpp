@@ -0,0 +1,477 @@
+#include <stdio.h>
+#include <string.h>
+#include <math.h>
+#include <emmintrin.h>
+#ifdef __AVX__
+#include <immintrin.h>
+#endif
+
+#include "raster.h"
+#include "hiz.h"
+
+//=====================================================================
+// 边函数光栅化
+//=====================================================================
+
+#define HALFSPACE_BLOCK_SIZE 8
+#define HALFSPACE_RHW_INDEX VARYING_RHW_INDEX
+
+// 三角形设置：坐标都相对于第一个顶点，减小大坐标下的精度损失
+typedef struct {
+	float ox, oy;
+	float edge_a[4];	// E(x, y) = a * x + b * y + c，第 4 个通道恒为正
+	float edge_b[4];
+	float edge_c[4];
+	float top_left[4];	// 上边或左边，E == 0 时也算覆盖
+	float attr_c[MAX_VARYING_NUM];
+	float attr_dx[MAX_VARYING_NUM];
+	float attr_dy[MAX_VARYING_NUM];
+} halfspace_triangle_t;
+
+static const float halfspace_lane_offset[8] = { 0.0f, 1.0f, 2.0f, 3.0f, 4.0f, 5.0f, 6.0f, 7.0f };
+
+static int halfspace_bit_count(int mask)
+{
+	int n = 0;
+	for (; mask; mask &= mask - 1) n++;
+	return n;
+}
+
+static bool halfspace_setup(halfspace_triangle_t *tri, const varying_layout_t *layout, const vertex_t *t1, const vertex_t *t2, const vertex_t *t3)
+{
+	const vertex_t *p[3] = { t1, t2, t3 };
+
+	float area = (t2->pos.x - t1->pos.x) * (t3->pos.y - t1->pos.y) - (t3->pos.x - t1->pos.x) * (t2->pos.y - t1->pos.y);
+	if (!(fabsf(area) > 0.0f))
+	{
+		return false;
+	}
+
+	// 统一为正面积的绕序
+	if (area < 0.0f)
+	{
+		p[1] = t3;
+		p[2] = t2;
+		area = -area;
+	}
+
+	tri->ox = p[0]->pos.x;
+	tri->oy = p[0]->pos.y;
+
+	// 第 i 条边与第 i 个顶点相对，E_i / area 即第 i 个顶点的重心坐标
+	for (int i = 0; i < 3; i++)
+	{
+		const vertex_t *a = p[(i + 1) % 3];
+		const vertex_t *b = p[(i + 2) % 3];
+		float A = a->pos.y - b->pos.y;
+		float B = b->pos.x - a->pos.x;
+		tri->edge_a[i] = A;
+		tri->edge_b[i] = B;
+		tri->edge_c[i] = A * (tri->ox - a->pos.x) + B * (tri->oy - a->pos.y);
+		tri->top_left[i] = (A > 0.0f || (A == 0.0f && B > 0.0f)) ? 1.0f : 0.0f;
+	}
+	tri->edge_a[3] = 0.0f;
+	tri->edge_b[3] = 0.0f;
+	tri->edge_c[3] = 1.0f;
+	tri->top_left[3] = 1.0f;
+
+	// 属性平面 f = f0 + (f1 - f0) * l1 + (f2 - f0) * l2
+	// 只为片元着色器需要的属性建立平面
+	varying_t f0, f1, f2;
+	varying_pack(layout, &f0, p[0]);
+	varying_pack(layout, &f1, p[1]);
+	varying_pack(layout, &f2, p[2]);
+
+	float inv_area = 1.0f / area;
+	__m128 a1 = _mm_set1_ps(tri->edge_a[1] * inv_area);
+	__m128 a2 = _mm_set1_ps(tri->edge_a[2] * inv_area);
+	__m128 b1 = _mm_set1_ps(tri->edge_b[1] * inv_area);
+	__m128 b2 = _mm_set1_ps(tri->edge_b[2] * inv_area);
+	for (int k = 0; k < layout->stride; k += 4)
+	{
+		__m128 v0 = _mm_loadu_ps(&f0.f[k]);
+		__m128 d1 = _mm_sub_ps(_mm_loadu_ps(&f1.f[k]), v0);
+		__m128 d2 = _mm_sub_ps(_mm_loadu_ps(&f2.f[k]), v0);
+		_mm_storeu_ps(&tri->attr_c[k], v0);
+		_mm_storeu_ps(&tri->attr_dx[k], _mm_add_ps(_mm_mul_ps(d1, a1), _mm_mul_ps(d2, a2)));
+		_mm_storeu_ps(&tri->attr_dy[k], _mm_add_ps(_mm_mul_ps(d1, b1), _mm_mul_ps(d2, b2)));
+	}
+
+	return true;
+}
+
+// 一行 8 个像素的覆盖掩码，fx/fy 为第一个像素中心相对原点的坐标
+static int halfspace_row_coverage(const halfspace_triangle_t *tri, float fx, float fy)
+{
+	int mask = 0xFF;
+#ifdef __AVX__
+	__m256 lane = _mm256_loadu_ps(halfspace_lane_offset);
+	__m256 zero = _mm256_setzero_ps();
+	for (int i = 0; i < 3; i++)
+	{
+		__m256 e = _mm256_set1_ps(tri->edge_a[i] * fx + tri->edge_b[i] * fy + tri->edge_c[i]);
+		e = _mm256_add_ps(e, _mm256_mul_ps(lane, _mm256_set1_ps(tri->edge_a[i])));
+		__m256 inside = _mm256_cmp_ps(e, zero, _CMP_GT_OQ);
+		if (tri->top_left[i] != 0.0f)
+		{
+			inside = _mm256_or_ps(inside, _mm256_cmp_ps(e, zero, _CMP_EQ_OQ));
+		}
+		mask &= _mm256_movemask_ps(inside);
+	}
+#else
+	__m128 lane0 = _mm_loadu_ps(halfspace_lane_offset);
+	__m128 lane1 = _mm_loadu_ps(halfspace_lane_offset + 4);
+	__m128 zero = _mm_setzero_ps();
+	for (int i = 0; i < 3; i++)
+	{
+		__m128 a = _mm_set1_ps(tri->edge_a[i]);
+		__m128 e = _mm_set1_ps(tri->edge_a[i] * fx + tri->edge_b[i] * fy + tri->edge_c[i]);
+		__m128 e0 = _mm_add_ps(e, _mm_mul_ps(lane0, a));
+		__m128 e1 = _mm_add_ps(e, _mm_mul_ps(lane1, a));
+		__m128 inside0 = _mm_cmpgt_ps(e0, zero);
+		__m128 inside1 = _mm_cmpgt_ps(e1, zero);
+		if (tri->top_left[i] != 0.0f)
+		{
+			inside0 = _mm_or_ps(inside0, _mm_cmpeq_ps(e0, zero));
+			inside1 = _mm_or_ps(inside1, _mm_cmpeq_ps(e1, zero));
+		}
+		mask &= _mm_movemask_ps(inside0) | (_mm_movemask_ps(inside1) << 4);
+	}
+#endif
+	return mask;
+}
+
+// 一行 8 个像素的深度测试掩码，同时输出每个像素的 rhw；zbuffer 为 NULL 时不比较，全部通过
+static int halfspace_row_depth(const halfspace_triangle_t *tri, int depth_func, const float *zbuffer, float fx, float fy, float *rhw)
+{
+	float rhw_dx = tri->attr_dx[HALFSPACE_RHW_INDEX];
+	float base = tri->attr_c[HALFSPACE_RHW_INDEX] + rhw_dx * fx + tri->attr_dy[HALFSPACE_RHW_INDEX] * fy;
+	int mask = 0;
+#ifdef __AVX__
+	__m256 r = _mm256_add_ps(_mm256_set1_ps(base), _mm256_mul_ps(_mm256_loadu_ps(halfspace_lane_offset), _mm256_set1_ps(rhw_dx)));
+	_mm256_storeu_ps(rhw, r);
+	if (zbuffer == NULL) return 0xFF;
+	__m256 z = _mm256_loadu_ps(zbuffer);
+	if (depth_func & DEPTH_FUNC_LESS) mask |= _mm256_movemask_ps(_mm256_cmp_ps(r, z, _CMP_LT_OQ));
+	if (depth_func & DEPTH_FUNC_EQUAL) mask |= _mm256_movemask_ps(_mm256_cmp_ps(r, z, _CMP_EQ_OQ));
+	if (depth_func & DEPTH_FUNC_GREATER) mask |= _mm256_movemask_ps(_mm256_cmp_ps(r, z, _CMP_GT_OQ));
+#else
+	__m128 r0 = _mm_add_ps(_mm_set1_ps(base), _mm_mul_ps(_mm_loadu_ps(halfspace_lane_offset), _mm_set1_ps(rhw_dx)));
+	__m128 r1 = _mm_add_ps(_mm_set1_ps(base), _mm_mul_ps(_mm_loadu_ps(halfspace_lane_offset + 4), _mm_set1_ps(rhw_dx)));
+	_mm_storeu_ps(rhw, r0);
+	_mm_storeu_ps(rhw + 4, r1);
+	if (zbuffer == NULL) return 0xFF;
+	__m128 z0 = _mm_loadu_ps(zbuffer);
+	__m128 z1 = _mm_loadu_ps(zbuffer + 4);
+	if (depth_func & DEPTH_FUNC_LESS) mask |= _mm_movemask_ps(_mm_cmplt_ps(r0, z0)) | (_mm_movemask_ps(_mm_cmplt_ps(r1, z1)) << 4);
+	if (depth_func & DEPTH_FUNC_EQUAL) mask |= _mm_movemask_ps(_mm_cmpeq_ps(r0, z0)) | (_mm_movemask_ps(_mm_cmpeq_ps(r1, z1)) << 4);
+	if (depth_func & DEPTH_FUNC_GREATER) mask |= _mm_movemask_ps(_mm_cmpgt_ps(r0, z0)) | (_mm_movemask_ps(_mm_cmpgt_ps(r1, z1)) << 4);
+#endif
+	return mask;
+}
+
+// 块内 rhw 的范围，取块四角的平面值并限制在三角形顶点的范围内
+static void halfspace_block_rhw_range(const halfspace_triangle_t *tri, float fx, float fy, float tri_min, float tri_max, float *rhw_min, float *rhw_max)
+{
+	float rhw_dx = tri->attr_dx[HALFSPACE_RHW_INDEX] * (float)(HALFSPACE_BLOCK_SIZE - 1);
+	float rhw_dy = tri->attr_dy[HALFSPACE_RHW_INDEX] * (float)(HALFSPACE_BLOCK_SIZE - 1);
+	float base = tri->attr_c[HALFSPACE_RHW_INDEX] + tri->attr_dx[HALFSPACE_RHW_INDEX] * fx + tri->attr_dy[HALFSPACE_RHW_INDEX] * fy;
+	*rhw_min = fmaxf(base + fminf(rhw_dx, 0.0f) + fminf(rhw_dy, 0.0f), tri_min);
+	*rhw_max = fminf(base + fmaxf(rhw_dx, 0.0f) + fmaxf(rhw_dy, 0.0f), tri_max);
+}
+
+static void halfspace_interp_varying(const halfspace_triangle_t *tri, const varying_layout_t *layout, varying_t *out, float fx, float fy)
+{
+	__m128 x = _mm_set1_ps(fx);
+	__m128 y = _mm_set1_ps(fy);
+	for (int k = 0; k < layout->stride; k += 4)
+	{
+		__m128 v = _mm_loadu_ps(&tri->attr_c[k]);
+		v = _mm_add_ps(v, _mm_mul_ps(_mm_loadu_ps(&tri->attr_dx[k]), x));
+		v = _mm_add_ps(v, _mm_mul_ps(_mm_loadu_ps(&tri->attr_dy[k]), y));
+		_mm_storeu_ps(&out->f[k], v);
+	}
+}
+
+// 判断 8x8 块与三角形的关系：0 完全在外，1 部分覆盖，2 完全覆盖
+static int halfspace_classify_block(const halfspace_triangle_t *tri, float fx, float fy)
+{
+	__m128 a = _mm_loadu_ps(tri->edge_a);
+	__m128 b = _mm_loadu_ps(tri->edge_b);
+	__m128 e = _mm_add_ps(_mm_loadu_ps(tri->edge_c), _mm_add_ps(_mm_mul_ps(a, _mm_set1_ps(fx)), _mm_mul_ps(b, _mm_set1_ps(fy))));
+
+	__m128 zero = _mm_setzero_ps();
+	__m128 span = _mm_set1_ps((float)(HALFSPACE_BLOCK_SIZE - 1));
+	__m128 da = _mm_mul_ps(a, span);
+	__m128 db = _mm_mul_ps(b, span);
+	__m128 e_min = _mm_add_ps(e, _mm_add_ps(_mm_min_ps(da, zero), _mm_min_ps(db, zero)));
+	__m128 e_max = _mm_add_ps(e, _mm_add_ps(_mm_max_ps(da, zero), _mm_max_ps(db, zero)));
+
+	if (_mm_movemask_ps(_mm_cmplt_ps(e_max, zero)) != 0)
+	{
+		return 0;
+	}
+
+	if (_mm_movemask_ps(_mm_cmpgt_ps(e_min, zero)) == 0xF)
+	{
+		return 2;
+	}
+
+	return 1;
+}
+
+// 块内第 y 行覆盖且通过深度测试的像素掩码，同时输出每个像素的 rhw；depth_pass 时不比较深度
+static int halfspace_row_mask(const halfspace_triangle_t *tri, const pipeline_state_t *pso, int state, int lane_mask, int bx, int y, bool depth_pass, float *rhw, raster_region_t *region)
+{
+	float fx = (float)bx + 0.5f - tri->ox;
+	float fy = (float)y + 0.5f - tri->oy;
+	int mask = lane_mask;
+	if (state == 1)
+	{
+		mask &= halfspace_row_coverage(tri, fx, fy);
+	}
+
+	if (mask == 0)
+	{
+		return 0;
+	}
+	region->stats.covered_pixel_num += halfspace_bit_count(mask);
+
+	return mask & halfspace_row_depth(tri, pso->depth_func, depth_pass ? NULL : pso->zbuffer[y] + bx, fx, fy, rhw);
+}
+
+// 按 2x2 像素块着色一个 8x8 块，块内的行 [row_begin, row_end)，返回是否写入了深度
+// 像素块内没有覆盖或没有通过深度测试的片元作为辅助片元，只参与着色器的导数计算，不写入
+static bool halfspace_shade_quads(device_t *device, const halfspace_triangle_t *tri, int state, int lane_mask, int bx, int by, int row_begin, int row_end, bool depth_pass, pixel_packet_t *packet, raster_region_t *region)
+{
+	const pipeline_state_t *pso = &device->pipeline_state;
+	const varying_layout_t *layout = &pso->varying_layout;
+	float fx = (float)bx + 0.5f - tri->ox;
+	bool depth_written = false;
+	varying_t varying;
+
+	for (int y = by; y < row_end; y += 2)
+	{
+		int row_mask[2];
+		float row_rhw[2][HALFSPACE_BLOCK_SIZE];
+		for (int r = 0; r < 2; r++)
+		{
+			bool in_rows = y + r >= row_begin && y + r < row_end;
+			row_mask[r] = in_rows ? halfspace_row_mask(tri, pso, state, lane_mask, bx, y + r, depth_pass, row_rhw[r], region) : 0;
+		}
+
+		for (int qx = 0; qx < HALFSPACE_BLOCK_SIZE; qx += 2)
+		{
+			int quad_mask = ((row_mask[0] >> qx) & 3) | (((row_mask[1] >> qx) & 3) << 2);
+			if (quad_mask == 0)
+			{
+				continue;
+			}
+
+			for (int lane = 0; lane < PIXEL_PACKET_SIZE; lane++)
+			{
+				float fy = (float)(y + (lane >> 1)) + 0.5f - tri->oy;
+				halfspace_interp_varying(tri, layout, &varying, fx + (float)(qx + (lane & 1)), fy);
+				varying_unpack_packet(layout, packet, lane, &varying);
+			}
+
+			IUINT32 colors[PIXEL_PACKET_SIZE];
+			packet->mask = quad_mask;
+			pso->pixel_shader_packet(device, packet, colors);
+			for (int lane = 0; lane < PIXEL_PACKET_SIZE; lane++)
+			{
+				if ((quad_mask >> lane) & 1)
+				{
+					int r = lane >> 1;
+					int x = qx + (lane & 1);
+					depth_written |= pso->write_pixel(device, pso->framebuffer[y + r], pso->zbuffer[y + r], bx + x, row_rhw[r][x], colors[lane]);
+				}
+			}
+
+			int shaded = halfspace_bit_count(quad_mask);
+			region->stats.shaded_pixel_num += shaded;
+			region->stats.helper_pixel_num += PIXEL_PACKET_SIZE - shaded;
+		}
+	}
+	return depth_written;
+}
+
+void device_render_triangle_halfspace(device_t *device, const vertex_t *t1, const vertex_t *t2, const vertex_t *t3, raster_region_t *region)
+{
+	const pipeline_state_t *pso = &device->pipeline_state;
+	halfspace_triangle_t tri;
+	if (!halfspace_setup(&tri, &pso->varying_layout, t1, t2, t3))
+	{
+		return;
+	}
+
+	func_pixel_shader p_shader = pso->pixel_shader;
+	func_pixel_shader_packet p_shader_packet = pso->pixel_shader_packet;
+	func_write_pixel write_pixel = pso->write_pixel;
+	hiz_buffer_t *hiz = pso->hiz;
+	bool depth_only = !pso->color_write;
+	bool quad_shading = pso->quad_shading && !depth_only && p_shader_packet != NULL;
+	float tri_rhw_min = fminf(t1->rhw, fminf(t2->rhw, t3->rhw));
+	float tri_rhw_max = fmaxf(t1->rhw, fmaxf(t2->rhw, t3->rhw));
+
+	// 包围盒，先在浮点下裁剪，避免超大坐标转换溢出
+	const rect_t *clip = &region->clip;
+	float min_x = fminf(t1->pos.x, fminf(t2->pos.x, t3->pos.x));
+	float max_x = fmaxf(t1->pos.x, fmaxf(t2->pos.x, t3->pos.x));
+	float min_y = fminf(t1->pos.y, fminf(t2->pos.y, t3->pos.y));
+	float max_y = fmaxf(t1->pos.y, fmaxf(t2->pos.y, t3->pos.y));
+	min_x = fmaxf(min_x, (float)clip->x0);
+	min_y = fmaxf(min_y, (float)clip->y0);
+	max_x = fminf(max_x + 1.0f, (float)clip->x1);
+	max_y = fminf(max_y + 1.0f, (float)clip->y1);
+	if (!(min_x < max_x && min_y < max_y))
+	{
+		return;
+	}
+
+	int x_begin = (int)min_x;
+	int y_begin = (int)min_y;
+	int x_end = (int)max_x;
+	int y_end = (int)max_y;
+
+	// 块与分块光栅化的块边界对齐，不会读写其他线程的像素
+	int block_x0 = x_begin & ~(HALFSPACE_BLOCK_SIZE - 1);
+	int block_y0 = y_begin & ~(HALFSPACE_BLOCK_SIZE - 1);
+
+	// 着色器只读取声明过的属性，其余属性不插值
+	vertex_t v;
+	pixel_packet_t packet;
+	varying_t varying;
+	memset(&v, 0, sizeof(vertex_t));
+	memset(&packet, 0, sizeof(pixel_packet_t));
+	float rhw[HALFSPACE_BLOCK_SIZE];
+
+	for (int by = block_y0; by < y_end; by += HALFSPACE_BLOCK_SIZE)
+	{
+		int row_begin = by > y_begin ? by : y_begin;
+		int row_end = by + HALFSPACE_BLOCK_SIZE < y_end ? by + HALFSPACE_BLOCK_SIZE : y_end;
+
+		for (int bx = block_x0; bx < x_end; bx += HALFSPACE_BLOCK_SIZE)
+		{
+			float fx = (float)bx + 0.5f - tri.ox;
+			int state = halfspace_classify_block(&tri, fx, (float)by + 0.5f - tri.oy);
+			if (state == 0)
+			{
+				continue;
+			}
+
+			// 块内最近的深度比已写入的最远深度还远则跳过整块，最远的深度比已写入的最近深度还近则不必逐像素比较
+			bool depth_pass = false;
+			if (pso->hiz_reject)
+			{
+				float rhw_min, rhw_max, depth_min, depth_max;
+				halfspace_block_rhw_range(&tri, fx, (float)by + 0.5f - tri.oy, tri_rhw_min, tri_rhw_max, &rhw_min, &rhw_max);
+				hiz_get_block(hiz, bx / HIZ_BLOCK_SIZE, by / HIZ_BLOCK_SIZE, &depth_min, &depth_max);
+				region->stats.hiz_block_test_num++;
+				if (rhw_max + rhw_max * HIZ_DEPTH_EPSILON < depth_min)
+				{
+					region->stats.hiz_block_reject_num++;
+					continue;
+				}
+				if (pso->hiz_accept && rhw_min - rhw_min * HIZ_DEPTH_EPSILON > depth_max)
+				{
+					region->stats.hiz_block_accept_num++;
+					depth_pass = true;
+				}
+			}
+
+			bool depth_written = false;
+			// 块内处于包围盒中的像素
+			int lane_begin = x_begin > bx ? x_begin - bx : 0;
+			int lane_end = x_end - bx < HALFSPACE_BLOCK_SIZE ? x_end - bx : HALFSPACE_BLOCK_SIZE;
+			int lane_mask = ((1 << lane_end) - 1) & ~((1 << lane_begin) - 1);
+
+			if (quad_shading)
+			{
+				depth_written = halfspace_shade_quads(device, &tri, state, lane_mask, bx, by, row_begin, row_end, depth_pass, &packet, region);
+				if (depth_written)
+				{
+					hiz_mark_block_dirty(hiz, bx / HIZ_BLOCK_SIZE, by / HIZ_BLOCK_SIZE);
+				}
+				continue;
+			}
+
+			for (int y = row_begin; y < row_end; y++)
+			{
+				float fy = (float)y + 0.5f - tri.oy;
+				int mask = halfspace_row_mask(&tri, pso, state, lane_mask, bx, y, depth_pass, rhw, region);
+				if (mask == 0)
+				{
+					continue;
+				}
+
+				IUINT32 *framebuffer = pso->framebuffer[y];
+				float *zbuffer = pso->zbuffer[y];
+
+				if (depth_only)
+				{
+					if (pso->depth_write && mask)
+					{
+						for (int lane = 0; lane < HALFSPACE_BLOCK_SIZE; lane++)
+						{
+							if ((mask >> lane) & 1) zbuffer[bx + lane] = rhw[lane];
+						}
+						depth_written = true;
+					}
+					continue;
+				}
+
+				if (p_shader == NULL)
+				{
+					continue;
+				}
+
+				if (p_shader_packet)
+				{
+					// 每次取出最多 PIXEL_PACKET_SIZE 个覆盖的像素组成片元包
+					region->stats.shaded_pixel_num += halfspace_bit_count(mask);
+					while (mask)
+					{
+						int lanes[PIXEL_PACKET_SIZE];
+						int lane_num = 0;
+						for (; mask && lane_num < PIXEL_PACKET_SIZE; mask &= mask - 1)
+						{
+							int lane = 0;
+							while (((mask >> lane) & 1) == 0) lane++;
+
+							halfspace_interp_varying(&tri, &pso->varying_layout, &varying, fx + (float)lane, fy);
+							varying_unpack_packet(&pso->varying_layout, &packet, lane_num, &varying);
+							lanes[lane_num++] = lane;
+						}
+
+						IUINT32 colors[PIXEL_PACKET_SIZE];
+						packet.mask = (1 << lane_num) - 1;
+						p_shader_packet(device, &packet, colors);
+						for (int k = 0; k < lane_num; k++)
+						{
+							depth_written |= write_pixel(device, framebuffer, zbuffer, bx + lanes[k], rhw[lanes[k]], colors[k]);
+						}
+					}
+					continue;
+				}
+
+				for (; mask; mask &= mask - 1)
+				{
+					int lane = 0;
+					while (((mask >> lane) & 1) == 0) lane++;
+
+					halfspace_interp_varying(&tri, &pso->varying_layout, &varying, fx + (float)lane, fy);
+					varying_unpack(&pso->varying_layout, &v, &varying);
+					IUINT32 color = p_shader(device, &v);
+					depth_written |= write_pixel(device, framebuffer, zbuffer, bx + lane, rhw[lane], color);
+					region->stats.shaded_pixel_num++;
+				}
+			}
+
+			if (depth_written)
+			{
+				hiz_mark_block_dirty(hiz, bx / HIZ_BLOCK_SIZE, by / HIZ_BLOCK_SIZE);
+			}
+		}
+	}
+}
@@ -0,0 +1,306 @@
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+
+#include "raster_kernel.h"
+#include "blend.h"
+#include "hiz.h"
+
+template<int DepthTest>
+static inline bool rop_depth_test(int depth_func, float rhw, float depth)
+{
+	switch (DepthTest)
+	{
+	case ROP_DEPTH_TEST_OFF: return true;
+	case ROP_DEPTH_TEST_GEQUAL: return rhw >= depth;
+	case ROP_DEPTH_TEST_EQUAL: return rhw == depth;
+	default: return raster_depth_test(depth_func, rhw, depth);
+	}
+}
+
+template<int Format>
+static inline bool rop_is_opaque(IUINT32 color)
+{
+	return Format == ROP_TARGET_XRGB8 || (color & 0xFF) == 255;
+}
+
+// 与 blend_frame_buffer_color 相同，源和目标都使用 srcState 对应的系数
+template<int Blend>
+static inline IUINT32 rop_blend(IUINT32 src, IUINT32 dst)
+{
+	float alpha = (float)(src & 0xFF) / 255.0f;
+	float factor = 0.0f;
+	switch (Blend)
+	{
+	case ROP_BLEND_ONE: factor = 1.0f; break;
+	case ROP_BLEND_SRC_ALPHA: factor = alpha; break;
+	case ROP_BLEND_ONE_MINUS_SRC_ALPHA: factor = 1.0f - alpha; break;
+	default: break;
+	}
+
+	IUINT32 r = (IUINT32)(((src >> 24) & 0xFF) * factor + ((dst >> 24) & 0xFF) * factor);
+	IUINT32 g = (IUINT32)(((src >> 16) & 0xFF) * factor + ((dst >> 16) & 0xFF) * factor);
+	IUINT32 b = (IUINT32)(((src >> 8) & 0xFF) * factor + ((dst >> 8) & 0xFF) * factor);
+	IUINT32 a = (IUINT32)((src & 0xFF) * factor + (dst & 0xFF) * factor);
+	return (r << 24) | (g << 16) | (b << 8) | a;
+}
+
+// 写入已通过深度测试的片元，返回是否写入了深度
+template<bool DepthWrite, int Blend, int Format>
+static inline bool rop_write(IUINT32 *framebuffer, float *zbuffer, int x, float rhw, IUINT32 color)
+{
+	if (Blend == ROP_BLEND_OPAQUE || rop_is_opaque<Format>(color))
+	{
+		framebuffer[x] = color;
+		if (DepthWrite) zbuffer[x] = rhw;
+		return DepthWrite;
+	}
+	framebuffer[x] = rop_blend<Blend>(color, framebuffer[x]);
+	return false;
+}
+
+template<bool DepthWrite, int Blend, int Format>
+static bool raster_write_pixel_kernel(device_t *, IUINT32 *framebuffer, float *zbuffer, int x, float rhw, IUINT32 color)
+{
+	return rop_write<DepthWrite, Blend, Format>(framebuffer, zbuffer, x, rhw, color);
+}
+
+// 对片元包着色并写入，lane_x 和 lane_rhw 为每个片元的位置和深度
+template<bool DepthWrite, int Blend, int Format>
+static inline void rop_shade_packet(device_t *device, pixel_packet_t *packet, int lane_num, const int *lane_x, const float *lane_rhw,
+	IUINT32 *framebuffer, float *zbuffer, int *write_x0, int *write_x1)
+{
+	IUINT32 colors[PIXEL_PACKET_SIZE];
+	packet->mask = (1 << lane_num) - 1;
+	device->pipeline_state.pixel_shader_packet(device, packet, colors);
+	for (int lane = 0; lane < lane_num; lane++)
+	{
+		if (rop_write<DepthWrite, Blend, Format>(framebuffer, zbuffer, lane_x[lane], lane_rhw[lane], colors[lane]))
+		{
+			if (lane_x[lane] < *write_x0) *write_x0 = lane_x[lane];
+			*write_x1 = lane_x[lane] + 1;
+		}
+	}
+}
+
+// 逐片元着色时结果与 device_draw_scanline_generic 逐位一致
+// Packet 为 true 时把通过深度测试的片元攒成片元包再着色，一个扫描线内的片元位置互不相同，延后写入不影响深度测试
+template<int DepthTest, bool DepthWrite, int Blend, int Format, bool Packet>
+static void raster_scanline_kernel(device_t *device, scanline_t *scanline, raster_region_t *region)
+{
+	const pipeline_state_t *pso = &device->pipeline_state;
+	IUINT32 *framebuffer = pso->framebuffer[scanline->y];
+	float *zbuffer = pso->zbuffer[scanline->y];
+	func_pixel_shader p_shader = pso->pixel_shader;
+	const varying_layout_t *layout = &pso->varying_layout;
+	int depth_func = pso->depth_func;
+
+	vertex_t v;
+	pixel_packet_t packet;
+	int lane_x[PIXEL_PACKET_SIZE];
+	float lane_rhw[PIXEL_PACKET_SIZE];
+	int lane_num = 0;
+	if (Blend != ROP_BLEND_COLOR_MASKED)
+	{
+		if (Packet) memset(&packet, 0, sizeof(pixel_packet_t));
+		else memset(&v, 0, sizeof(vertex_t));
+	}
+
+	// clip 左侧的像素只步进属性，步进次数与通用版本相同，保证插值结果一致
+	int x = scanline->x;
+	int x_end = scanline->x + scanline->w;
+	for (; x < x_end && x < region->clip.x0; x++)
+	{
+		varying_add(layout, &scanline->v, &scanline->step);
+	}
+	if (x_end > region->clip.x1) x_end = region->clip.x1;
+	if (x >= x_end)
+	{
+		return;
+	}
+
+	region->stats.covered_pixel_num += x_end - x;
+	unsigned int shaded_pixel_num = 0;
+	int write_x0 = x_end, write_x1 = x;
+	for (; x < x_end; x++)
+	{
+		float rhw = scanline->v.f[VARYING_RHW_INDEX];
+		if (rop_depth_test<DepthTest>(depth_func, rhw, zbuffer[x]))
+		{
+			bool depth_written;
+			if (Blend == ROP_BLEND_COLOR_MASKED)
+			{
+				if (DepthWrite) zbuffer[x] = rhw;
+				depth_written = DepthWrite;
+			}
+			else if (Packet)
+			{
+				varying_unpack_packet(layout, &packet, lane_num, &scanline->v);
+				lane_x[lane_num] = x;
+				lane_rhw[lane_num] = rhw;
+				if (++lane_num == PIXEL_PACKET_SIZE)
+				{
+					rop_shade_packet<DepthWrite, Blend, Format>(device, &packet, lane_num, lane_x, lane_rhw, framebuffer, zbuffer, &write_x0, &write_x1);
+					lane_num = 0;
+				}
+				shaded_pixel_num++;
+				depth_written = false;
+			}
+			else
+			{
+				varying_unpack(layout, &v, &scanline->v);
+				IUINT32 color = p_shader(device, &v);
+				depth_written = rop_write<DepthWrite, Blend, Format>(framebuffer, zbuffer, x, rhw, color);
+				shaded_pixel_num++;
+			}
+			if (depth_written)
+			{
+				if (x < write_x0) write_x0 = x;
+				write_x1 = x + 1;
+			}
+		}
+		varying_add(layout, &scanline->v, &scanline->step);
+	}
+	if (Packet && lane_num > 0)
+	{
+		rop_shade_packet<DepthWrite, Blend, Format>(device, &packet, lane_num, lane_x, lane_rhw, framebuffer, zbuffer, &write_x0, &write_x1);
+	}
+	region->stats.shaded_pixel_num += shaded_pixel_num;
+
+	if (DepthWrite)
+	{
+		hiz_mark_dirty(pso->hiz, scanline->y, write_x0, write_x1);
+	}
+}
+
+#define SCANLINE_KERNEL_PACKET(D, W, B) { raster_scanline_kernel<D, W, B, ROP_TARGET_FORMAT, false>, raster_scanline_kernel<D, W, B, ROP_TARGET_FORMAT, true> }
+
+#define SCANLINE_KERNEL_BLEND(D, W) { \
+	SCANLINE_KERNEL_PACKET(D, W, ROP_BLEND_COLOR_MASKED), \
+	SCANLINE_KERNEL_PACKET(D, W, ROP_BLEND_OPAQUE), \
+	SCANLINE_KERNEL_PACKET(D, W, ROP_BLEND_ZERO), \
+	SCANLINE_KERNEL_PACKET(D, W, ROP_BLEND_ONE), \
+	SCANLINE_KERNEL_PACKET(D, W, ROP_BLEND_SRC_ALPHA), \
+	SCANLINE_KERNEL_PACKET(D, W, ROP_BLEND_ONE_MINUS_SRC_ALPHA) }
+
+#define SCANLINE_KERNEL_DEPTH(D) { SCANLINE_KERNEL_BLEND(D, false), SCANLINE_KERNEL_BLEND(D, true) }
+
+static const func_scanline_kernel scanline_kernel_table[ROP_DEPTH_TEST_NUM][2][ROP_BLEND_NUM][2] = {
+	SCANLINE_KERNEL_DEPTH(ROP_DEPTH_TEST_OFF),
+	SCANLINE_KERNEL_DEPTH(ROP_DEPTH_TEST_GEQUAL),
+	SCANLINE_KERNEL_DEPTH(ROP_DEPTH_TEST_EQUAL),
+	SCANLINE_KERNEL_DEPTH(ROP_DEPTH_TEST_FUNC),
+};
+
+// 只写深度时不会写入颜色，使用不混合的版本
+#define WRITE_PIXEL_KERNEL_BLEND(W) { \
+	raster_write_pixel_kernel<W, ROP_BLEND_OPAQUE, ROP_TARGET_FORMAT>, \
+	raster_write_pixel_kernel<W, ROP_BLEND_OPAQUE, ROP_TARGET_FORMAT>, \
+	raster_write_pixel_kernel<W, ROP_BLEND_ZERO, ROP_TARGET_FORMAT>, \
+	raster_write_pixel_kernel<W, ROP_BLEND_ONE, ROP_TARGET_FORMAT>, \
+	raster_write_pixel_kernel<W, ROP_BLEND_SRC_ALPHA, ROP_TARGET_FORMAT>, \
+	raster_write_pixel_kernel<W, ROP_BLEND_ONE_MINUS_SRC_ALPHA, ROP_TARGET_FORMAT> }
+
+static const func_write_pixel write_pixel_kernel_table[2][ROP_BLEND_NUM] = {
+	WRITE_PIXEL_KERNEL_BLEND(false),
+	WRITE_PIXEL_KERNEL_BLEND(true),
+};
+
+static int raster_kernel_depth_test(int depth_func)
+{
+	switch (depth_func)
+	{
+	case DEPTH_FUNC_ALWAYS: return ROP_DEPTH_TEST_OFF;
+	case DEPTH_FUNC_GEQUAL: return ROP_DEPTH_TEST_GEQUAL;
+	case DEPTH_FUNC_EQUAL: return ROP_DEPTH_TEST_EQUAL;
+	default: return ROP_DEPTH_TEST_FUNC;
+	}
+}
+
+// srcState 为 BLEND_ONE、dstState 为 BLEND_ZERO 时不混合
+static int raster_kernel_blend(const pipeline_state_t *pipeline_state)
+{
+	if (!pipeline_state->color_write)
+	{
+		return ROP_BLEND_COLOR_MASKED;
+	}
+
+	const blendstate_t *blend_state = &pipeline_state->blend_state;
+	switch (blend_state->srcState)
+	{
+	case BLEND_ZERO: return ROP_BLEND_ZERO;
+	case BLEND_ONE: return blend_state->dstState == BLEND_ZERO ? ROP_BLEND_OPAQUE : ROP_BLEND_ONE;
+	case BLEND_SRC_ALPHA: return ROP_BLEND_SRC_ALPHA;
+	case BLEND_ONE_MINUS_SRC_ALPHA: return ROP_BLEND_ONE_MINUS_SRC_ALPHA;
+	default: return ROP_BLEND_OPAQUE;
+	}
+}
+
+void raster_select_kernel(pipeline_state_t *pipeline_state, bool generic)
+{
+	// 没有片元着色器时只统计覆盖的像素，交给通用版本
+	if (generic || (pipeline_state->color_write && pipeline_state->pixel_shader == NULL))
+	{
+		pipeline_state->scanline_kernel = device_draw_scanline_generic;
+		pipeline_state->write_pixel = device_write_pixel;
+		return;
+	}
+
+	int depth_test = raster_kernel_depth_test(pipeline_state->depth_func);
+	int depth_write = pipeline_state->depth_write ? 1 : 0;
+	int blend = raster_kernel_blend(pipeline_state);
+	int packet = pipeline_state->pixel_shader_packet != NULL ? 1 : 0;
+	pipeline_state->scanline_kernel = scanline_kernel_table[depth_test][depth_write][blend][packet];
+	pipeline_state->write_pixel = write_pixel_kernel_table[depth_write][blend];
+}
+
+void raster_kernel_benchmark(device_t *device, const char *name, int repeat)
+{
+	pipeline_state_t *pso = &device->pipeline_state;
+	if (!device_begin_draw(device) || (pso->color_write && pso->pixel_shader == NULL))
+	{
+		return;
+	}
+
+	// 整屏宽的扫描线，属性从左到右线性变化
+	vertex_t left, right;
+	memset(&left, 0, sizeof(vertex_t));
+	memset(&right, 0, sizeof(vertex_t));
+	left.pos = { 0.0f, 0.0f, 0.5f, 1.0f };
+	right.pos = { (float)device->framebuffer_width, 0.0f, 0.5f, 1.0f };
+	left.tc = { 0.0f, 0.0f };
+	right.tc = { 1.0f, 1.0f };
+	left.color = { 1.0f, 0.0f, 0.0f, 1.0f };
+	right.color = { 0.0f, 0.0f, 1.0f, 1.0f };
+	left.normal = { 0.0f, 0.0f, 1.0f, 0.0f };
+	right.normal = { 1.0f, 0.0f, 0.0f, 0.0f };
+	left.vs_result[0] = { -1.0f, -1.0f, 0.5f, 1.0f };
+	right.vs_result[0] = { 1.0f, 1.0f, 0.5f, 1.0f };
+	left.rhw = 1.0f;
+	right.rhw = 1.0f;
+
+	varying_t left_varying, right_varying;
+	varying_pack(&pso->varying_layout, &left_varying, &left);
+	varying_pack(&pso->varying_layout, &right_varying, &right);
+
+	func_scanline_kernel kernels[2] = { device_draw_scanline_generic, pso->scanline_kernel };
+	double milliseconds[2];
+	raster_region_t region;
+	for (int k = 0; k < 2; k++)
+	{
+		device_init_raster_region(device, &region);
+		clock_t start = clock();
+		for (int i = 0; i < repeat; i++)
+		{
+			for (int y = 0; y < device->framebuffer_height; y++)
+			{
+				scanline_t scanline;
+				trapezoid_init_scan_line(&pso->varying_layout, &left_varying, &right_varying, &scanline, y);
+				kernels[k](device, &scanline, &region);
+			}
+		}
+		milliseconds[k] = (double)(clock() - start) * 1000.0 / CLOCKS_PER_SEC;
+	}
+
+	printf("%s: generic %.1f ms, specialized %.1f ms, %u pixels shaded per pass\n", name, milliseconds[0], milliseconds[1], region.stats.shaded_pixel_num / repeat);
+}
@@ -0,0 +1,44 @@
+#pragma once
+
+#include "device.h"
+#include "raster.h"
+#include "renderstate.h"
+
+//=====================================================================
+// 光栅化内核：扫描线的深度测试、着色、混合和写入按
+// (深度测试, 深度写入, 混合模式, 目标格式) 编译为模板特化版本，
+// 编译管线状态时查表选出一次，内循环不再逐像素判断这些状态
+// 片元着色器有片元包版本时，通过深度测试的片元每 PIXEL_PACKET_SIZE 个着色一次
+//=====================================================================
+
+// 深度测试
+#define ROP_DEPTH_TEST_OFF		0	// 不比较，DEPTH_FUNC_ALWAYS
+#define ROP_DEPTH_TEST_GEQUAL	1	// 默认的深度比较
+#define ROP_DEPTH_TEST_EQUAL	2	// 深度预渲染后的着色
+#define ROP_DEPTH_TEST_FUNC		3	// 其他比较函数，按 depth_func 比较
+#define ROP_DEPTH_TEST_NUM		4
+
+// 混合模式，半透明的片元按 blend_state.srcState 混合
+#define ROP_BLEND_COLOR_MASKED		0	// 不写颜色，只写深度
+#define ROP_BLEND_OPAQUE			1	// 不混合，直接写入片元颜色
+#define ROP_BLEND_ZERO				2
+#define ROP_BLEND_ONE				3
+#define ROP_BLEND_SRC_ALPHA			4
+#define ROP_BLEND_ONE_MINUS_SRC_ALPHA	5
+#define ROP_BLEND_NUM				6
+
+// 目标格式
+#define ROP_TARGET_RGBA8	0	// R G B A 从高到低，A 为 255 时不透明
+#define ROP_TARGET_XRGB8	1	// GDI 的位图，没有透明度
+
+#ifdef USE_GDI_VIEW
+#define ROP_TARGET_FORMAT ROP_TARGET_XRGB8
+#else
+#define ROP_TARGET_FORMAT ROP_TARGET_RGBA8
+#endif
+
+// 按管线状态填写 scanline_kernel 和 write_pixel，generic 为 true 时使用逐像素判断状态的通用版本
+void raster_select_kernel(pipeline_state_t *pipeline_state, bool generic);
+
+// 用当前管线状态绘制 repeat 遍整屏扫描线，分别统计通用版本和特化版本的耗时并输出
+void raster_kernel_benchmark(device_t *device, const char *name, int repeat);
@@ -1,29 +1,43 @@
 #pragma once
 
-#define RENDER_STATE_WIREFRAME      1		// Ⱦ߿
-#define RENDER_STATE_TEXTURE        2		// Ⱦ
-#define RENDER_STATE_COLOR          4		// Ⱦɫ
-#define RENDER_STATE_LAMBERT_LIGHT_TEXTURE 8 // ع
-#define RENDER_STATE_PHONG_LIGHT_TEXTURE 16 // PHONG
-#define RENDER_STATE_TEXTURE_ALPHA	32 //͸ģʽ
-#define RENDER_STATE_SHADOW_MAP	64 //Ӱģʽ
-#define RENDER_STATE_BLINN_LIGHT_TEXTURE 128 //Blinn
+#define RENDER_STATE_WIREFRAME      1		// 渲染线框
+#define RENDER_STATE_TEXTURE        2		// 渲染纹理
+#define RENDER_STATE_COLOR          4		// 渲染颜色
+#define RENDER_STATE_LAMBERT_LIGHT_TEXTURE 8 // 兰伯特光照
+#define RENDER_STATE_PHONG_LIGHT_TEXTURE 16 // PHONG光照
+#define RENDER_STATE_TEXTURE_ALPHA	32 //透明模式
+#define RENDER_STATE_SHADOW_MAP	64 //阴影模式
+#define RENDER_STATE_BLINN_LIGHT_TEXTURE 128 //Blinn光照
 
-#define SHADER_STATE_WIREFRAME      1		// Ⱦ߿
-#define SHADER_STATE_TEXTURE        2		// Ⱦ
-#define SHADER_STATE_COLOR          4		// Ⱦɫ
-#define SHADER_STATE_LAMBERT_LIGHT_TEXTURE 8 // ع
-#define SHADER_STATE_PHONG_LIGHT_TEXTURE 16 // PHONG
-#define SHADER_STATE_TEXTURE_ALPHA	32 //͸ģʽ
-#define SHADER_STATE_SHADOW_MAP	64 //Ӱģʽ
-#define SHADER_STATE_LIGHT_SHADOW 128 //Ӱ
-#define SHADER_STATE_BLINN_LIGHT_TEXTURE 256 //Blinn
+#define SHADER_STATE_WIREFRAME      1		// 渲染线框
+#define SHADER_STATE_TEXTURE        2		// 渲染纹理
+#define SHADER_STATE_COLOR          4		// 渲染颜色
+#define SHADER_STATE_LAMBERT_LIGHT_TEXTURE 8 // 兰伯特光照
+#define SHADER_STATE_PHONG_LIGHT_TEXTURE 16 // PHONG光照
+#define SHADER_STATE_TEXTURE_ALPHA	32 //透明模式
+#define SHADER_STATE_SHADOW_MAP	64 //阴影模式
+#define SHADER_STATE_LIGHT_SHADOW 128 //光照阴影
+#define SHADER_STATE_BLINN_LIGHT_TEXTURE 256 //Blinn光照
+#define SHADER_STATE_LIGHT_NO_SHADOW 512 //光照阴影中不接收阴影的物体，光照与光照阴影相同
 
 //#define USE_GDI_VIEW
+//#define SHOW_RENDER_STATS	// 每秒输出帧率和光栅化统计
+//#define BENCHMARK_RASTER_KERNEL	// 启动时比较通用和特化的扫描线内核的耗时
+//#define BENCHMARK_TEXTURE_MIPMAP	// 启动时比较远处地面在各 mip 过滤方式下的耗时和纹理缓存行读取
+//#define BENCHMARK_TEXTURE_LAYOUT	// 启动时比较旋转的盒子在两种纹素排列下的耗时和纹理缓存行读取
+//#define BENCHMARK_TEXTURE_COMPRESSION	// 启动时比较近处地面在未压缩和块压缩纹理下的耗时、内存和纹理缓存行读取
+//#define BENCHMARK_SHADOW_PCF	// 启动时比较阴影在各百分比渐近过滤核下的耗时
+//#define BENCHMARK_VERTEX_SHADING	// 启动时比较逐顶点和批量 SoA 顶点着色的耗时
+//#define BENCHMARK_OBJECT_CULLING	// 启动时比较大量盒子中视锥外的盒子提交绘制和批量视锥剔除的耗时
 
 #define WINDOW_SIZE 512
+#define SHADOW_ATLAS_SIZE 1024	// 阴影图集的分辨率，不超过 MAX_FRAME_BUFFER_WIDTH，与窗口大小无关
+#define SHADOW_MAP_SIZE 512	// 主光源阴影图的分辨率，向上取为图集边长除以 2 的幂
+#define SHADOW_LIGHT_NUM 1	// 投射阴影的光源数，不超过 MAX_SHADOW_LIGHT_NUM
+#define SHADOW_PCF SAMPLER_PCF_2X2	// 阴影图比较采样的过滤核，SAMPLER_PCF_*
+#define SHADOW_MAP_PARTIAL_UPDATE	// 只有动态的投射物改变时，复制保存的静态投射物深度，只重新绘制动态的投射物
 #define MAX_RENDER_STATE 8
-#define MAX_SHADER_STATE 9
+#define MAX_SHADER_STATE 10
 
 #define MOVE_NEAR 0
 #define MOVE_FAR 1
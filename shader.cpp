@@ -3,16 +3,11 @@
 #include <stdio.h>
 
 #include "shader.h"
+#include "mathlib_simd.h"
 #include "renderstate.h"
 #include "comm_func.h"
 
-typedef struct {
-	IUINT32 RenderState;
-	func_vertex_shader p_vertex_shader;
-	func_pixel_shader p_pixel_shader;
-} RenderComponent;
-
-// ɫ
+// 顶点着色器
 void shader_vertex_normal_mvp(device_t* device, vertex_t* vertex, point_t* output)
 {
 	transform_apply(&device->transform, output, &(vertex->pos));
@@ -33,9 +28,18 @@ void shader_vertex_shadow_map_mvp(device_t* device, vertex_t* vertex, point_t* o
 {
 	transform_apply(&device->transform, output, &(vertex->pos));
 	
-	vector_t pos_in_light_space;
-	matrix_apply(&(pos_in_light_space), &(vertex->pos), &(device->uniform_matrix[0]));
-	transform_homogenize(&device->transform, &(vertex->vs_result[0]), &pos_in_light_space);
+	// 光源空间的坐标换算为阴影图的纹理坐标和 z/w，与阴影图的分辨率无关
+	int light_num = (int)device->uniform_vector[SHADOW_UNIFORM_LIGHT_NUM].x;
+	for (int i = 0; i < light_num; i++)
+	{
+		vector_t pos_in_light_space;
+		matrix_apply(&(pos_in_light_space), &(vertex->pos), &(device->uniform_matrix[i]));
+		float rhw = 1.0f / pos_in_light_space.w;
+		vertex->vs_result[i].x = (pos_in_light_space.x * rhw + 1.0f) * 0.5f;
+		vertex->vs_result[i].y = (1.0f - pos_in_light_space.y * rhw) * 0.5f;
+		vertex->vs_result[i].z = pos_in_light_space.z * rhw;
+		vertex->vs_result[i].w = 1.0f;
+	}
 }
 
 void shader_vertex_blinn_mvp(device_t* device, vertex_t* vertex, point_t* output)
@@ -49,9 +53,96 @@ void shader_vertex_blinn_mvp(device_t* device, vertex_t* vertex, point_t* output
 	vector_sub(&vertex->vs_result[0], &eye, &posInWorld);
 }
 
+// 批量顶点着色器：每 4 个顶点的位置转置为 SoA，一次变换 4 个顶点，结果转置回连续的顶点和裁剪空间坐标
+// 累加顺序与逐顶点的版本相同
+#define VERTEX_BATCH_SIZE 4
+
+static inline vector_packet_t shader_batch_position(const vertex_t* vertices, int count)
+{
+	return vector_packet_gather(&vertices->pos, sizeof(vertex_t), count);
+}
+
+static inline void shader_batch_store_clip(const vector_packet_t* clip, point_t* outputs, int count)
+{
+	vector_packet_scatter(clip, outputs, sizeof(point_t), count);
+}
+
+// 所有着色器的位置部分，只计算裁剪空间坐标
+void shader_vertex_normal_mvp_batch(device_t* device, vertex_t* vertices, point_t* outputs, int count)
+{
+	for (int i = 0; i < count; i += VERTEX_BATCH_SIZE)
+	{
+		int n = count - i < VERTEX_BATCH_SIZE ? count - i : VERTEX_BATCH_SIZE;
+		vector_packet_t pos = shader_batch_position(vertices + i, n);
+		vector_packet_t clip;
+		vector_packet_apply(&clip, &pos, &device->transform.transform);
+		shader_batch_store_clip(&clip, outputs + i, n);
+	}
+}
+
+// 属性部分：可见三角形的顶点不连续，按地址读写 4 个顶点
+static inline vector_packet_t shader_attribute_position(vertex_t** vertices, int count)
+{
+	const vector_t* pos[VERTEX_BATCH_SIZE];
+	for (int k = 0; k < count; k++)
+	{
+		pos[k] = &vertices[k]->pos;
+	}
+	return vector_packet_gather_ptr(pos, count);
+}
+
+static inline void shader_attribute_store(const vector_packet_t* result, vertex_t** vertices, int slot, int count)
+{
+	vector_t* vs_result[VERTEX_BATCH_SIZE];
+	for (int k = 0; k < count; k++)
+	{
+		vs_result[k] = &vertices[k]->vs_result[slot];
+	}
+	vector_packet_scatter_ptr(result, vs_result, count);
+}
+
+// phong 和 blinn 共用，vs_result[0] 为世界空间中指向视点的矢量
+void shader_vertex_eye_attribute(device_t* device, vertex_t** vertices, int count)
+{
+	vector_packet_t eye = vector_packet_set(&device->uniform_vector[2]);
+	for (int i = 0; i < count; i += VERTEX_BATCH_SIZE)
+	{
+		int n = count - i < VERTEX_BATCH_SIZE ? count - i : VERTEX_BATCH_SIZE;
+		vector_packet_t pos = shader_attribute_position(vertices + i, n);
+		vector_packet_t pos_in_world, eye_view;
+		vector_packet_apply(&pos_in_world, &pos, &device->transform.world);
+		vector_packet_sub(&eye_view, &eye, &pos_in_world);
+		eye_view.w = _mm_set1_ps(1.0f);
+		shader_attribute_store(&eye_view, vertices + i, 0, n);
+	}
+}
+
+void shader_vertex_shadow_map_attribute(device_t* device, vertex_t** vertices, int count)
+{
+	int light_num = (int)device->uniform_vector[SHADOW_UNIFORM_LIGHT_NUM].x;
+	__m128 one = _mm_set1_ps(1.0f);
+	__m128 half = _mm_set1_ps(0.5f);
+	for (int i = 0; i < count; i += VERTEX_BATCH_SIZE)
+	{
+		int n = count - i < VERTEX_BATCH_SIZE ? count - i : VERTEX_BATCH_SIZE;
+		vector_packet_t pos = shader_attribute_position(vertices + i, n);
+		for (int k = 0; k < light_num; k++)
+		{
+			vector_packet_t pos_in_light_space, shadow;
+			vector_packet_apply(&pos_in_light_space, &pos, &device->uniform_matrix[k]);
+			__m128 rhw = _mm_div_ps(one, pos_in_light_space.w);
+			shadow.x = _mm_mul_ps(_mm_add_ps(_mm_mul_ps(pos_in_light_space.x, rhw), one), half);
+			shadow.y = _mm_mul_ps(_mm_sub_ps(one, _mm_mul_ps(pos_in_light_space.y, rhw)), half);
+			shadow.z = _mm_mul_ps(pos_in_light_space.z, rhw);
+			shadow.w = one;
+			shader_attribute_store(&shadow, vertices + i, k, n);
+		}
+	}
+}
+
 unsigned char default_alpha = 255;
 
-// ƬԪɫ
+// 片元着色器
 IUINT32 shader_pixel_normal_color(device_t* device, vertex_t* vertex)
 {
 	float w = 1.0f / vertex->rhw;
@@ -80,7 +171,7 @@ IUINT32 shader_pixel_normal_texture(device_t* device, vertex_t* vertex)
 	float u = vertex->tc.u * w;
 	float v = vertex->tc.v * w;
 
-	IUINT32 cc = device_texture_read(device, u, v, device->texture_id[0]);
+	IUINT32 cc = device_texture_sample(device, 0, u, v, 0.0f);
 	IUINT32 texture_R = Get_R(cc);
 	IUINT32 texture_G = Get_G(cc);
 	IUINT32 texture_B = Get_B(cc);
@@ -109,7 +200,7 @@ IUINT32 shader_pixel_texture_lambert_light(device_t* device, vertex_t* vertex)
 	vector_t cnormal;
 	matrix_apply(&cnormal, &normal, &(normal_world));
 
-	IUINT32 cc = device_texture_read(device, u, v, device->texture_id[0]);
+	IUINT32 cc = device_texture_sample(device, 0, u, v, 0.0f);
 	float diffuse = vector_dotproduct(&direction, &cnormal);
 	if (diffuse >= 0.001)
 	{
@@ -159,7 +250,7 @@ IUINT32 shader_pixel_texture_phong_light(device_t* device, vertex_t* vertex)
 	vector_t cnormal;
 	matrix_apply(&cnormal, &normal, &(normal_world));
 
-	IUINT32 cc = device_texture_read(device, u, v, device->texture_id[0]);
+	IUINT32 cc = device_texture_sample(device, 0, u, v, 0.0f);
 	float diffuse = vector_dotproduct(&direction, &cnormal);
 	if (diffuse >= 0.001)
 	{
@@ -233,7 +324,7 @@ IUINT32 shader_pixel_normal_texture_alpha(device_t* device, vertex_t* vertex)
 	float u = vertex->tc.u * w;
 	float v = vertex->tc.v * w;
 
-	IUINT32 cc = device_texture_read(device, u, v, device->texture_id[0]);
+	IUINT32 cc = device_texture_sample(device, 0, u, v, 0.0f);
 	IUINT32 texture_R = Get_R(cc);
 	IUINT32 texture_G = Get_G(cc);
 	IUINT32 texture_B = Get_B(cc);
@@ -259,39 +350,15 @@ IUINT32 shader_pixel_shadow_map(device_t* device, vertex_t* vertex)
 #endif
 }
 
-IUINT32 shader_pixel_texture_lambert_light_shadow(device_t* device, vertex_t* vertex)
+// 多个光源的兰伯特光照，漫反射相加；shadowed 时每个光源的漫反射乘以阴影图集中的比较结果
+static IUINT32 shader_lambert_lights(device_t* device, vertex_t* vertex, bool shadowed)
 {
-
-//	IUINT32 texture_R = 0;
-//	IUINT32 texture_G = 0;
-//	IUINT32 texture_B = IUINT32(255.0f * vertex->vs_result[0].z);
-//
-//#ifdef USE_GDI_VIEW
-//	return (texture_R << 16) | (texture_G << 8) | (texture_B);
-//#else
-//	return (texture_R << 24) | (texture_G << 16) | (texture_B << 8) | (default_alpha);
-//#endif
-
-
 	float w = 1.0f / vertex->rhw;
 
 	float u = vertex->tc.u * w;
 	float v = vertex->tc.v * w;
 
-	IUINT32 depth = device_texture_read(device,vertex->vs_result[0].x / device->framebuffer_width,vertex->vs_result[0].y / device->framebuffer_height,device->texture_id[1]);
-	float fDepth = (depth >> 8) / 255.0f;
-	float fShadow = 1.0f;
-	if (fDepth > 0.0f)
-	{
-		if (vertex->vs_result[0].z >= (fDepth + 0.01f))
-		{
-			fShadow = 0.6f;
-		}
-	}
-
 	vector_t normal = vertex->normal;
-	vector_t direction = device->uniform_vector[1];
-	vector_normalize(&direction);
 	vector_normalize(&normal);
 
 	matrix_t normal_world;
@@ -299,18 +366,55 @@ IUINT32 shader_pixel_texture_lambert_light_shadow(device_t* device, vertex_t* ve
 	vector_t cnormal;
 	matrix_apply(&cnormal, &normal, &(normal_world));
 
-	IUINT32 cc = device_texture_read(device, u, v, device->texture_id[0]);
-	float diffuse = vector_dotproduct(&direction, &cnormal);
-	if (diffuse >= 0.001)
+	float light_R = 0.0f;
+	float light_G = 0.0f;
+	float light_B = 0.0f;
+	bool lit = false;
+	int light_num = (int)device->uniform_vector[SHADOW_UNIFORM_LIGHT_NUM].x;
+	for (int i = 0; i < light_num; i++)
 	{
+		vector_t direction = device->uniform_vector[SHADOW_UNIFORM_DIRECTION(i)];
+		vector_normalize(&direction);
+		float diffuse = vector_dotproduct(&direction, &cnormal);
+		if (diffuse < 0.001)
+		{
+			continue;
+		}
+
+		float fShadow = 1.0f;
+		const vector_t *atlas_uv = &device->uniform_vector[SHADOW_UNIFORM_ATLAS_UV(i)];
+		if (shadowed && atlas_uv->x > 0.0f)
+		{
+			// 阴影图为光源视角深度缓存中的 rhw，光源空间顶点的 z/w 减去偏移后换算为 rhw 作为参考值
+			// m[3][2] 为负，rhw 小于参考值的纹素比该点更远，不遮挡该点；未绘制的纹素为 0，也不遮挡
+			const vector_t *atlas_clamp = &device->uniform_vector[SHADOW_UNIFORM_ATLAS_CLAMP(i)];
+			const matrix_t *projection = &device->transform.projection;
+			float fRef = (vertex->vs_result[i].z - 0.01f - projection->m[2][2]) / projection->m[3][2];
+			float fU = vertex->vs_result[i].x * atlas_uv->x + atlas_uv->z;
+			float fV = vertex->vs_result[i].y * atlas_uv->y + atlas_uv->w;
+			fU = fU < atlas_clamp->x ? atlas_clamp->x : (fU > atlas_clamp->z ? atlas_clamp->z : fU);
+			fV = fV < atlas_clamp->y ? atlas_clamp->y : (fV > atlas_clamp->w ? atlas_clamp->w : fV);
+			float fLit = device_texture_sample_compare(device, 1, fU, fV, fRef);
+			fShadow = 1.0f - 0.4f * (1.0f - fLit);
+		}
+
+		vector_t energy = device->uniform_vector[SHADOW_UNIFORM_ENERGY(i)];
+		light_R += diffuse * energy.x * fShadow;
+		light_G += diffuse * energy.y * fShadow;
+		light_B += diffuse * energy.z * fShadow;
+		lit = true;
+	}
+
+	if (lit)
+	{
+		IUINT32 cc = device_texture_sample(device, 0, u, v, 0.0f);
 		IUINT32 texture_R = Get_R(cc);
 		IUINT32 texture_G = Get_G(cc);
 		IUINT32 texture_B = Get_B(cc);
 
-		vector_t energy = device->uniform_vector[0];
-		IUINT32 diffuse_R = (IUINT32)(texture_R * diffuse * energy.x * fShadow);
-		IUINT32 diffuse_G = (IUINT32)(texture_G * diffuse * energy.y * fShadow);
-		IUINT32 diffuse_B = (IUINT32)(texture_B * diffuse * energy.z * fShadow);
+		IUINT32 diffuse_R = (IUINT32)(texture_R * light_R);
+		IUINT32 diffuse_G = (IUINT32)(texture_G * light_G);
+		IUINT32 diffuse_B = (IUINT32)(texture_B * light_B);
 
 		diffuse_R = CMID(diffuse_R, 0, 255);
 		diffuse_G = CMID(diffuse_G, 0, 255);
@@ -332,6 +436,16 @@ IUINT32 shader_pixel_texture_lambert_light_shadow(device_t* device, vertex_t* ve
 	}
 }
 
+IUINT32 shader_pixel_texture_lambert_light_shadow(device_t* device, vertex_t* vertex)
+{
+	return shader_lambert_lights(device, vertex, true);
+}
+
+IUINT32 shader_pixel_texture_lambert_light_no_shadow(device_t* device, vertex_t* vertex)
+{
+	return shader_lambert_lights(device, vertex, false);
+}
+
 IUINT32 shader_pixel_texture_blinn_light(device_t* device, vertex_t* vertex)
 {
 	float w = 1.0f / vertex->rhw;
@@ -350,7 +464,7 @@ IUINT32 shader_pixel_texture_blinn_light(device_t* device, vertex_t* vertex)
 	matrix_apply(&cnormal, &normal, &(normal_world));
 	vector_normalize(&cnormal);
 
-	IUINT32 cc = device_texture_read(device, u, v, device->texture_id[0]);
+	IUINT32 cc = device_texture_sample(device, 0, u, v, 0.0f);
 	float diffuse = vector_dotproduct(&direction, &cnormal);
 	if (diffuse >= 0.001)
 	{
@@ -416,42 +530,208 @@ IUINT32 shader_pixel_texture_blinn_light(device_t* device, vertex_t* vertex)
 	}
 }
 
-RenderComponent g_ShaderComponent[MAX_SHADER_STATE] = {
-	{ SHADER_STATE_WIREFRAME, shader_vertex_normal_mvp, NULL },
-	{ SHADER_STATE_TEXTURE, shader_vertex_normal_mvp, shader_pixel_normal_texture },
-	{ SHADER_STATE_COLOR, shader_vertex_normal_mvp, shader_pixel_normal_color },
-	{ SHADER_STATE_LAMBERT_LIGHT_TEXTURE, shader_vertex_normal_mvp, shader_pixel_texture_lambert_light },
-	{ SHADER_STATE_PHONG_LIGHT_TEXTURE, shader_vertex_phong_mvp, shader_pixel_texture_phong_light },
-	{ SHADER_STATE_TEXTURE_ALPHA , shader_vertex_normal_mvp, shader_pixel_normal_texture_alpha },
-	{ SHADER_STATE_SHADOW_MAP, shader_vertex_normal_mvp, shader_pixel_shadow_map },
-	{ SHADER_STATE_LIGHT_SHADOW, shader_vertex_shadow_map_mvp, shader_pixel_texture_lambert_light_shadow },
-	{ SHADER_STATE_BLINN_LIGHT_TEXTURE , shader_vertex_blinn_mvp, shader_pixel_texture_phong_light},
-};
+// 片元包着色器：一次计算 PIXEL_PACKET_SIZE 个片元，结果与逐片元的版本只有归一化和指数运算的舍入误差
+// 纹理按 2x2 像素块的导数选择 mipmap 层，纹理没有 mipmap 时与逐片元的版本读取相同的纹素
+#define PACKET_VECTOR(packet, member) vector_packet_load((packet)->f[VERTEX_FLOAT_INDEX(member.x)], (packet)->f[VERTEX_FLOAT_INDEX(member.y)], (packet)->f[VERTEX_FLOAT_INDEX(member.z)], (packet)->f[VERTEX_FLOAT_INDEX(member.w)])
+
+// 透视校正后的纹理坐标
+static void shader_packet_texcoord(const pixel_packet_t* packet, __m128* u, __m128* v)
+{
+	__m128 w = _mm_div_ps(_mm_set1_ps(1.0f), _mm_loadu_ps(packet->f[VERTEX_FLOAT_INDEX(rhw)]));
+	*u = _mm_mul_ps(_mm_loadu_ps(packet->f[VERTEX_FLOAT_INDEX(tc.u)]), w);
+	*v = _mm_mul_ps(_mm_loadu_ps(packet->f[VERTEX_FLOAT_INDEX(tc.v)]), w);
+}
+
+// 由 2x2 像素块内纹理坐标的导数计算 lod = log2(max(|d(uv)/dx|, |d(uv)/dy|))，单位为 level 0 的纹素
+// 只能在按像素块着色(PIXEL_SHADER_FLAG_DERIVATIVE)的着色器中使用
+static __m128 shader_packet_texture_lod(const device_t* device, __m128 u, __m128 v, int unit)
+{
+	const texture_t* texture = &device->texture_array[device->texture_id[unit]];
+	__m128 width = _mm_set1_ps((float)texture->width);
+	__m128 height = _mm_set1_ps((float)texture->height);
+	__m128 dudx = _mm_mul_ps(simd_quad_ddx(u), width);
+	__m128 dvdx = _mm_mul_ps(simd_quad_ddx(v), height);
+	__m128 dudy = _mm_mul_ps(simd_quad_ddy(u), width);
+	__m128 dvdy = _mm_mul_ps(simd_quad_ddy(v), height);
+	__m128 rho2 = _mm_max_ps(_mm_add_ps(_mm_mul_ps(dudx, dudx), _mm_mul_ps(dvdx, dvdx)), _mm_add_ps(_mm_mul_ps(dudy, dudy), _mm_mul_ps(dvdy, dvdy)));
+
+	// log2(sqrt(rho2)) = ln(rho2) * 0.5 / ln(2)
+	return _mm_mul_ps(simd_log(rho2), _mm_set1_ps(0.72134752f));
+}
 
-func_pixel_shader get_pixel_shader(device_t* device)
+// 纹理读取不能向量化，逐个读取有效片元的纹理
+static void shader_packet_texture_read(const device_t* device, const pixel_packet_t* packet, __m128 u, __m128 v, __m128 lod, int unit, __m128* r, __m128* g, __m128* b)
 {
-	int i;
-	for (i = 0; i < MAX_SHADER_STATE; i++)
+	float us[PIXEL_PACKET_SIZE], vs[PIXEL_PACKET_SIZE], lods[PIXEL_PACKET_SIZE];
+	float rs[PIXEL_PACKET_SIZE] = { 0 }, gs[PIXEL_PACKET_SIZE] = { 0 }, bs[PIXEL_PACKET_SIZE] = { 0 };
+	_mm_storeu_ps(us, u);
+	_mm_storeu_ps(vs, v);
+	_mm_storeu_ps(lods, lod);
+	for (int lane = 0; lane < PIXEL_PACKET_SIZE; lane++)
 	{
-		if (device->shader_state == g_ShaderComponent[i].RenderState)
+		if ((packet->mask >> lane) & 1)
 		{
-			return g_ShaderComponent[i].p_pixel_shader;
+			IUINT32 cc = device_texture_sample(device, unit, us[lane], vs[lane], lods[lane]);
+			rs[lane] = (float)Get_R(cc);
+			gs[lane] = (float)Get_G(cc);
+			bs[lane] = (float)Get_B(cc);
 		}
 	}
+	*r = _mm_loadu_ps(rs);
+	*g = _mm_loadu_ps(gs);
+	*b = _mm_loadu_ps(bs);
+}
 
-	return NULL;
+// 世界空间下的法线，与逐片元版本相同，法线先归一化再乘以 worldInv 的转置
+static vector_packet_t shader_packet_world_normal(device_t* device, const pixel_packet_t* packet)
+{
+	vector_packet_t normal = PACKET_VECTOR(packet, normal);
+	vector_packet_normalize(&normal);
+
+	matrix_t normal_world;
+	matrix_transpose(&(device->transform.worldInv), &normal_world);
+	vector_packet_t cnormal;
+	vector_packet_apply(&cnormal, &normal, &normal_world);
+	return cnormal;
 }
 
-func_vertex_shader get_vertex_shader(device_t* device)
+// 截断到 [0, 255] 后取整，等价于先取整再 CMID
+static inline __m128i shader_packet_color_channel(__m128 x)
 {
-	int i;
-	for (i = 0; i < MAX_SHADER_STATE; i++)
+	return _mm_cvttps_epi32(_mm_min_ps(_mm_max_ps(x, _mm_setzero_ps()), _mm_set1_ps(255.0f)));
+}
+
+static void shader_packet_pack_color(__m128 r, __m128 g, __m128 b, IUINT32* colors)
+{
+	__m128i R = shader_packet_color_channel(r);
+	__m128i G = shader_packet_color_channel(g);
+	__m128i B = shader_packet_color_channel(b);
+
+#ifdef USE_GDI_VIEW
+	__m128i color = _mm_or_si128(_mm_or_si128(_mm_slli_epi32(R, 16), _mm_slli_epi32(G, 8)), B);
+#else
+	__m128i color = _mm_or_si128(_mm_or_si128(_mm_slli_epi32(R, 24), _mm_slli_epi32(G, 16)), _mm_or_si128(_mm_slli_epi32(B, 8), _mm_set1_epi32(default_alpha)));
+#endif
+	_mm_storeu_si128((__m128i*)colors, color);
+}
+
+void shader_pixel_normal_texture_packet(device_t* device, const pixel_packet_t* packet, IUINT32* colors)
+{
+	__m128 u, v;
+	shader_packet_texcoord(packet, &u, &v);
+
+	__m128 texture_R, texture_G, texture_B;
+	__m128 lod = shader_packet_texture_lod(device, u, v, 0);
+	shader_packet_texture_read(device, packet, u, v, lod, 0, &texture_R, &texture_G, &texture_B);
+	shader_packet_pack_color(texture_R, texture_G, texture_B, colors);
+}
+
+void shader_pixel_texture_lambert_light_packet(device_t* device, const pixel_packet_t* packet, IUINT32* colors)
+{
+	__m128 u, v;
+	shader_packet_texcoord(packet, &u, &v);
+
+	vector_t direction = device->uniform_vector[1];
+	vector_normalize(&direction);
+	vector_packet_t light = vector_packet_set(&direction);
+	vector_packet_t cnormal = shader_packet_world_normal(device, packet);
+
+	__m128 texture_R, texture_G, texture_B;
+	__m128 lod = shader_packet_texture_lod(device, u, v, 0);
+	shader_packet_texture_read(device, packet, u, v, lod, 0, &texture_R, &texture_G, &texture_B);
+
+	// 背光的片元输出黑色
+	__m128 diffuse = vector_packet_dotproduct(&light, &cnormal);
+	__m128 lit = _mm_cmpge_ps(diffuse, _mm_set1_ps(0.001f));
+	diffuse = _mm_and_ps(diffuse, lit);
+
+	const vector_t* energy = &device->uniform_vector[0];
+	__m128 diffuse_R = simd_trunc(_mm_mul_ps(_mm_mul_ps(texture_R, diffuse), _mm_set1_ps(energy->x)));
+	__m128 diffuse_G = simd_trunc(_mm_mul_ps(_mm_mul_ps(texture_G, diffuse), _mm_set1_ps(energy->y)));
+	__m128 diffuse_B = simd_trunc(_mm_mul_ps(_mm_mul_ps(texture_B, diffuse), _mm_set1_ps(energy->z)));
+	shader_packet_pack_color(diffuse_R, diffuse_G, diffuse_B, colors);
+}
+
+// 漫反射和镜面反射的合成，spec 为 0 的片元只有漫反射
+static void shader_packet_lighting(device_t* device, __m128 texture_R, __m128 texture_G, __m128 texture_B, __m128 diffuse, __m128 spec, __m128 lit, IUINT32* colors)
+{
+	const vector_t* energy = &device->uniform_vector[0];
+	__m128 energy_R = _mm_set1_ps(energy->x);
+	__m128 energy_G = _mm_set1_ps(energy->y);
+	__m128 energy_B = _mm_set1_ps(energy->z);
+
+	vector_t matrial = device->uniform_vector[3];
+	__m128 kD = _mm_set1_ps(matrial.x);
+	__m128 kS = _mm_set1_ps(matrial.y);
+	__m128 kQ = _mm_set1_ps(matrial.z);
+
+	// 背向视线的镜面反射为 0，x 为 0 时 simd_pow 也为 0
+	spec = simd_pow(spec, kQ);
+
+	__m128 diffuse_R = simd_trunc(_mm_mul_ps(_mm_mul_ps(texture_R, diffuse), energy_R));
+	__m128 diffuse_G = simd_trunc(_mm_mul_ps(_mm_mul_ps(texture_G, diffuse), energy_G));
+	__m128 diffuse_B = simd_trunc(_mm_mul_ps(_mm_mul_ps(texture_B, diffuse), energy_B));
+	__m128 spec_R = simd_trunc(_mm_mul_ps(_mm_mul_ps(texture_R, spec), energy_R));
+	__m128 spec_G = simd_trunc(_mm_mul_ps(_mm_mul_ps(texture_G, spec), energy_G));
+	__m128 spec_B = simd_trunc(_mm_mul_ps(_mm_mul_ps(texture_B, spec), energy_B));
+
+	__m128 R = _mm_and_ps(_mm_add_ps(_mm_mul_ps(diffuse_R, kD), _mm_mul_ps(spec_R, kS)), lit);
+	__m128 G = _mm_and_ps(_mm_add_ps(_mm_mul_ps(diffuse_G, kD), _mm_mul_ps(spec_G, kS)), lit);
+	__m128 B = _mm_and_ps(_mm_add_ps(_mm_mul_ps(diffuse_B, kD), _mm_mul_ps(spec_B, kS)), lit);
+	shader_packet_pack_color(R, G, B, colors);
+}
+
+void shader_pixel_texture_phong_light_packet(device_t* device, const pixel_packet_t* packet, IUINT32* colors)
+{
+	__m128 u, v;
+	shader_packet_texcoord(packet, &u, &v);
+
+	vector_t direction = device->uniform_vector[1];
+	vector_normalize(&direction);
+	vector_packet_t light = vector_packet_set(&direction);
+	vector_packet_t cnormal = shader_packet_world_normal(device, packet);
+
+	__m128 texture_R, texture_G, texture_B;
+	__m128 lod = shader_packet_texture_lod(device, u, v, 0);
+	shader_packet_texture_read(device, packet, u, v, lod, 0, &texture_R, &texture_G, &texture_B);
+
+	__m128 diffuse = vector_packet_dotproduct(&light, &cnormal);
+	__m128 lit = _mm_cmpge_ps(diffuse, _mm_set1_ps(0.001f));
+
+	vector_packet_t vec_spec = cnormal;
+	vector_packet_scale(&vec_spec, _mm_mul_ps(_mm_set1_ps(2.0f), diffuse));
+	vector_packet_sub(&vec_spec, &vec_spec, &light);
+	vector_packet_normalize(&vec_spec);
+
+	vector_packet_t eye_view = PACKET_VECTOR(packet, vs_result[0]);
+	vector_packet_normalize(&eye_view);
+
+	__m128 spec = vector_packet_dotproduct(&eye_view, &vec_spec);
+	shader_packet_lighting(device, texture_R, texture_G, texture_B, diffuse, spec, lit, colors);
+}
+
+RenderComponent g_ShaderComponent[MAX_SHADER_STATE] = {
+	{ SHADER_STATE_WIREFRAME, shader_vertex_normal_mvp, NULL, 0, 0, NULL, 0, shader_vertex_normal_mvp_batch, NULL },
+	{ SHADER_STATE_TEXTURE, shader_vertex_normal_mvp, shader_pixel_normal_texture, VARYING_TEXCOORD, TEXTURE_UNIT_MASK(0), shader_pixel_normal_texture_packet, PIXEL_SHADER_FLAG_DERIVATIVE, shader_vertex_normal_mvp_batch, NULL },
+	{ SHADER_STATE_COLOR, shader_vertex_normal_mvp, shader_pixel_normal_color, VARYING_COLOR, 0, NULL, 0, shader_vertex_normal_mvp_batch, NULL },
+	{ SHADER_STATE_LAMBERT_LIGHT_TEXTURE, shader_vertex_normal_mvp, shader_pixel_texture_lambert_light, VARYING_TEXCOORD | VARYING_NORMAL, TEXTURE_UNIT_MASK(0), shader_pixel_texture_lambert_light_packet, PIXEL_SHADER_FLAG_DERIVATIVE, shader_vertex_normal_mvp_batch, NULL },
+	{ SHADER_STATE_PHONG_LIGHT_TEXTURE, shader_vertex_phong_mvp, shader_pixel_texture_phong_light, VARYING_TEXCOORD | VARYING_NORMAL | VARYING_VS_RESULT(0), TEXTURE_UNIT_MASK(0), shader_pixel_texture_phong_light_packet, PIXEL_SHADER_FLAG_DERIVATIVE, shader_vertex_normal_mvp_batch, shader_vertex_eye_attribute },
+	{ SHADER_STATE_TEXTURE_ALPHA, shader_vertex_normal_mvp, shader_pixel_normal_texture_alpha, VARYING_TEXCOORD, TEXTURE_UNIT_MASK(0), NULL, 0, shader_vertex_normal_mvp_batch, NULL },
+	{ SHADER_STATE_SHADOW_MAP, shader_vertex_normal_mvp, shader_pixel_shadow_map, VARYING_POSITION, 0, NULL, 0, shader_vertex_normal_mvp_batch, NULL },
+	{ SHADER_STATE_LIGHT_SHADOW, shader_vertex_shadow_map_mvp, shader_pixel_texture_lambert_light_shadow, VARYING_TEXCOORD | VARYING_NORMAL | VARYING_VS_RESULT(0) | VARYING_VS_RESULT(1), TEXTURE_UNIT_MASK(0) | TEXTURE_UNIT_MASK(1), NULL, 0, shader_vertex_normal_mvp_batch, shader_vertex_shadow_map_attribute },
+	{ SHADER_STATE_BLINN_LIGHT_TEXTURE, shader_vertex_blinn_mvp, shader_pixel_texture_phong_light, VARYING_TEXCOORD | VARYING_NORMAL | VARYING_VS_RESULT(0), TEXTURE_UNIT_MASK(0), shader_pixel_texture_phong_light_packet, PIXEL_SHADER_FLAG_DERIVATIVE, shader_vertex_normal_mvp_batch, shader_vertex_eye_attribute },
+	{ SHADER_STATE_LIGHT_NO_SHADOW, shader_vertex_normal_mvp, shader_pixel_texture_lambert_light_no_shadow, VARYING_TEXCOORD | VARYING_NORMAL, TEXTURE_UNIT_MASK(0), NULL, 0, shader_vertex_normal_mvp_batch, NULL },
+};
+
+const RenderComponent* get_render_component(device_t* device)
+{
+	for (int i = 0; i < MAX_SHADER_STATE; i++)
 	{
-		if (device->shader_state == g_ShaderComponent[i].RenderState)
+		if ((IUINT32)device->shader_state == g_ShaderComponent[i].RenderState)
 		{
-			return g_ShaderComponent[i].p_vertex_shader;
+			return &g_ShaderComponent[i];
 		}
 	}
 
 	return NULL;
-}
\ No newline at end of file
+}
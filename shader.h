@@ -2,8 +2,28 @@
 
 #include "device.h"
 
-typedef void(*func_vertex_shader)(device_t* device, vertex_t* vertex, point_t* output);
-typedef IUINT32 (*func_pixel_shader)(device_t* device, vertex_t* vertex);
+#define PIXEL_SHADER_FLAG_DERIVATIVE	1	// 片元包着色器使用 ddx/ddy，光栅化按 2x2 像素块生成片元包
 
-func_pixel_shader get_pixel_shader(device_t* device);
-func_vertex_shader get_vertex_shader(device_t* device);
\ No newline at end of file
+// 光照阴影的 uniform：光源 i 的光源变换矩阵为 uniform_matrix[i]，所有光源的阴影图在同一个图集中，绑定在纹理单元 1
+#define MAX_SHADOW_LIGHT_NUM			2	// 每个光源的光源空间坐标占一个 vs_result
+#define SHADOW_UNIFORM_LIGHT_NUM		0	// x 为光源数
+#define SHADOW_UNIFORM_ENERGY(i)		(1 + 4 * (i))	// 入射光强
+#define SHADOW_UNIFORM_DIRECTION(i)		(2 + 4 * (i))	// 入射光方向
+#define SHADOW_UNIFORM_ATLAS_UV(i)		(3 + 4 * (i))	// 阴影图纹理坐标到图集的变换 (u * x + z, v * y + w)，x 为 0 时不查找该光源的阴影
+#define SHADOW_UNIFORM_ATLAS_CLAMP(i)	(4 + 4 * (i))	// 图集纹理坐标的范围 (u0, v0, u1, v1)
+
+// 一种 shader_state 使用的着色器，device_create_pipeline_state 从中读取管线状态
+typedef struct {
+	IUINT32 RenderState;
+	func_vertex_shader p_vertex_shader;
+	func_pixel_shader p_pixel_shader;
+	int varying_mask;	// 片元着色器读取的插值属性
+	int texture_mask;	// 片元着色器读取的纹理单元
+	func_pixel_shader_packet p_pixel_shader_packet;	// 一次着色多个片元的版本，可以为 NULL
+	int pixel_shader_flags;	// PIXEL_SHADER_FLAG_*
+	func_vertex_shader_batch p_vertex_position;	// 顶点着色器的位置部分，与属性部分合起来等同于 p_vertex_shader，可以为 NULL
+	func_vertex_attribute_shader p_vertex_attribute;	// 顶点着色器的属性部分，只输出位置时为 NULL
+} RenderComponent;
+
+// shader_state 没有对应的组件时返回 NULL
+const RenderComponent* get_render_component(device_t* device);
@@ -0,0 +1,133 @@
+#include <string.h>
+
+#include "shadow_atlas.h"
+
+void shadow_atlas_init(shadow_atlas_t *atlas, int size)
+{
+	atlas->size = size;
+	memset(atlas->node_state, SHADOW_ATLAS_NODE_FREE, sizeof(atlas->node_state));
+}
+
+// 在 node 的子树中查找 target 层的空闲节点
+static int shadow_atlas_find(shadow_atlas_t *atlas, int node, int level, int target)
+{
+	unsigned char state = atlas->node_state[node];
+	if (state == SHADOW_ATLAS_NODE_USED)
+	{
+		return -1;
+	}
+
+	if (level == target)
+	{
+		if (state != SHADOW_ATLAS_NODE_FREE)
+		{
+			return -1;
+		}
+		atlas->node_state[node] = SHADOW_ATLAS_NODE_USED;
+		return node;
+	}
+
+	if (state == SHADOW_ATLAS_NODE_FREE)
+	{
+		// 空闲节点的子节点都是空闲的，拆分后使用第一个子节点
+		atlas->node_state[node] = SHADOW_ATLAS_NODE_SPLIT;
+		return shadow_atlas_find(atlas, 4 * node + 1, level + 1, target);
+	}
+
+	// 先在已拆分的子节点中查找，保留完整的空闲节点给更大的阴影图
+	for (int pass = 0; pass < 2; pass++)
+	{
+		for (int k = 0; k < 4; k++)
+		{
+			int child = 4 * node + 1 + k;
+			if ((atlas->node_state[child] == SHADOW_ATLAS_NODE_SPLIT) != (pass == 0))
+			{
+				continue;
+			}
+			int slot = shadow_atlas_find(atlas, child, level + 1, target);
+			if (slot >= 0)
+			{
+				return slot;
+			}
+		}
+	}
+	return -1;
+}
+
+int shadow_atlas_alloc(shadow_atlas_t *atlas, int size)
+{
+	if (size <= 0 || size > atlas->size)
+	{
+		return -1;
+	}
+
+	int level = 0;
+	while (level + 1 < SHADOW_ATLAS_LEVEL_NUM && (atlas->size >> (level + 1)) >= size)
+	{
+		level++;
+	}
+	return shadow_atlas_find(atlas, 0, 0, level);
+}
+
+void shadow_atlas_free(shadow_atlas_t *atlas, int slot)
+{
+	if (slot < 0 || slot >= SHADOW_ATLAS_NODE_NUM || atlas->node_state[slot] != SHADOW_ATLAS_NODE_USED)
+	{
+		return;
+	}
+
+	// 4 个子节点都空闲时合并为空闲的父节点
+	atlas->node_state[slot] = SHADOW_ATLAS_NODE_FREE;
+	while (slot > 0)
+	{
+		int parent = (slot - 1) / 4;
+		for (int k = 0; k < 4; k++)
+		{
+			if (atlas->node_state[4 * parent + 1 + k] != SHADOW_ATLAS_NODE_FREE)
+			{
+				return;
+			}
+		}
+		atlas->node_state[parent] = SHADOW_ATLAS_NODE_FREE;
+		slot = parent;
+	}
+}
+
+void shadow_atlas_get_rect(const shadow_atlas_t *atlas, int slot, int *x, int *y, int *size)
+{
+	int level = 0;
+	for (int node = slot; node > 0; node = (node - 1) / 4)
+	{
+		level++;
+	}
+
+	// 子节点 k 的第 0 位为列，第 1 位为行
+	int s = atlas->size >> level;
+	*x = 0;
+	*y = 0;
+	*size = s;
+	for (int node = slot; node > 0; node = (node - 1) / 4, s <<= 1)
+	{
+		int k = (node - 1) % 4;
+		*x += (k & 1) * s;
+		*y += (k >> 1) * s;
+	}
+}
+
+void shadow_atlas_get_uv_transform(const shadow_atlas_t *atlas, int slot, int border, vector_t *transform, vector_t *clamp)
+{
+	int x, y, size;
+	shadow_atlas_get_rect(atlas, slot, &x, &y, &size);
+
+	// CLAMP 时纹素 i 的中心位于 i / (size - 1)
+	float rcp = 1.0f / (float)(atlas->size - 1);
+	transform->x = (float)(size - 1) * rcp;
+	transform->y = (float)(size - 1) * rcp;
+	transform->z = (float)x * rcp;
+	transform->w = (float)y * rcp;
+
+	clamp->x = (float)(x + border) * rcp;
+	clamp->y = (float)(y + border) * rcp;
+	clamp->z = (float)(x + size - 1 - border) * rcp;
+	clamp->w = (float)(y + size - 1 - border) * rcp;
+}
@@ -0,0 +1,33 @@
+#pragma once
+
+#include "mathlib.h"
+
+//=====================================================================
+// 阴影图集：多个光源的阴影图分配在同一个深度缓存中，每个阴影图为边长是 2 的幂的正方形
+// 按四叉树分配，节点 0 为整个图集，节点 i 的子节点为 4i+1 ~ 4i+4，最小的区域为图集边长的 1/16
+//=====================================================================
+
+#define SHADOW_ATLAS_LEVEL_NUM 5
+#define SHADOW_ATLAS_NODE_NUM ((1 << (2 * SHADOW_ATLAS_LEVEL_NUM)) / 3)	// 1 + 4 + 16 + 64 + 256
+
+#define SHADOW_ATLAS_NODE_FREE	0
+#define SHADOW_ATLAS_NODE_SPLIT	1	// 部分子节点已分配
+#define SHADOW_ATLAS_NODE_USED	2
+
+typedef struct {
+	int size;	// 图集边长，2 的幂
+	unsigned char node_state[SHADOW_ATLAS_NODE_NUM];
+} shadow_atlas_t;
+
+void shadow_atlas_init(shadow_atlas_t *atlas, int size);
+
+// 分配边长不小于 size 的区域，优先使用已拆分的节点，返回区域的编号，没有空间时返回 -1
+int shadow_atlas_alloc(shadow_atlas_t *atlas, int size);
+void shadow_atlas_free(shadow_atlas_t *atlas, int slot);
+
+// 区域在图集中的像素位置和边长
+void shadow_atlas_get_rect(const shadow_atlas_t *atlas, int slot, int *x, int *y, int *size);
+
+// 阴影图纹理坐标 [0, 1] 到图集纹理坐标的变换 (u * x + z, v * y + w)，CLAMP 时纹素中心与单独的阴影图一致
+// clamp 为图集纹理坐标的范围 (u0, v0, u1, v1)，向内收缩 border 个纹素，过滤核读取的纹素不越过该区域
+void shadow_atlas_get_uv_transform(const shadow_atlas_t *atlas, int slot, int border, vector_t *transform, vector_t *clamp);
@@ -0,0 +1,1079 @@
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <float.h>
+#include <emmintrin.h>
+
+#include "texture.h"
+#include "texture_bc.h"
+#include "mathlib_simd.h"
+
+#ifdef TEXTURE_FETCH_STATS
+#define TEXTURE_CACHE_LINE_SHIFT 6
+#define TEXTURE_CACHE_SET_NUM 64
+#define TEXTURE_CACHE_WAY_NUM 8
+
+static size_t texture_cache_tag[TEXTURE_CACHE_SET_NUM][TEXTURE_CACHE_WAY_NUM];
+static long long texture_cache_age[TEXTURE_CACHE_SET_NUM][TEXTURE_CACHE_WAY_NUM];
+static texture_fetch_stats_t texture_fetch_stats;
+
+// 组内按最近最少使用替换
+static inline void texture_trace_fetch(const void *texel)
+{
+	size_t line = (size_t)texel >> TEXTURE_CACHE_LINE_SHIFT;
+	size_t *tag = texture_cache_tag[line % TEXTURE_CACHE_SET_NUM];
+	long long *age = texture_cache_age[line % TEXTURE_CACHE_SET_NUM];
+	long long now = ++texture_fetch_stats.fetch_num;
+	int victim = 0;
+	for (int way = 0; way < TEXTURE_CACHE_WAY_NUM; way++)
+	{
+		if (tag[way] == line)
+		{
+			age[way] = now;
+			return;
+		}
+		if (age[way] < age[victim])
+		{
+			victim = way;
+		}
+	}
+	tag[victim] = line;
+	age[victim] = now;
+	texture_fetch_stats.miss_num++;
+}
+
+void texture_reset_fetch_stats()
+{
+	memset(texture_cache_tag, 0, sizeof(texture_cache_tag));
+	memset(texture_cache_age, 0, sizeof(texture_cache_age));
+	memset(&texture_fetch_stats, 0, sizeof(texture_fetch_stats));
+}
+
+texture_fetch_stats_t texture_get_fetch_stats()
+{
+	return texture_fetch_stats;
+}
+
+#define TEXTURE_TRACE_FETCH(texel) texture_trace_fetch(texel)
+#else
+#define TEXTURE_TRACE_FETCH(texel)
+#endif
+
+// 每个线程缓存最近解码的压缩块，按块坐标的低 4 位直接映射，64x64 纹素以内的块互不冲突
+#define TEXTURE_BLOCK_CACHE_SHIFT 4
+#define TEXTURE_BLOCK_CACHE_SIZE (1 << (2 * TEXTURE_BLOCK_CACHE_SHIFT))
+
+typedef struct {
+	const IUINT32 *block;
+	IUINT32 texels[TEXTURE_TILE_SIZE * TEXTURE_TILE_SIZE];
+} texture_block_cache_entry_t;
+
+typedef struct {
+	int generation;
+	texture_block_cache_entry_t entry[TEXTURE_BLOCK_CACHE_SIZE];
+} texture_block_cache_t;
+
+// 压缩数据被释放时加 1，各线程的缓存在下次读取时清空，之后新分配的块可能与旧块地址相同
+// 纹理只在光栅化线程空闲时修改，读取不需要同步
+static int texture_block_generation = 1;
+static thread_local texture_block_cache_t texture_block_cache;
+
+// 每个纹素的字节数，块压缩格式为 0
+static inline int texture_texel_bytes(int format)
+{
+	switch (format)
+	{
+	case TEXTURE_FORMAT_RGBA8:
+	case TEXTURE_FORMAT_R32F:
+		return 4;
+	case TEXTURE_FORMAT_RG8:
+	case TEXTURE_FORMAT_RGB565:
+	case TEXTURE_FORMAT_R16F:
+		return 2;
+	case TEXTURE_FORMAT_R8:
+		return 1;
+	}
+	return 0;
+}
+
+static inline bool texture_format_is_compressed(int format)
+{
+	return format == TEXTURE_FORMAT_BC1 || format == TEXTURE_FORMAT_BC3;
+}
+
+static inline bool texture_format_is_float(int format)
+{
+	return format == TEXTURE_FORMAT_R16F || format == TEXTURE_FORMAT_R32F;
+}
+
+// 第 y 行第 x 列纹素的地址，bytes 为每个纹素的字节数
+static inline IUINT8 *texture_level_address(const texture_level_t *level, int layout, int bytes, int x, int y)
+{
+	if (layout == TEXTURE_LAYOUT_TILED)
+	{
+		const int tile_mask = TEXTURE_TILE_SIZE - 1;
+		int tile_x = x >> TEXTURE_TILE_SHIFT;
+		int tile_y = y >> TEXTURE_TILE_SHIFT;
+		int offset = (tile_x << (2 * TEXTURE_TILE_SHIFT)) + ((y & tile_mask) << TEXTURE_TILE_SHIFT) + (x & tile_mask);
+		return (IUINT8*)(level->bits + tile_y * level->pitch) + offset * bytes;
+	}
+	return (IUINT8*)(level->bits + y * level->pitch) + x * bytes;
+}
+
+// RGBA8 纹素的地址
+static inline IUINT32 *texture_level_texel(const texture_level_t *level, int layout, int x, int y)
+{
+	return (IUINT32*)texture_level_address(level, layout, sizeof(IUINT32), x, y);
+}
+
+// 一个纹素块占用的 IUINT32 数
+static inline int texture_block_words(int format)
+{
+	if (format == TEXTURE_FORMAT_BC1)
+	{
+		return BC1_BLOCK_SIZE / sizeof(IUINT32);
+	}
+	if (format == TEXTURE_FORMAT_BC3)
+	{
+		return BC3_BLOCK_SIZE / sizeof(IUINT32);
+	}
+	return TEXTURE_TILE_SIZE * TEXTURE_TILE_SIZE * texture_texel_bytes(format) / sizeof(IUINT32);
+}
+
+// 半精度浮点转为单精度
+static inline float texture_half_to_float(unsigned short h)
+{
+	IUINT32 sign = (IUINT32)(h & 0x8000) << 16;
+	IUINT32 exponent = (h >> 10) & 0x1f;
+	IUINT32 mantissa = h & 0x3ff;
+	IUINT32 bits;
+	if (exponent == 0x1f)
+	{
+		bits = sign | 0x7f800000 | (mantissa << 13);	// 无穷大和 NaN
+	}
+	else if (exponent != 0)
+	{
+		bits = sign | ((exponent + 127 - 15) << 23) | (mantissa << 13);
+	}
+	else
+	{
+		// 非规格化数为 mantissa * 2^-24
+		float f = (float)mantissa * (1.0f / 16777216.0f);
+		return sign ? -f : f;
+	}
+
+	float f;
+	memcpy(&f, &bits, sizeof(f));
+	return f;
+}
+
+// 单精度转为半精度，舍入到最近的偶数，超出范围时为无穷大
+static unsigned short texture_float_to_half(float f)
+{
+	IUINT32 bits;
+	memcpy(&bits, &f, sizeof(bits));
+	IUINT32 sign = (bits >> 16) & 0x8000;
+	IUINT32 mantissa = bits & 0x7fffff;
+	int exponent = (int)((bits >> 23) & 0xff) - 127 + 15;
+	if (((bits >> 23) & 0xff) == 0xff)
+	{
+		return (unsigned short)(sign | 0x7c00 | (mantissa ? 0x200 : 0));
+	}
+	if (exponent >= 0x1f)
+	{
+		return (unsigned short)(sign | 0x7c00);
+	}
+
+	int shift = 13;
+	IUINT32 half;
+	if (exponent <= 0)
+	{
+		// 非规格化数，补上隐含的 1 后右移
+		if (exponent < -10)
+		{
+			return (unsigned short)sign;
+		}
+		mantissa |= 0x800000;
+		shift = 14 - exponent;
+		half = mantissa >> shift;
+	}
+	else
+	{
+		half = ((IUINT32)exponent << 10) | (mantissa >> shift);
+	}
+
+	// 进位可以进到指数，最大的有限数进位后即无穷大
+	IUINT32 rem = mantissa & ((1u << shift) - 1);
+	IUINT32 mid = 1u << (shift - 1);
+	if (rem > mid || (rem == mid && (half & 1)))
+	{
+		half++;
+	}
+	return (unsigned short)(sign | half);
+}
+
+// 浮点格式的纹素
+static inline float texture_unpack_float(int format, const IUINT8 *texel)
+{
+	if (format == TEXTURE_FORMAT_R16F)
+	{
+		return texture_half_to_float((unsigned short)(texel[0] | (texel[1] << 8)));
+	}
+	float f;
+	memcpy(&f, texel, sizeof(f));
+	return f;
+}
+
+static inline void texture_pack_float(int format, IUINT8 *texel, float f)
+{
+	if (format == TEXTURE_FORMAT_R16F)
+	{
+		unsigned short h = texture_float_to_half(f);
+		texel[0] = (IUINT8)(h & 0xff);
+		texel[1] = (IUINT8)(h >> 8);
+		return;
+	}
+	memcpy(texel, &f, sizeof(f));
+}
+
+// 非压缩格式的纹素展开为 RGBA8，缺少的颜色通道为 0，透明度为 255，浮点截断到 [0, 1]
+static inline IUINT32 texture_unpack_texel(int format, const IUINT8 *texel)
+{
+	switch (format)
+	{
+	case TEXTURE_FORMAT_R8:
+		return ((IUINT32)texel[0] << 24) | 0xff;
+	case TEXTURE_FORMAT_RG8:
+		return ((IUINT32)texel[0] << 24) | ((IUINT32)texel[1] << 16) | 0xff;
+	case TEXTURE_FORMAT_RGB565:
+		return texture_rgb565_unpack(texel[0] | (texel[1] << 8));
+	case TEXTURE_FORMAT_R16F:
+	case TEXTURE_FORMAT_R32F:
+		{
+			float f = texture_unpack_float(format, texel);
+			int r = f > 0.0f ? (f < 1.0f ? (int)(f * 255.0f + 0.5f) : 255) : 0;
+			return ((IUINT32)r << 24) | 0xff;
+		}
+	}
+
+	IUINT32 c;
+	memcpy(&c, texel, sizeof(c));
+	return c;
+}
+
+static inline void texture_pack_texel(int format, IUINT8 *texel, IUINT32 c)
+{
+	switch (format)
+	{
+	case TEXTURE_FORMAT_R8:
+		texel[0] = (IUINT8)(c >> 24);
+		return;
+	case TEXTURE_FORMAT_RG8:
+		texel[0] = (IUINT8)(c >> 24);
+		texel[1] = (IUINT8)(c >> 16);
+		return;
+	case TEXTURE_FORMAT_RGB565:
+		{
+			int rgb = texture_rgb565_pack((c >> 24) & 0xff, (c >> 16) & 0xff, (c >> 8) & 0xff);
+			texel[0] = (IUINT8)(rgb & 0xff);
+			texel[1] = (IUINT8)(rgb >> 8);
+		}
+		return;
+	case TEXTURE_FORMAT_R16F:
+	case TEXTURE_FORMAT_R32F:
+		texture_pack_float(format, texel, (float)(c >> 24) * (1.0f / 255.0f));
+		return;
+	}
+	memcpy(texel, &c, sizeof(c));
+}
+
+// 一层数据占用的 IUINT32 数，TILED 时宽高补齐到纹素块的整数倍
+static long texture_level_size(int w, int h, int layout, int format)
+{
+	if (layout == TEXTURE_LAYOUT_TILED)
+	{
+		long tile_num = (long)((w + TEXTURE_TILE_SIZE - 1) >> TEXTURE_TILE_SHIFT) * ((h + TEXTURE_TILE_SIZE - 1) >> TEXTURE_TILE_SHIFT);
+		return tile_num * texture_block_words(format);
+	}
+	return (long)h * ((w * texture_texel_bytes(format) + 3) / 4);
+}
+
+static int texture_level_pitch(int w, int layout, int format)
+{
+	if (layout == TEXTURE_LAYOUT_TILED)
+	{
+		return ((w + TEXTURE_TILE_SIZE - 1) >> TEXTURE_TILE_SHIFT) * texture_block_words(format);
+	}
+	return (w * texture_texel_bytes(format) + 3) / 4;	// 每行补齐到 4 字节
+}
+
+// 压缩格式第 y 行第 x 列纹素所在的块
+static inline const IUINT32 *texture_level_block(const texture_level_t *level, int format, int x, int y)
+{
+	return level->bits + (y >> TEXTURE_TILE_SHIFT) * level->pitch + (x >> TEXTURE_TILE_SHIFT) * texture_block_words(format);
+}
+
+// 按行排列的 width x height 纹素压缩为 level 的各块，不满 4x4 的块重复最后一行和最后一列
+static void texture_level_encode(texture_level_t *level, int format, const IUINT32 *src, long src_pitch)
+{
+	IUINT32 texels[TEXTURE_TILE_SIZE * TEXTURE_TILE_SIZE];
+	for (int y = 0; y < level->height; y += TEXTURE_TILE_SIZE)
+	{
+		for (int x = 0; x < level->width; x += TEXTURE_TILE_SIZE)
+		{
+			for (int j = 0; j < TEXTURE_TILE_SIZE; j++)
+			{
+				const IUINT32 *row = src + (y + j < level->height ? y + j : level->height - 1) * src_pitch;
+				for (int i = 0; i < TEXTURE_TILE_SIZE; i++)
+				{
+					texels[(j << TEXTURE_TILE_SHIFT) + i] = row[x + i < level->width ? x + i : level->width - 1];
+				}
+			}
+
+			IUINT8 *block = (IUINT8*)texture_level_block(level, format, x, y);
+			if (format == TEXTURE_FORMAT_BC1)
+			{
+				texture_bc1_encode_block(texels, block);
+			}
+			else
+			{
+				texture_bc3_encode_block(texels, block);
+			}
+		}
+	}
+}
+
+static inline void texture_decode_block(const IUINT32 *block, int format, IUINT32 texels[16])
+{
+	if (format == TEXTURE_FORMAT_BC1)
+	{
+		texture_bc1_decode_block((const IUINT8*)block, texels);
+	}
+	else
+	{
+		texture_bc3_decode_block((const IUINT8*)block, texels);
+	}
+}
+
+// 压缩格式的一层解码为按行排列的纹素，每行 width 个
+static void texture_level_decode(const texture_level_t *level, int format, IUINT32 *dst)
+{
+	IUINT32 texels[TEXTURE_TILE_SIZE * TEXTURE_TILE_SIZE];
+	for (int y = 0; y < level->height; y += TEXTURE_TILE_SIZE)
+	{
+		for (int x = 0; x < level->width; x += TEXTURE_TILE_SIZE)
+		{
+			texture_decode_block(texture_level_block(level, format, x, y), format, texels);
+			for (int j = 0; j < TEXTURE_TILE_SIZE && y + j < level->height; j++)
+			{
+				for (int i = 0; i < TEXTURE_TILE_SIZE && x + i < level->width; i++)
+				{
+					dst[(long)(y + j) * level->width + x + i] = texels[(j << TEXTURE_TILE_SHIFT) + i];
+				}
+			}
+		}
+	}
+}
+
+// 读取第 y 行，RGBA8 LINEAR 时直接返回行指针，TILED 时从各纹素块拼接到 row，其他格式展开为 RGBA8
+static const IUINT32 *texture_level_load_row(const texture_level_t *level, int layout, int format, int y, IUINT32 *row)
+{
+	if (format != TEXTURE_FORMAT_RGBA8)
+	{
+		int bytes = texture_texel_bytes(format);
+		for (int x = 0; x < level->width; x++)
+		{
+			row[x] = texture_unpack_texel(format, texture_level_address(level, layout, bytes, x, y));
+		}
+		return row;
+	}
+
+	if (layout == TEXTURE_LAYOUT_LINEAR)
+	{
+		return level->bits + y * level->pitch;
+	}
+
+	for (int x = 0; x < level->width; x += TEXTURE_TILE_SIZE)
+	{
+		memcpy(row + x, texture_level_texel(level, layout, x, y), sizeof(IUINT32) * TEXTURE_TILE_SIZE);
+	}
+	return row;
+}
+
+// 写入第 y 行，row 只读取 width 个纹素
+static void texture_level_store_row(texture_level_t *level, int layout, int format, int y, const IUINT32 *row)
+{
+	if (format != TEXTURE_FORMAT_RGBA8)
+	{
+		int bytes = texture_texel_bytes(format);
+		for (int x = 0; x < level->width; x++)
+		{
+			texture_pack_texel(format, texture_level_address(level, layout, bytes, x, y), row[x]);
+		}
+		return;
+	}
+
+	if (layout == TEXTURE_LAYOUT_LINEAR)
+	{
+		memcpy(level->bits + y * level->pitch, row, sizeof(IUINT32) * level->width);
+		return;
+	}
+
+	for (int x = 0; x < level->width; x += TEXTURE_TILE_SIZE)
+	{
+		int n = level->width - x < TEXTURE_TILE_SIZE ? level->width - x : TEXTURE_TILE_SIZE;
+		memcpy(texture_level_texel(level, layout, x, y), row + x, sizeof(IUINT32) * n);
+	}
+}
+
+// 浮点格式的一行，不经过 8 位量化
+static void texture_level_load_row_float(const texture_level_t *level, int layout, int format, int y, float *row)
+{
+	int bytes = texture_texel_bytes(format);
+	for (int x = 0; x < level->width; x++)
+	{
+		row[x] = texture_unpack_float(format, texture_level_address(level, layout, bytes, x, y));
+	}
+}
+
+static void texture_level_store_row_float(texture_level_t *level, int layout, int format, int y, const float *row)
+{
+	int bytes = texture_texel_bytes(format);
+	for (int x = 0; x < level->width; x++)
+	{
+		texture_pack_float(format, texture_level_address(level, layout, bytes, x, y), row[x]);
+	}
+}
+
+// 源图两行 [2x, 2x + 1] 的纹素取平均，宽度为奇数时最后一列与自己平均
+static void texture_downsample_row(IUINT32 *dst, const IUINT32 *src0, const IUINT32 *src1, int src_width, int dst_width)
+{
+	const __m128i zero = _mm_setzero_si128();
+	const __m128i round = _mm_set1_epi16(2);
+	int x = 0;
+
+	// 每次读取 8 个源纹素，输出 4 个
+	for (; x + 3 < dst_width && 2 * x + 7 < src_width; x += 4)
+	{
+		__m128i a0 = _mm_loadu_si128((const __m128i*)(src0 + 2 * x));
+		__m128i b0 = _mm_loadu_si128((const __m128i*)(src1 + 2 * x));
+		__m128i a1 = _mm_loadu_si128((const __m128i*)(src0 + 2 * x + 4));
+		__m128i b1 = _mm_loadu_si128((const __m128i*)(src1 + 2 * x + 4));
+
+		// 上下两行相加，每个 16 位整数为一个通道
+		__m128i s0 = _mm_add_epi16(_mm_unpacklo_epi8(a0, zero), _mm_unpacklo_epi8(b0, zero));
+		__m128i s1 = _mm_add_epi16(_mm_unpackhi_epi8(a0, zero), _mm_unpackhi_epi8(b0, zero));
+		__m128i s2 = _mm_add_epi16(_mm_unpacklo_epi8(a1, zero), _mm_unpacklo_epi8(b1, zero));
+		__m128i s3 = _mm_add_epi16(_mm_unpackhi_epi8(a1, zero), _mm_unpackhi_epi8(b1, zero));
+
+		// 左右两列相加，低 64 位为一个输出纹素
+		s0 = _mm_add_epi16(s0, _mm_srli_si128(s0, 8));
+		s1 = _mm_add_epi16(s1, _mm_srli_si128(s1, 8));
+		s2 = _mm_add_epi16(s2, _mm_srli_si128(s2, 8));
+		s3 = _mm_add_epi16(s3, _mm_srli_si128(s3, 8));
+
+		__m128i lo = _mm_srli_epi16(_mm_add_epi16(_mm_unpacklo_epi64(s0, s1), round), 2);
+		__m128i hi = _mm_srli_epi16(_mm_add_epi16(_mm_unpacklo_epi64(s2, s3), round), 2);
+		_mm_storeu_si128((__m128i*)(dst + x), _mm_packus_epi16(lo, hi));
+	}
+
+	for (; x < dst_width; x++)
+	{
+		int x0 = 2 * x < src_width ? 2 * x : src_width - 1;
+		int x1 = x0 + 1 < src_width ? x0 + 1 : x0;
+		IUINT32 c = 0;
+		for (int shift = 0; shift < 32; shift += 8)
+		{
+			IUINT32 sum = ((src0[x0] >> shift) & 0xff) + ((src0[x1] >> shift) & 0xff) + ((src1[x0] >> shift) & 0xff) + ((src1[x1] >> shift) & 0xff);
+			c |= ((sum + 2) >> 2) << shift;
+		}
+		dst[x] = c;
+	}
+}
+
+static void texture_downsample_row_float(float *dst, const float *src0, const float *src1, int src_width, int dst_width)
+{
+	for (int x = 0; x < dst_width; x++)
+	{
+		int x0 = 2 * x < src_width ? 2 * x : src_width - 1;
+		int x1 = x0 + 1 < src_width ? x0 + 1 : x0;
+		dst[x] = (src0[x0] + src0[x1] + src1[x0] + src1[x1]) * 0.25f;
+	}
+}
+
+// 分配失败时 level 0 的替代数据，足够一个纹素块
+static IUINT32 texture_empty_block[TEXTURE_TILE_SIZE * TEXTURE_TILE_SIZE];
+
+static void texture_set_size(texture_t *texture, int w, int h)
+{
+	texture_level_t *level = &texture->level[0];
+	texture->width = w;
+	texture->height = h;
+	texture->max_u = (float)(w - 1);
+	texture->max_v = (float)(h - 1);
+	level->width = w;
+	level->height = h;
+	level->max_u = (float)(w - 1);
+	level->max_v = (float)(h - 1);
+}
+
+void texture_set_data(texture_t *texture, void *bits, long pitch, int w, int h, int layout, int format)
+{
+	// 行指针只在 LINEAR 时引用调用者的数据，其他排列复制后调用者可以释放 bits
+	char *ptr = (char*)bits;
+	for (int j = 0; j < h; ptr += pitch, j++) 	// 重新计算每行纹理的指针
+	{
+		texture->texture[j] = layout == TEXTURE_LAYOUT_LINEAR ? (IUINT32*)ptr : NULL;
+	}
+
+	texture_release(texture);
+	texture_set_size(texture, w, h);
+
+	texture_level_t *level = &texture->level[0];
+	texture->layout = layout;
+	texture->format = format;
+	if (layout == TEXTURE_LAYOUT_LINEAR)
+	{
+		level->bits = texture->texture[0];
+		level->pitch = (int)(pitch / sizeof(IUINT32));
+		return;
+	}
+
+	texture->texel_buffer = (IUINT32*)malloc(sizeof(IUINT32) * texture_level_size(w, h, layout, format));
+	if (texture->texel_buffer == NULL)
+	{
+		// 退化为内容全为 0 的 1x1 纹理
+		texture_set_size(texture, 1, 1);
+		level->bits = texture_empty_block;
+		level->pitch = texture_level_pitch(1, layout, format);
+		return;
+	}
+
+	level->bits = texture->texel_buffer;
+	level->pitch = texture_level_pitch(w, layout, format);
+	if (texture_format_is_compressed(format))
+	{
+		texture_level_encode(level, format, (const IUINT32*)bits, (long)(pitch / sizeof(IUINT32)));
+		return;
+	}
+
+	ptr = (char*)bits;
+	for (int j = 0; j < h; ptr += pitch, j++)
+	{
+		if (texture_format_is_float(format))
+		{
+			texture_level_store_row_float(level, layout, format, j, (const float*)ptr);
+		}
+		else
+		{
+			texture_level_store_row(level, layout, format, j, (const IUINT32*)ptr);
+		}
+	}
+}
+
+void texture_release(texture_t *texture)
+{
+	texture_release_mipmap(texture);
+	texture_block_generation++;
+	if (texture->texel_buffer)
+	{
+		free(texture->texel_buffer);
+		texture->texel_buffer = NULL;
+	}
+}
+
+void texture_generate_mipmap(texture_t *texture)
+{
+	texture_release_mipmap(texture);
+
+	int layout = texture->layout;
+	int format = texture->format;
+	int level_num = 1;
+	long texel_num = 0;
+	int w = texture->level[0].width;
+	int h = texture->level[0].height;
+	while ((w > 1 || h > 1) && level_num < MAX_TEXTURE_LEVEL)
+	{
+		w = w > 1 ? w / 2 : 1;
+		h = h > 1 ? h / 2 : 1;
+		texel_num += texture_level_size(w, h, layout, format);
+		level_num++;
+	}
+	if (level_num == 1)
+	{
+		return;
+	}
+
+	// TILED 时源图的两行和结果先在行缓存中按线性排列
+	IUINT32 row0[MAX_TEXTURE_SIZE], row1[MAX_TEXTURE_SIZE], row_out[MAX_TEXTURE_SIZE];
+	texture->mip_buffer = (IUINT32*)malloc(sizeof(IUINT32) * texel_num);
+	IUINT32 *bits = texture->mip_buffer;
+
+	// 压缩格式只解码 level 0，之后每层由未压缩的上一层缩小后再压缩，误差不会逐层累积
+	bool compressed = texture_format_is_compressed(format);
+	IUINT32 *src_image = NULL;
+	IUINT32 *dst_image = NULL;
+	if (compressed)
+	{
+		const texture_level_t *base = &texture->level[0];
+		w = base->width > 1 ? base->width / 2 : 1;
+		h = base->height > 1 ? base->height / 2 : 1;
+		src_image = (IUINT32*)malloc(sizeof(IUINT32) * base->width * base->height);
+		dst_image = (IUINT32*)malloc(sizeof(IUINT32) * w * h);
+		texture_level_decode(base, format, src_image);
+	}
+
+	for (int i = 1; i < level_num; i++)
+	{
+		const texture_level_t *src = &texture->level[i - 1];
+		texture_level_t *dst = &texture->level[i];
+		dst->bits = bits;
+		dst->width = src->width > 1 ? src->width / 2 : 1;
+		dst->height = src->height > 1 ? src->height / 2 : 1;
+		dst->pitch = texture_level_pitch(dst->width, layout, format);
+		dst->max_u = (float)(dst->width - 1);
+		dst->max_v = (float)(dst->height - 1);
+		bits += texture_level_size(dst->width, dst->height, layout, format);
+
+		if (compressed)
+		{
+			for (int y = 0; y < dst->height; y++)
+			{
+				int y0 = 2 * y < src->height ? 2 * y : src->height - 1;
+				int y1 = y0 + 1 < src->height ? y0 + 1 : y0;
+				texture_downsample_row(dst_image + y * dst->width, src_image + y0 * src->width, src_image + y1 * src->width, src->width, dst->width);
+			}
+			texture_level_encode(dst, format, dst_image, dst->width);
+
+			// 上一层的缓存不小于下一层，交换后复用
+			IUINT32 *t = src_image;
+			src_image = dst_image;
+			dst_image = t;
+			continue;
+		}
+
+		if (texture_format_is_float(format))
+		{
+			float frow0[MAX_TEXTURE_SIZE], frow1[MAX_TEXTURE_SIZE], frow_out[MAX_TEXTURE_SIZE];
+			for (int y = 0; y < dst->height; y++)
+			{
+				int y0 = 2 * y < src->height ? 2 * y : src->height - 1;
+				int y1 = y0 + 1 < src->height ? y0 + 1 : y0;
+				texture_level_load_row_float(src, layout, format, y0, frow0);
+				texture_level_load_row_float(src, layout, format, y1, frow1);
+				texture_downsample_row_float(frow_out, frow0, frow1, src->width, dst->width);
+				texture_level_store_row_float(dst, layout, format, y, frow_out);
+			}
+			continue;
+		}
+
+		for (int y = 0; y < dst->height; y++)
+		{
+			int y0 = 2 * y < src->height ? 2 * y : src->height - 1;
+			int y1 = y0 + 1 < src->height ? y0 + 1 : y0;
+			const IUINT32 *src0 = texture_level_load_row(src, layout, format, y0, row0);
+			const IUINT32 *src1 = texture_level_load_row(src, layout, format, y1, row1);
+			if (layout == TEXTURE_LAYOUT_LINEAR && format == TEXTURE_FORMAT_RGBA8)
+			{
+				texture_downsample_row(dst->bits + y * dst->pitch, src0, src1, src->width, dst->width);
+			}
+			else
+			{
+				texture_downsample_row(row_out, src0, src1, src->width, dst->width);
+				texture_level_store_row(dst, layout, format, y, row_out);
+			}
+		}
+	}
+	texture->level_num = level_num;
+	free(src_image);
+	free(dst_image);
+}
+
+void texture_release_mipmap(texture_t *texture)
+{
+	if (texture->mip_buffer)
+	{
+		free(texture->mip_buffer);
+		texture->mip_buffer = NULL;
+		texture_block_generation++;
+	}
+	texture->level_num = 1;
+}
+
+// 返回第 y 行第 x 列纹素所在块解码后的 16 个纹素
+static inline const IUINT32 *texture_level_decoded_block(const texture_level_t *level, int format, int x, int y)
+{
+	const IUINT32 *block = texture_level_block(level, format, x, y);
+	texture_block_cache_t *cache = &texture_block_cache;
+	if (cache->generation != texture_block_generation)
+	{
+		for (int i = 0; i < TEXTURE_BLOCK_CACHE_SIZE; i++)
+		{
+			cache->entry[i].block = NULL;
+		}
+		cache->generation = texture_block_generation;
+	}
+
+	// 各层的块坐标相近，按层的地址错开，三线性过滤时相邻两层不互相替换
+	const int mask = (1 << TEXTURE_BLOCK_CACHE_SHIFT) - 1;
+	int index = ((x >> TEXTURE_TILE_SHIFT) & mask) | (((y >> TEXTURE_TILE_SHIFT) & mask) << TEXTURE_BLOCK_CACHE_SHIFT);
+	index ^= (int)((size_t)level / sizeof(texture_level_t)) & (TEXTURE_BLOCK_CACHE_SIZE - 1);
+	texture_block_cache_entry_t *entry = &cache->entry[index];
+	if (entry->block != block)
+	{
+		texture_decode_block(block, format, entry->texels);
+		entry->block = block;
+	}
+	return entry->texels;
+}
+
+static inline int texture_block_offset(int x, int y)
+{
+	return ((y & (TEXTURE_TILE_SIZE - 1)) << TEXTURE_TILE_SHIFT) + (x & (TEXTURE_TILE_SIZE - 1));
+}
+
+static inline IUINT32 texture_level_fetch(const texture_t *texture, const texture_level_t *level, int x, int y)
+{
+	if (texture->format == TEXTURE_FORMAT_RGBA8)
+	{
+		const IUINT32 *texel = texture_level_texel(level, texture->layout, x, y);
+		TEXTURE_TRACE_FETCH(texel);
+		return *texel;
+	}
+
+	if (texture_format_is_compressed(texture->format))
+	{
+		TEXTURE_TRACE_FETCH(texture_level_block(level, texture->format, x, y));
+		return texture_level_decoded_block(level, texture->format, x, y)[texture_block_offset(x, y)];
+	}
+
+	const IUINT8 *texel = texture_level_address(level, texture->layout, texture_texel_bytes(texture->format), x, y);
+	TEXTURE_TRACE_FETCH(texel);
+	return texture_unpack_texel(texture->format, texel);
+}
+
+// 第一个通道，浮点格式直接返回，其他格式为 [0, 1]
+static inline float texture_level_fetch_float(const texture_t *texture, const texture_level_t *level, int x, int y)
+{
+	if (texture_format_is_float(texture->format))
+	{
+		const IUINT8 *texel = texture_level_address(level, texture->layout, texture_texel_bytes(texture->format), x, y);
+		TEXTURE_TRACE_FETCH(texel);
+		return texture_unpack_float(texture->format, texel);
+	}
+	return (float)(texture_level_fetch(texture, level, x, y) >> 24) * (1.0f / 255.0f);
+}
+
+// 整数纹素坐标按环绕方式映射到 [0, size)，尺寸为 2 的幂时用掩码代替取模
+static inline int texture_wrap(int x, int size, int wrap)
+{
+	if (wrap == SAMPLER_WRAP_REPEAT)
+	{
+		if ((size & (size - 1)) == 0)
+		{
+			return x & (size - 1);
+		}
+		x %= size;
+		return x < 0 ? x + size : x;
+	}
+
+	if (wrap == SAMPLER_WRAP_MIRROR)
+	{
+		int period = size * 2;
+		if ((size & (size - 1)) == 0)
+		{
+			x &= period - 1;
+		}
+		else
+		{
+			x %= period;
+			x = x < 0 ? x + period : x;
+		}
+		return x < size ? x : period - 1 - x;
+	}
+
+	return CMID(x, 0, size - 1);
+}
+
+// CLAMP 时纹素 i 的中心位于 i / (size - 1)，与 device_texture_read 一致
+// REPEAT 和 MIRROR 以 size 个纹素为一个周期，纹素 i 的中心位于 (i + 0.5) / size
+static inline int texture_nearest_coord(float u, int size, float max_u, int wrap)
+{
+	if (wrap == SAMPLER_WRAP_CLAMP)
+	{
+		return CMID((int)(u * max_u + 0.5f), 0, size - 1);
+	}
+	return texture_wrap((int)floorf(u * (float)size), size, wrap);
+}
+
+// 左侧纹素的坐标，右侧纹素的权重为 8 位小数
+static inline int texture_bilinear_coord(float u, int size, float max_u, int wrap, int *weight)
+{
+	float x = wrap == SAMPLER_WRAP_CLAMP ? u * max_u : u * (float)size - 0.5f;
+	int fixed = (int)floorf(x * 256.0f);
+	*weight = fixed & 0xff;
+	return fixed >> 8;
+}
+
+static IUINT32 texture_level_read_nearest(const texture_t *texture, const texture_level_t *level, const samplerstate_t *sampler, float u, float v)
+{
+	int x = texture_nearest_coord(u, level->width, level->max_u, sampler->wrap_u);
+	int y = texture_nearest_coord(v, level->height, level->max_v, sampler->wrap_v);
+	return texture_level_fetch(texture, level, x, y);
+}
+
+// 8.8 定点插值：pair 的低 64 位和高 64 位各为一个纹素，4 个通道各占 16 位
+// 结果 a * (256 - weight) + b * weight 不超过 255 * 256，不会溢出无符号 16 位
+static inline __m128i texture_lerp_pair(__m128i pair, int weight)
+{
+	__m128i w = _mm_unpacklo_epi64(_mm_set1_epi16((short)(256 - weight)), _mm_set1_epi16((short)weight));
+	__m128i x = _mm_mullo_epi16(pair, w);
+	x = _mm_add_epi16(x, _mm_srli_si128(x, 8));
+	return _mm_srli_epi16(_mm_add_epi16(x, _mm_set1_epi16(128)), 8);
+}
+
+// 两个纹素展开为 16 位整数放到一个寄存器中
+static inline __m128i texture_unpack_pair(IUINT32 a, IUINT32 b)
+{
+	return _mm_unpacklo_epi8(_mm_unpacklo_epi32(_mm_cvtsi32_si128((int)a), _mm_cvtsi32_si128((int)b)), _mm_setzero_si128());
+}
+
+static inline IUINT32 texture_pack(__m128i x)
+{
+	return (IUINT32)_mm_cvtsi128_si32(_mm_packus_epi16(x, x));
+}
+
+// 上下两行先插值，左右两个纹素在同一个寄存器中一起计算，再横向插值
+// 双线性过滤读取的 2x2 纹素和右下纹素的 8 位权重
+typedef struct {
+	int x0, x1, y0, y1;
+	int wx, wy;
+} texture_footprint_t;
+
+static inline texture_footprint_t texture_bilinear_footprint(const texture_level_t *level, const samplerstate_t *sampler, float u, float v)
+{
+	texture_footprint_t f;
+	int x = texture_bilinear_coord(u, level->width, level->max_u, sampler->wrap_u, &f.wx);
+	int y = texture_bilinear_coord(v, level->height, level->max_v, sampler->wrap_v, &f.wy);
+	f.x0 = texture_wrap(x, level->width, sampler->wrap_u);
+	f.x1 = texture_wrap(x + 1, level->width, sampler->wrap_u);
+	f.y0 = texture_wrap(y, level->height, sampler->wrap_v);
+	f.y1 = texture_wrap(y + 1, level->height, sampler->wrap_v);
+	return f;
+}
+
+static IUINT32 texture_level_read_bilinear(const texture_t *texture, const texture_level_t *level, const samplerstate_t *sampler, float u, float v)
+{
+	texture_footprint_t f = texture_bilinear_footprint(level, sampler, u, v);
+
+	__m128i top, bottom;
+	if (texture_format_is_compressed(texture->format) && (((f.x0 ^ f.x1) | (f.y0 ^ f.y1)) >> TEXTURE_TILE_SHIFT) == 0)
+	{
+		// 压缩格式的 4 个纹素在同一块内时只查找一次缓存
+		const IUINT32 *texels = texture_level_decoded_block(level, texture->format, f.x0, f.y0);
+		for (int i = 0; i < 4; i++)
+		{
+			TEXTURE_TRACE_FETCH(texture_level_block(level, texture->format, f.x0, f.y0));
+		}
+		top = texture_unpack_pair(texels[texture_block_offset(f.x0, f.y0)], texels[texture_block_offset(f.x1, f.y0)]);
+		bottom = texture_unpack_pair(texels[texture_block_offset(f.x0, f.y1)], texels[texture_block_offset(f.x1, f.y1)]);
+	}
+	else
+	{
+		top = texture_unpack_pair(texture_level_fetch(texture, level, f.x0, f.y0), texture_level_fetch(texture, level, f.x1, f.y0));
+		bottom = texture_unpack_pair(texture_level_fetch(texture, level, f.x0, f.y1), texture_level_fetch(texture, level, f.x1, f.y1));
+	}
+	__m128i column = _mm_add_epi16(_mm_mullo_epi16(top, _mm_set1_epi16((short)(256 - f.wy))), _mm_mullo_epi16(bottom, _mm_set1_epi16((short)f.wy)));
+	column = _mm_srli_epi16(_mm_add_epi16(column, _mm_set1_epi16(128)), 8);
+	return texture_pack(texture_lerp_pair(column, f.wx));
+}
+
+static inline IUINT32 texture_level_read(const texture_t *texture, const texture_level_t *level, const samplerstate_t *sampler, float u, float v)
+{
+	if (sampler->filter == SAMPLER_FILTER_BILINEAR)
+	{
+		return texture_level_read_bilinear(texture, level, sampler, u, v);
+	}
+	return texture_level_read_nearest(texture, level, sampler, u, v);
+}
+
+IUINT32 texture_read(const texture_t *texture, float u, float v)
+{
+	const texture_level_t *level = &texture->level[0];
+	int x = CMID((int)(u * level->max_u + 0.5f), 0, level->width - 1);
+	int y = CMID((int)(v * level->max_v + 0.5f), 0, level->height - 1);
+	return texture_level_fetch(texture, level, x, y);
+}
+
+IUINT32 texture_sample(const texture_t *texture, const samplerstate_t *sampler, float u, float v, float lod)
+{
+	// lod 为 NaN 时也按放大处理
+	if (sampler->mip_filter == SAMPLER_MIP_FILTER_NONE || texture->level_num == 1 || !(lod > 0.0f))
+	{
+		return texture_level_read(texture, &texture->level[0], sampler, u, v);
+	}
+
+	float max_lod = (float)(texture->level_num - 1);
+	if (lod > max_lod)
+	{
+		lod = max_lod;
+	}
+
+	if (sampler->mip_filter == SAMPLER_MIP_FILTER_NEAREST)
+	{
+		return texture_level_read(texture, &texture->level[(int)(lod + 0.5f)], sampler, u, v);
+	}
+
+	int i = (int)lod;
+	int weight = (int)((lod - (float)i) * 256.0f);
+	IUINT32 c = texture_level_read(texture, &texture->level[i], sampler, u, v);
+	if (weight > 0)
+	{
+		IUINT32 c1 = texture_level_read(texture, &texture->level[i + 1], sampler, u, v);
+		c = texture_pack(texture_lerp_pair(texture_unpack_pair(c, c1), weight));
+	}
+	return c;
+}
+
+static float texture_level_read_float(const texture_t *texture, const texture_level_t *level, const samplerstate_t *sampler, float u, float v)
+{
+	if (sampler->filter == SAMPLER_FILTER_BILINEAR)
+	{
+		texture_footprint_t f = texture_bilinear_footprint(level, sampler, u, v);
+		float wx = (float)f.wx * (1.0f / 256.0f);
+		float wy = (float)f.wy * (1.0f / 256.0f);
+		float c00 = texture_level_fetch_float(texture, level, f.x0, f.y0);
+		float c10 = texture_level_fetch_float(texture, level, f.x1, f.y0);
+		float c01 = texture_level_fetch_float(texture, level, f.x0, f.y1);
+		float c11 = texture_level_fetch_float(texture, level, f.x1, f.y1);
+		float top = c00 + (c10 - c00) * wx;
+		float bottom = c01 + (c11 - c01) * wx;
+		return top + (bottom - top) * wy;
+	}
+
+	int x = texture_nearest_coord(u, level->width, level->max_u, sampler->wrap_u);
+	int y = texture_nearest_coord(v, level->height, level->max_v, sampler->wrap_v);
+	return texture_level_fetch_float(texture, level, x, y);
+}
+
+float texture_read_float(const texture_t *texture, float u, float v)
+{
+	const texture_level_t *level = &texture->level[0];
+	int x = CMID((int)(u * level->max_u + 0.5f), 0, level->width - 1);
+	int y = CMID((int)(v * level->max_v + 0.5f), 0, level->height - 1);
+	return texture_level_fetch_float(texture, level, x, y);
+}
+
+float texture_sample_float(const texture_t *texture, const samplerstate_t *sampler, float u, float v, float lod)
+{
+	if (sampler->mip_filter == SAMPLER_MIP_FILTER_NONE || texture->level_num == 1 || !(lod > 0.0f))
+	{
+		return texture_level_read_float(texture, &texture->level[0], sampler, u, v);
+	}
+
+	float max_lod = (float)(texture->level_num - 1);
+	if (lod > max_lod)
+	{
+		lod = max_lod;
+	}
+
+	if (sampler->mip_filter == SAMPLER_MIP_FILTER_NEAREST)
+	{
+		return texture_level_read_float(texture, &texture->level[(int)(lod + 0.5f)], sampler, u, v);
+	}
+
+	int i = (int)lod;
+	float weight = lod - (float)i;
+	float c = texture_level_read_float(texture, &texture->level[i], sampler, u, v);
+	if (weight > 0.0f)
+	{
+		c += (texture_level_read_float(texture, &texture->level[i + 1], sampler, u, v) - c) * weight;
+	}
+	return c;
+}
+
+// 4 个纹素与参考值比较，小于 ref 的为 1.0f，否则为 0
+static inline __m128 texture_compare4(__m128 texels, __m128 ref)
+{
+	return _mm_and_ps(_mm_cmplt_ps(texels, ref), _mm_set1_ps(1.0f));
+}
+
+// 以最近的纹素为中心、边长为 2 * radius + 1 的方框，每行的纹素读到补齐为 4 的倍数的数组中，补齐的部分为 FLT_MAX，比较结果为 0
+static float texture_level_compare_box(const texture_t *texture, const texture_level_t *level, const samplerstate_t *sampler, float u, float v, float ref, int radius)
+{
+	const int n = 2 * radius + 1;
+	int cx = texture_nearest_coord(u, level->width, level->max_u, sampler->wrap_u);
+	int cy = texture_nearest_coord(v, level->height, level->max_v, sampler->wrap_v);
+
+	int columns[8];
+	for (int i = 0; i < n; i++)
+	{
+		columns[i] = texture_wrap(cx - radius + i, level->width, sampler->wrap_u);
+	}
+	// R32F 按行排列且方框没有越过左右边界时，一行的纹素是连续的
+	bool contiguous = texture->format == TEXTURE_FORMAT_R32F && texture->layout == TEXTURE_LAYOUT_LINEAR && cx - radius >= 0 && cx + radius < level->width;
+
+	__m128 ref4 = _mm_set1_ps(ref);
+	__m128 sum = _mm_setzero_ps();
+	float row[8];
+	for (int i = n; i < 8; i++)
+	{
+		row[i] = FLT_MAX;
+	}
+	for (int j = 0; j < n; j++)
+	{
+		int y = texture_wrap(cy - radius + j, level->height, sampler->wrap_v);
+		if (contiguous)
+		{
+			const float *texels = (const float*)texture_level_address(level, TEXTURE_LAYOUT_LINEAR, sizeof(float), columns[0], y);
+			for (int i = 0; i < n; i++)
+			{
+				TEXTURE_TRACE_FETCH(texels + i);
+				row[i] = texels[i];
+			}
+		}
+		else
+		{
+			for (int i = 0; i < n; i++)
+			{
+				row[i] = texture_level_fetch_float(texture, level, columns[i], y);
+			}
+		}
+		sum = _mm_add_ps(sum, texture_compare4(_mm_loadu_ps(row), ref4));
+		if (n > 4)
+		{
+			sum = _mm_add_ps(sum, texture_compare4(_mm_loadu_ps(row + 4), ref4));
+		}
+	}
+	return simd_sum(sum) * (1.0f / (float)(n * n));
+}
+
+float texture_sample_compare(const texture_t *texture, const samplerstate_t *sampler, float u, float v, float ref)
+{
+	const texture_level_t *level = &texture->level[0];
+	if (sampler->pcf == SAMPLER_PCF_2X2)
+	{
+		// 4 个纹素一起比较，再按双线性权重 (1 - wx)(1 - wy) wx(1 - wy) (1 - wx)wy wxwy 求和
+		texture_footprint_t f = texture_bilinear_footprint(level, sampler, u, v);
+		__m128 texels = _mm_setr_ps(texture_level_fetch_float(texture, level, f.x0, f.y0), texture_level_fetch_float(texture, level, f.x1, f.y0),
+			texture_level_fetch_float(texture, level, f.x0, f.y1), texture_level_fetch_float(texture, level, f.x1, f.y1));
+		__m128 wx = _mm_set1_ps((float)f.wx * (1.0f / 256.0f));
+		__m128 wy = _mm_set1_ps((float)f.wy * (1.0f / 256.0f));
+		__m128 one = _mm_set1_ps(1.0f);
+		__m128 weight_x = simd_select(_mm_castsi128_ps(_mm_setr_epi32(0, -1, 0, -1)), wx, _mm_sub_ps(one, wx));
+		__m128 weight_y = simd_select(_mm_castsi128_ps(_mm_setr_epi32(0, 0, -1, -1)), wy, _mm_sub_ps(one, wy));
+		return simd_sum(_mm_mul_ps(texture_compare4(texels, _mm_set1_ps(ref)), _mm_mul_ps(weight_x, weight_y)));
+	}
+	if (sampler->pcf == SAMPLER_PCF_3X3)
+	{
+		return texture_level_compare_box(texture, level, sampler, u, v, ref, 1);
+	}
+	if (sampler->pcf == SAMPLER_PCF_5X5)
+	{
+		return texture_level_compare_box(texture, level, sampler, u, v, ref, 2);
+	}
+
+	int x = texture_nearest_coord(u, level->width, level->max_u, sampler->wrap_u);
+	int y = texture_nearest_coord(v, level->height, level->max_v, sampler->wrap_v);
+	return texture_level_fetch_float(texture, level, x, y) < ref ? 1.0f : 0.0f;
+}
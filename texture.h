@@ -0,0 +1,56 @@
+#pragma once
+
+#include "device.h"
+#include "renderstate.h"
+
+//=====================================================================
+// 纹理：数据排列、块压缩、mipmap 生成和按采样器采样
+// LINEAR 的 level 0 引用调用者的数据，TILED 的 level 0 和 mipmap 各层都由纹理自己分配
+// 压缩格式按 TILED 排列，每个纹素块压缩为 BC1 或 BC3 块，读取时解码整块并缓存在当前线程
+//=====================================================================
+
+// 设置 level 0 的数据，layout 为 TILED 时复制并转换排列，原有的 mipmap 失效
+// format 为 R16F R32F 时 bits 为 float，其他格式 bits 为 RGBA8，复制时转为 format
+// LINEAR 直接引用 bits，bits 即按 format 排列的纹素，不支持压缩格式
+// 其他排列复制后不再引用 bits，分配失败时纹理退化为内容为 0 的 1x1 纹理
+void texture_set_data(texture_t *texture, void *bits, long pitch, int w, int h, int layout, int format);
+
+// 释放纹理分配的所有数据
+void texture_release(texture_t *texture);
+
+// 由 level 0 生成完整的 mipmap 链，每层宽高减半（不小于 1），2x2 盒式滤波，各层格式与 level 0 相同
+void texture_generate_mipmap(texture_t *texture);
+
+// 释放 level 0 以外的各层
+void texture_release_mipmap(texture_t *texture);
+
+// 读取 level 0 最近的纹素，坐标截断到边缘，即默认采样器
+IUINT32 texture_read(const texture_t *texture, float u, float v);
+
+// 按采样器读取，lod 为 log2(每个像素跨越的 level 0 纹素数)，lod <= 0 时为放大，只读取 level 0
+// 非 RGBA8 格式展开为 RGBA8，缺少的颜色通道为 0，透明度为 255
+IUINT32 texture_sample(const texture_t *texture, const samplerstate_t *sampler, float u, float v, float lod);
+
+// 同 texture_read 和 texture_sample，只读取第一个通道，浮点格式不经过 8 位量化，其他格式为 [0, 1]
+float texture_read_float(const texture_t *texture, float u, float v);
+float texture_sample_float(const texture_t *texture, const samplerstate_t *sampler, float u, float v, float lod);
+
+// 比较采样，用于百分比渐近过滤的阴影：按 sampler->pcf 读取 level 0 的多个纹素，第一个通道小于 ref 的记为 1，否则为 0
+// 返回按权重混合的结果，各纹素一起用 SIMD 比较
+float texture_sample_compare(const texture_t *texture, const samplerstate_t *sampler, float u, float v, float ref);
+
+#if defined(BENCHMARK_TEXTURE_MIPMAP) || defined(BENCHMARK_TEXTURE_LAYOUT) || defined(BENCHMARK_TEXTURE_COMPRESSION)
+#define TEXTURE_FETCH_STATS
+#endif
+
+// 纹素读取统计，缓存按 32KB 8 路组相联模拟，未命中即需要从内存读取一个缓存行
+typedef struct {
+	long long fetch_num;
+	long long miss_num;
+} texture_fetch_stats_t;
+
+// 只在定义 TEXTURE_FETCH_STATS 时统计
+#ifdef TEXTURE_FETCH_STATS
+void texture_reset_fetch_stats();
+texture_fetch_stats_t texture_get_fetch_stats();
+#endif
@@ -0,0 +1,234 @@
+#include <stdlib.h>
+
+#include "texture_bc.h"
+
+// 通道 k 为 0 1 2 3 时依次为 R G B A
+static inline int texture_bc_channel(IUINT32 c, int k)
+{
+	return (c >> (24 - 8 * k)) & 0xff;
+}
+
+// 两个颜色按 wa : wb 混合，透明度为 255
+static IUINT32 texture_bc_mix(IUINT32 a, IUINT32 b, int wa, int wb)
+{
+	IUINT32 c = 0xff;
+	for (int k = 0; k < 3; k++)
+	{
+		c |= (IUINT32)((texture_bc_channel(a, k) * wa + texture_bc_channel(b, k) * wb) / (wa + wb)) << (24 - 8 * k);
+	}
+	return c;
+}
+
+// c0 > c1 或 BC3 的颜色块为 4 色，否则为 3 色加透明的黑色
+static void texture_bc_color_palette(int c0, int c1, bool four_color, IUINT32 palette[4])
+{
+	palette[0] = texture_rgb565_unpack(c0);
+	palette[1] = texture_rgb565_unpack(c1);
+	if (four_color)
+	{
+		palette[2] = texture_bc_mix(palette[0], palette[1], 2, 1);
+		palette[3] = texture_bc_mix(palette[0], palette[1], 1, 2);
+	}
+	else
+	{
+		palette[2] = texture_bc_mix(palette[0], palette[1], 1, 1);
+		palette[3] = 0;
+	}
+}
+
+// a0 > a1 时端点之间插值 6 个，否则插值 4 个再加上 0 和 255
+static void texture_bc_alpha_palette(int a0, int a1, int palette[8])
+{
+	palette[0] = a0;
+	palette[1] = a1;
+	if (a0 > a1)
+	{
+		for (int i = 1; i <= 6; i++)
+		{
+			palette[i + 1] = ((7 - i) * a0 + i * a1) / 7;
+		}
+	}
+	else
+	{
+		for (int i = 1; i <= 4; i++)
+		{
+			palette[i + 1] = ((5 - i) * a0 + i * a1) / 5;
+		}
+		palette[6] = 0;
+		palette[7] = 255;
+	}
+}
+
+static void texture_bc_encode_color(const IUINT32 texels[16], IUINT8 *block)
+{
+	int lo[3] = { 255, 255, 255 };
+	int hi[3] = { 0, 0, 0 };
+	for (int i = 0; i < 16; i++)
+	{
+		for (int k = 0; k < 3; k++)
+		{
+			int v = texture_bc_channel(texels[i], k);
+			if (v < lo[k]) lo[k] = v;
+			if (v > hi[k]) hi[k] = v;
+		}
+	}
+
+	// 以范围最大的通道为参考，与之负相关的通道交换端点，端点连线即沿颜色分布的对角线
+	int ref = 0;
+	for (int k = 1; k < 3; k++)
+	{
+		if (hi[k] - lo[k] > hi[ref] - lo[ref]) ref = k;
+	}
+	int cov[3] = { 0, 0, 0 };
+	for (int i = 0; i < 16; i++)
+	{
+		int d = 2 * texture_bc_channel(texels[i], ref) - lo[ref] - hi[ref];
+		for (int k = 0; k < 3; k++)
+		{
+			cov[k] += d * (2 * texture_bc_channel(texels[i], k) - lo[k] - hi[k]);
+		}
+	}
+
+	// 包围盒向内收缩 1/16，端点落在分布内部，减小中间两个插值色的误差
+	for (int k = 0; k < 3; k++)
+	{
+		int inset = (hi[k] - lo[k]) >> 4;
+		lo[k] += inset;
+		hi[k] -= inset;
+		if (cov[k] < 0)
+		{
+			int t = lo[k];
+			lo[k] = hi[k];
+			hi[k] = t;
+		}
+	}
+
+	// 保证 c0 > c1，BC1 按 4 色解码
+	int c0 = texture_rgb565_pack(hi[0], hi[1], hi[2]);
+	int c1 = texture_rgb565_pack(lo[0], lo[1], lo[2]);
+	if (c0 < c1)
+	{
+		int t = c0;
+		c0 = c1;
+		c1 = t;
+	}
+
+	IUINT32 indices = 0;
+	if (c0 != c1)
+	{
+		IUINT32 palette[4];
+		texture_bc_color_palette(c0, c1, true, palette);
+		for (int i = 0; i < 16; i++)
+		{
+			int best = 0;
+			int best_dist = 0x7fffffff;
+			for (int j = 0; j < 4; j++)
+			{
+				int dist = 0;
+				for (int k = 0; k < 3; k++)
+				{
+					int d = texture_bc_channel(texels[i], k) - texture_bc_channel(palette[j], k);
+					dist += d * d;
+				}
+				if (dist < best_dist)
+				{
+					best = j;
+					best_dist = dist;
+				}
+			}
+			indices |= (IUINT32)best << (2 * i);
+		}
+	}
+
+	block[0] = (IUINT8)(c0 & 0xff);
+	block[1] = (IUINT8)(c0 >> 8);
+	block[2] = (IUINT8)(c1 & 0xff);
+	block[3] = (IUINT8)(c1 >> 8);
+	for (int k = 0; k < 4; k++)
+	{
+		block[4 + k] = (IUINT8)(indices >> (8 * k));
+	}
+}
+
+static void texture_bc_encode_alpha(const IUINT32 texels[16], IUINT8 *block)
+{
+	int a0 = 0;
+	int a1 = 255;
+	for (int i = 0; i < 16; i++)
+	{
+		int a = texture_bc_channel(texels[i], 3);
+		if (a > a0) a0 = a;
+		if (a < a1) a1 = a;
+	}
+
+	unsigned long long indices = 0;
+	if (a0 != a1)
+	{
+		int palette[8];
+		texture_bc_alpha_palette(a0, a1, palette);
+		for (int i = 0; i < 16; i++)
+		{
+			int a = texture_bc_channel(texels[i], 3);
+			int best = 0;
+			for (int j = 1; j < 8; j++)
+			{
+				if (abs(a - palette[j]) < abs(a - palette[best])) best = j;
+			}
+			indices |= (unsigned long long)best << (3 * i);
+		}
+	}
+
+	block[0] = (IUINT8)a0;
+	block[1] = (IUINT8)a1;
+	for (int k = 0; k < 6; k++)
+	{
+		block[2 + k] = (IUINT8)(indices >> (8 * k));
+	}
+}
+
+static void texture_bc_decode_color(const IUINT8 *block, bool force_four_color, IUINT32 texels[16])
+{
+	int c0 = block[0] | (block[1] << 8);
+	int c1 = block[2] | (block[3] << 8);
+	IUINT32 palette[4];
+	texture_bc_color_palette(c0, c1, force_four_color || c0 > c1, palette);
+
+	IUINT32 indices = block[4] | (block[5] << 8) | (block[6] << 16) | ((IUINT32)block[7] << 24);
+	for (int i = 0; i < 16; i++, indices >>= 2)
+	{
+		texels[i] = palette[indices & 3];
+	}
+}
+
+void texture_bc1_encode_block(const IUINT32 texels[16], IUINT8 *block)
+{
+	texture_bc_encode_color(texels, block);
+}
+
+void texture_bc3_encode_block(const IUINT32 texels[16], IUINT8 *block)
+{
+	texture_bc_encode_alpha(texels, block);
+	texture_bc_encode_color(texels, block + 8);
+}
+
+void texture_bc1_decode_block(const IUINT8 *block, IUINT32 texels[16])
+{
+	texture_bc_decode_color(block, false, texels);
+}
+
+void texture_bc3_decode_block(const IUINT8 *block, IUINT32 texels[16])
+{
+	texture_bc_decode_color(block + 8, true, texels);
+
+	int palette[8];
+	texture_bc_alpha_palette(block[0], block[1], palette);
+	unsigned long long indices = 0;
+	for (int k = 0; k < 6; k++)
+	{
+		indices |= (unsigned long long)block[2 + k] << (8 * k);
+	}
+	for (int i = 0; i < 16; i++, indices >>= 3)
+	{
+		texels[i] = (texels[i] & 0xffffff00) | (IUINT32)palette[indices & 7];
+	}
+}
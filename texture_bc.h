@@ -0,0 +1,38 @@
+#pragma once
+
+#include "basetype.h"
+
+//=====================================================================
+// 块压缩：每个 4x4 纹素块压缩为固定大小，纹素按行存放在 texels[16] 中
+// BC1 8 字节：两个 RGB565 端点和 16 个 2 位索引，不保存透明度
+// BC3 16 字节：8 字节的透明度块（两个 8 位端点和 16 个 3 位索引）加一个 BC1 颜色块
+// 纹素与纹理相同，R G B A 从高到低
+//=====================================================================
+
+#define BC1_BLOCK_SIZE 8
+#define BC3_BLOCK_SIZE 16
+
+// RGB565 展开为纹素，低位由高位重复填充，透明度为 255
+static inline IUINT32 texture_rgb565_unpack(int c)
+{
+	int r = (c >> 11) & 0x1f;
+	int g = (c >> 5) & 0x3f;
+	int b = c & 0x1f;
+	r = (r << 3) | (r >> 2);
+	g = (g << 2) | (g >> 4);
+	b = (b << 3) | (b >> 2);
+	return ((IUINT32)r << 24) | ((IUINT32)g << 16) | ((IUINT32)b << 8) | 0xff;
+}
+
+// 各通道四舍五入到 5 6 5 位
+static inline int texture_rgb565_pack(int r, int g, int b)
+{
+	return (((r * 31 + 127) / 255) << 11) | (((g * 63 + 127) / 255) << 5) | ((b * 31 + 127) / 255);
+}
+
+// 端点取颜色包围盒向内收缩 1/16 后的对角线，以范围最大的通道为参考，与之负相关的通道交换端点
+void texture_bc1_encode_block(const IUINT32 texels[16], IUINT8 *block);
+void texture_bc3_encode_block(const IUINT32 texels[16], IUINT8 *block);
+
+void texture_bc1_decode_block(const IUINT8 *block, IUINT32 texels[16]);
+void texture_bc3_decode_block(const IUINT8 *block, IUINT32 texels[16]);
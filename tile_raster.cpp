@@ -0,0 +1,399 @@
+#include <stdio.h>
+#include <string.h>
+#include <math.h>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <deque>
+#include <vector>
+
+#include "tile_raster.h"
+#include "raster.h"
+
+typedef struct {
+	vertex_t v[3];
+	int state_idx;		// 绘制时的设备状态
+} tile_triangle_t;
+
+// 延迟光栅化读取的绘制状态，纹理、采样器和渲染目标在修改前会先 flush，不需要保存
+typedef struct {
+	pipeline_state_t pipeline_state;
+	transform_t transform;
+	int viewport_x;
+	int viewport_y;
+	int viewport_width;
+	int viewport_height;
+	int texture_id[MAX_TEXTURE_NUM];
+	int sampler_id[MAX_TEXTURE_NUM];
+	int uniform_vector_num;		// 只保存设置过的 uniform
+	int uniform_matrix_num;
+	vector_t uniform_vector[MAX_UNIFORM_NUM];
+	matrix_t uniform_matrix[MAX_UNIFORM_NUM];
+} tile_draw_state_t;
+
+// 每个线程的设备上下文，第一次绘制时从设备复制，之后绘制状态改变时只更新 tile_draw_state_t 中的部分
+typedef struct {
+	device_t context;
+	int state_idx;		// context 当前的绘制状态，-1 为本次 flush 还未复制
+	raster_stats_t stats;	// 各自累计，flush 结束时合并
+} tile_thread_t;
+
+// 每个线程一个块队列，自己从队尾取，空闲时从其他线程的队头窃取
+typedef struct {
+	std::mutex lock;
+	std::deque<int> tiles;
+} tile_queue_t;
+
+struct tile_raster_t {
+	std::vector<tile_triangle_t> triangles;
+	std::vector<int> bins[TILE_NUM];	// 每个块覆盖到的三角形，按提交顺序
+	std::vector<int> active_tiles;
+
+	std::vector<tile_draw_state_t> states;	// 绘制状态快照，着色器在块内绘制时读取
+	int state_num;
+	bool state_valid;
+	device_t* device;		// 正在 flush 的设备
+
+	// 线程池，0 号为调用 flush 的线程，线程数只在 raster_thread_num 改变时重建
+	int thread_num;
+	std::vector<std::thread> workers;
+	tile_queue_t* queues;
+	tile_thread_t* threads;
+	std::mutex pool_lock;
+	std::condition_variable pool_start;
+	std::condition_variable pool_done;
+	int generation;
+	int busy_workers;
+	bool quit;
+};
+
+static void tile_raster_save_state(tile_draw_state_t* state, const device_t* device)
+{
+	state->pipeline_state = device->pipeline_state;
+	state->transform = device->transform;
+	state->viewport_x = device->viewport_x;
+	state->viewport_y = device->viewport_y;
+	state->viewport_width = device->viewport_width;
+	state->viewport_height = device->viewport_height;
+	memcpy(state->texture_id, device->texture_id, sizeof(state->texture_id));
+	memcpy(state->sampler_id, device->sampler_id, sizeof(state->sampler_id));
+	state->uniform_vector_num = device->uniform_vector_num;
+	state->uniform_matrix_num = device->uniform_matrix_num;
+	memcpy(state->uniform_vector, device->uniform_vector, device->uniform_vector_num * sizeof(vector_t));
+	memcpy(state->uniform_matrix, device->uniform_matrix, device->uniform_matrix_num * sizeof(matrix_t));
+}
+
+static void tile_raster_apply_state(device_t* context, const tile_draw_state_t* state)
+{
+	context->pipeline_state = state->pipeline_state;
+	context->transform = state->transform;
+	context->viewport_x = state->viewport_x;
+	context->viewport_y = state->viewport_y;
+	context->viewport_width = state->viewport_width;
+	context->viewport_height = state->viewport_height;
+	memcpy(context->texture_id, state->texture_id, sizeof(state->texture_id));
+	memcpy(context->sampler_id, state->sampler_id, sizeof(state->sampler_id));
+	memcpy(context->uniform_vector, state->uniform_vector, state->uniform_vector_num * sizeof(vector_t));
+	memcpy(context->uniform_matrix, state->uniform_matrix, state->uniform_matrix_num * sizeof(matrix_t));
+}
+
+static void tile_raster_render_tile(tile_raster_t* raster, int tile, tile_thread_t* thread)
+{
+	int tx = tile % TILE_COLUMN_NUM;
+	int ty = tile / TILE_COLUMN_NUM;
+	std::vector<int>& bin = raster->bins[tile];
+	device_t* state = &thread->context;
+
+	for (size_t i = 0; i < bin.size(); i++)
+	{
+		const tile_triangle_t* tri = &raster->triangles[bin[i]];
+		if (tri->state_idx != thread->state_idx)
+		{
+			if (thread->state_idx < 0)
+			{
+				*state = *raster->device;
+			}
+			tile_raster_apply_state(state, &raster->states[tri->state_idx]);
+			thread->state_idx = tri->state_idx;
+		}
+
+		raster_region_t region;
+		device_init_raster_region(state, &region);
+		if (region.clip.x0 < tx * TILE_SIZE) region.clip.x0 = tx * TILE_SIZE;
+		if (region.clip.y0 < ty * TILE_SIZE) region.clip.y0 = ty * TILE_SIZE;
+		if (region.clip.x1 > (tx + 1) * TILE_SIZE) region.clip.x1 = (tx + 1) * TILE_SIZE;
+		if (region.clip.y1 > (ty + 1) * TILE_SIZE) region.clip.y1 = (ty + 1) * TILE_SIZE;
+
+		device_render_triangle(state, &tri->v[0], &tri->v[1], &tri->v[2], &region);
+		raster_stats_add(&thread->stats, &region.stats);
+	}
+}
+
+static bool tile_queue_pop(tile_queue_t* queue, int* tile, bool steal)
+{
+	std::lock_guard<std::mutex> guard(queue->lock);
+	if (queue->tiles.empty())
+	{
+		return false;
+	}
+
+	if (steal)
+	{
+		*tile = queue->tiles.front();
+		queue->tiles.pop_front();
+	}
+	else
+	{
+		*tile = queue->tiles.back();
+		queue->tiles.pop_back();
+	}
+	return true;
+}
+
+static void tile_raster_work(tile_raster_t* raster, int index)
+{
+	int tile;
+	for (;;)
+	{
+		if (tile_queue_pop(&raster->queues[index], &tile, false))
+		{
+			tile_raster_render_tile(raster, tile, &raster->threads[index]);
+			continue;
+		}
+
+		bool stolen = false;
+		for (int k = 1; k < raster->thread_num && !stolen; k++)
+		{
+			stolen = tile_queue_pop(&raster->queues[(index + k) % raster->thread_num], &tile, true);
+		}
+
+		if (!stolen)
+		{
+			return;
+		}
+
+		tile_raster_render_tile(raster, tile, &raster->threads[index]);
+	}
+}
+
+static void tile_raster_worker(tile_raster_t* raster, int index, int generation)
+{
+	for (;;)
+	{
+		{
+			std::unique_lock<std::mutex> lock(raster->pool_lock);
+			raster->pool_start.wait(lock, [&] { return raster->quit || raster->generation != generation; });
+			if (raster->quit)
+			{
+				return;
+			}
+			generation = raster->generation;
+		}
+
+		tile_raster_work(raster, index);
+
+		std::lock_guard<std::mutex> guard(raster->pool_lock);
+		if (--raster->busy_workers == 0)
+		{
+			raster->pool_done.notify_one();
+		}
+	}
+}
+
+static void tile_raster_stop_workers(tile_raster_t* raster)
+{
+	{
+		std::lock_guard<std::mutex> guard(raster->pool_lock);
+		raster->quit = true;
+	}
+	raster->pool_start.notify_all();
+
+	for (size_t i = 0; i < raster->workers.size(); i++)
+	{
+		raster->workers[i].join();
+	}
+	raster->workers.clear();
+	raster->quit = false;
+
+	delete[] raster->queues;
+	raster->queues = NULL;
+	delete[] raster->threads;
+	raster->threads = NULL;
+	raster->thread_num = 0;
+}
+
+static void tile_raster_start_workers(tile_raster_t* raster, int thread_num)
+{
+	if (raster->thread_num == thread_num)
+	{
+		return;
+	}
+
+	tile_raster_stop_workers(raster);
+
+	raster->thread_num = thread_num;
+	raster->queues = new tile_queue_t[thread_num];
+	raster->threads = new tile_thread_t[thread_num];
+	for (int i = 1; i < thread_num; i++)
+	{
+		raster->workers.push_back(std::thread(tile_raster_worker, raster, i, raster->generation));
+	}
+}
+
+tile_raster_t* tile_raster_create()
+{
+	tile_raster_t* raster = new tile_raster_t;
+	raster->states.resize(TILE_MAX_DRAW_STATE);
+	raster->state_num = 0;
+	raster->state_valid = false;
+	raster->device = NULL;
+	raster->thread_num = 0;
+	raster->queues = NULL;
+	raster->threads = NULL;
+	raster->generation = 0;
+	raster->busy_workers = 0;
+	raster->quit = false;
+	return raster;
+}
+
+int tile_raster_default_thread_num()
+{
+	int thread_num = (int)std::thread::hardware_concurrency();
+	if (thread_num < 1) thread_num = 1;
+	if (thread_num > TILE_MAX_THREAD_NUM) thread_num = TILE_MAX_THREAD_NUM;
+	return thread_num;
+}
+
+void tile_raster_destroy(tile_raster_t* raster)
+{
+	if (raster == NULL)
+	{
+		return;
+	}
+
+	tile_raster_stop_workers(raster);
+	delete raster;
+}
+
+void tile_raster_begin_draw(tile_raster_t* raster)
+{
+	raster->state_valid = false;
+}
+
+void tile_raster_bin_triangle(device_t* device, const vertex_t* t1, const vertex_t* t2, const vertex_t* t3)
+{
+	tile_raster_t* raster = device->tile_raster;
+
+	if (!raster->state_valid)
+	{
+		if (raster->state_num >= TILE_MAX_DRAW_STATE)
+		{
+			tile_raster_flush(device);
+		}
+
+		tile_raster_save_state(&raster->states[raster->state_num++], device);
+		raster->state_valid = true;
+	}
+
+	// 包围盒向外扩一个像素，保证覆盖扫描线取整后的所有像素
+	float min_x = fminf(t1->pos.x, fminf(t2->pos.x, t3->pos.x)) - 1.0f;
+	float max_x = fmaxf(t1->pos.x, fmaxf(t2->pos.x, t3->pos.x)) + 1.0f;
+	float min_y = fminf(t1->pos.y, fminf(t2->pos.y, t3->pos.y)) - 1.0f;
+	float max_y = fmaxf(t1->pos.y, fmaxf(t2->pos.y, t3->pos.y)) + 1.0f;
+
+	min_x = fmaxf(min_x, (float)device->viewport_x);
+	min_y = fmaxf(min_y, (float)device->viewport_y);
+	max_x = fminf(max_x, (float)(device->viewport_x + device->viewport_width - 1));
+	max_y = fminf(max_y, (float)(device->viewport_y + device->viewport_height - 1));
+	if (!(min_x <= max_x && min_y <= max_y))
+	{
+		return;
+	}
+
+	int idx = (int)raster->triangles.size();
+	tile_triangle_t tri;
+	tri.v[0] = *t1;
+	tri.v[1] = *t2;
+	tri.v[2] = *t3;
+	tri.state_idx = raster->state_num - 1;
+	raster->triangles.push_back(tri);
+
+	int tx0 = (int)min_x / TILE_SIZE;
+	int tx1 = (int)max_x / TILE_SIZE;
+	int ty0 = (int)min_y / TILE_SIZE;
+	int ty1 = (int)max_y / TILE_SIZE;
+	for (int ty = ty0; ty <= ty1; ty++)
+	{
+		for (int tx = tx0; tx <= tx1; tx++)
+		{
+			std::vector<int>& bin = raster->bins[ty * TILE_COLUMN_NUM + tx];
+			if (bin.empty())
+			{
+				raster->active_tiles.push_back(ty * TILE_COLUMN_NUM + tx);
+			}
+			bin.push_back(idx);
+		}
+	}
+}
+
+void tile_raster_flush(device_t* device)
+{
+	tile_raster_t* raster = device->tile_raster;
+	size_t tile_num = raster->active_tiles.size();
+
+	if (tile_num > 0)
+	{
+		int thread_num = device->raster_thread_num;
+		if (thread_num > TILE_MAX_THREAD_NUM) thread_num = TILE_MAX_THREAD_NUM;
+		if (thread_num < 1) thread_num = 1;
+		tile_raster_start_workers(raster, thread_num);
+
+		raster->device = device;
+		for (int i = 0; i < thread_num; i++)
+		{
+			raster->threads[i].state_idx = -1;
+			memset(&raster->threads[i].stats, 0, sizeof(raster_stats_t));
+		}
+
+		// 块比线程少时只分给前 tile_num 个队列，其余线程找不到块后直接返回
+		int queue_num = thread_num < (int)tile_num ? thread_num : (int)tile_num;
+		for (size_t i = 0; i < tile_num; i++)
+		{
+			raster->queues[i % queue_num].tiles.push_back(raster->active_tiles[i]);
+		}
+
+		if (queue_num == 1)
+		{
+			tile_raster_work(raster, 0);
+		}
+		else
+		{
+			{
+				std::lock_guard<std::mutex> guard(raster->pool_lock);
+				raster->generation++;
+				raster->busy_workers = thread_num - 1;
+			}
+			raster->pool_start.notify_all();
+
+			tile_raster_work(raster, 0);
+
+			std::unique_lock<std::mutex> lock(raster->pool_lock);
+			raster->pool_done.wait(lock, [&] { return raster->busy_workers == 0; });
+		}
+
+		for (int i = 0; i < thread_num; i++)
+		{
+			raster_stats_add(&device->raster_stats, &raster->threads[i].stats);
+		}
+
+		for (size_t i = 0; i < tile_num; i++)
+		{
+			raster->bins[raster->active_tiles[i]].clear();
+		}
+		raster->active_tiles.clear();
+	}
+
+	raster->triangles.clear();
+	raster->state_num = 0;
+	raster->state_valid = false;
+}
@@ -0,0 +1,28 @@
+#pragma once
+
+#include "device.h"
+#include "geometry.h"
+
+//=====================================================================
+// 分块光栅化：三角形按屏幕块分箱，由多线程按块并行绘制
+//=====================================================================
+
+#define TILE_SIZE 64
+#define TILE_COLUMN_NUM ((MAX_FRAME_BUFFER_WIDTH + TILE_SIZE - 1) / TILE_SIZE)
+#define TILE_ROW_NUM ((MAX_FRAME_BUFFER_HEIGHT + TILE_SIZE - 1) / TILE_SIZE)
+#define TILE_NUM (TILE_COLUMN_NUM * TILE_ROW_NUM)
+#define TILE_MAX_DRAW_STATE 64	// 缓存的绘制状态数量上限，超过后立即绘制
+#define TILE_MAX_THREAD_NUM 64
+
+tile_raster_t* tile_raster_create();
+int tile_raster_default_thread_num();
+void tile_raster_destroy(tile_raster_t* raster);
+
+// 开始一次绘制调用，下一个三角形会重新记录设备状态
+void tile_raster_begin_draw(tile_raster_t* raster);
+
+// 将三角形放入覆盖到的块中，顶点需已经过 vertex_rhw_init
+void tile_raster_bin_triangle(device_t* device, const vertex_t* t1, const vertex_t* t2, const vertex_t* t3);
+
+// 多线程绘制所有块，块内按提交顺序绘制三角形
+void tile_raster_flush(device_t* device);
@@ -1,14 +1,14 @@
 #include <stdio.h>
 #include "transform.h"
 
-// £ transform = world * view * projection
+// 矩阵更新，计算 transform = world * view * projection
 void transform_update(transform_t *ts) {
 	matrix_t m;
 	matrix_mul(&m, &ts->world, &ts->view);
 	matrix_mul(&ts->transform, &m, &ts->projection);
 }
 
-// ʼĻ
+// 初始化，设置屏幕长宽
 void transform_init(transform_t *ts, int width, int height) {
 	float aspect = (float)width / ((float)height);
 	matrix_set_identity(&ts->world);
@@ -16,15 +16,32 @@ void transform_init(transform_t *ts, int width, int height) {
 	matrix_set_perspective(&ts->projection, 3.1415926f * 0.5f, aspect, 1.0f, 500.0f);
 	ts->w = (float)width;
 	ts->h = (float)height;
+	ts->x = 0.0f;
+	ts->y = 0.0f;
 	transform_update(ts);
 }
 
-// ʸ x  project 
+// 改变屏幕长宽，投影只更新宽高比
+void transform_set_size(transform_t *ts, int width, int height) {
+	float aspect = (float)width / ((float)height);
+	ts->projection.m[0][0] = ts->projection.m[1][1] / aspect;
+	ts->w = (float)width;
+	ts->h = (float)height;
+	transform_update(ts);
+}
+
+void transform_set_viewport(transform_t *ts, int x, int y, int width, int height) {
+	ts->x = (float)x;
+	ts->y = (float)y;
+	transform_set_size(ts, width, height);
+}
+
+// 将矢量 x 进行 project 
 void transform_apply(const transform_t *ts, vector_t *y, const vector_t *x) {
 	matrix_apply(y, x, &ts->transform);
 }
 
-// ͬ cvv ı߽׶ü
+// 检查齐次坐标同 cvv 的边界用于视锥裁剪
 int transform_check_cvv(const vector_t *v) {
 	float w = v->w;
 	int check = 0;
@@ -42,7 +59,7 @@ bool calc_cvv_cut_vertex_ratio(const vector_t *c1, const vector_t *c2, float* fR
 	int check1 = transform_check_cvv(c1);
 	int check2 = transform_check_cvv(c2);
 
-	if ((check1 & 1) == (check2 & 1)) // ڽüڲ òü
+	if ((check1 & 1) == (check2 & 1)) // 都在近裁剪的内侧或者外侧 不用裁剪
 	{
 		return false;
 	}
@@ -51,11 +68,50 @@ bool calc_cvv_cut_vertex_ratio(const vector_t *c1, const vector_t *c2, float* fR
 	return true;
 }
 
-// һõĻ
+int transform_check_box_cvv(const matrix_t *m, const vector_t *box_min, const vector_t *box_max, vector_t *ndc_min, vector_t *ndc_max) {
+	int check = 63;
+	bool cross_near = false;
+	ndc_min->x = ndc_min->y = ndc_min->z = 1.0f;
+	ndc_max->x = ndc_max->y = ndc_max->z = -1.0f;
+	ndc_min->w = ndc_max->w = 1.0f;
+	for (int i = 0; i < 8; i++) {
+		vector_t corner = { (i & 1) ? box_max->x : box_min->x, (i & 2) ? box_max->y : box_min->y, (i & 4) ? box_max->z : box_min->z, 1.0f };
+		vector_t c;
+		matrix_apply(&c, &corner, m);
+		int code = transform_check_cvv(&c);
+		check &= code;
+		if (code & 1) {
+			cross_near = true;
+			continue;
+		}
+		float rhw = 1.0f / c.w;
+		float x = c.x * rhw, y = c.y * rhw, z = c.z * rhw;
+		if (x < ndc_min->x) ndc_min->x = x;
+		if (x > ndc_max->x) ndc_max->x = x;
+		if (y < ndc_min->y) ndc_min->y = y;
+		if (y > ndc_max->y) ndc_max->y = y;
+		if (z < ndc_min->z) ndc_min->z = z;
+		if (z > ndc_max->z) ndc_max->z = z;
+	}
+	if (cross_near) {
+		ndc_min->x = ndc_min->y = -1.0f;
+		ndc_max->x = ndc_max->y = 1.0f;
+		ndc_min->z = 0.0f;
+	}
+	ndc_min->x = ndc_min->x < -1.0f ? -1.0f : ndc_min->x;
+	ndc_min->y = ndc_min->y < -1.0f ? -1.0f : ndc_min->y;
+	ndc_min->z = ndc_min->z < 0.0f ? 0.0f : ndc_min->z;
+	ndc_max->x = ndc_max->x > 1.0f ? 1.0f : ndc_max->x;
+	ndc_max->y = ndc_max->y > 1.0f ? 1.0f : ndc_max->y;
+	ndc_max->z = ndc_max->z > 1.0f ? 1.0f : ndc_max->z;
+	return check;
+}
+
+// 归一化，得到屏幕坐标
 void transform_homogenize(const transform_t *ts, vector_t *y, const vector_t *x) {
 	float rhw = 1.0f / x->w;
-	y->x = (x->x * rhw + 1.0f) * ts->w * 0.5f;
-	y->y = (1.0f - x->y * rhw) * ts->h * 0.5f;
+	y->x = (x->x * rhw + 1.0f) * ts->w * 0.5f + ts->x;
+	y->y = (1.0f - x->y * rhw) * ts->h * 0.5f + ts->y;
 	y->z = x->z * rhw;
 	y->w = 1.0f;
 }
\ No newline at end of file
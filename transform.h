@@ -3,31 +3,42 @@
 #include "mathlib.h"
 
 //=====================================================================
-// 任
+// 坐标变换
 //=====================================================================
 typedef struct {
-	matrix_t world;         // 任
-	matrix_t view;          // Ӱ任
-	matrix_t projection;    // ͶӰ任
+	matrix_t world;         // 世界坐标变换
+	matrix_t view;          // 摄影机坐标变换
+	matrix_t projection;    // 投影变换
 	matrix_t transform;     // transform = world * view * projection
-	float w, h;             // ĻС
-	matrix_t worldInv;		// 任
-	matrix_t viewInv;		// Ӱ任
+	float w, h;             // 屏幕大小，即视口大小
+	float x, y;             // 视口左上角在渲染目标中的位置
+	matrix_t worldInv;		// 世界坐标变换的逆矩阵
+	matrix_t viewInv;		// 摄影机变换的逆矩阵
 }	transform_t;
 
 
-// £ transform = world * view * projection
+// 矩阵更新，计算 transform = world * view * projection
 void transform_update(transform_t *ts);
 
-// ʼĻ
+// 初始化，设置屏幕长宽
 void transform_init(transform_t *ts, int width, int height);
 
-// ʸ x  project 
+// 改变屏幕长宽和投影的宽高比，保留世界和摄影机变换
+void transform_set_size(transform_t *ts, int width, int height);
+
+// 视口为渲染目标中的矩形，归一化的坐标映射到视口内，投影的宽高比为视口的宽高比
+void transform_set_viewport(transform_t *ts, int x, int y, int width, int height);
+
+// 将矢量 x 进行 project 
 void transform_apply(const transform_t *ts, vector_t *y, const vector_t *x);
 
-// ͬ cvv ı߽׶ü
+// 检查齐次坐标同 cvv 的边界用于视锥裁剪
 int transform_check_cvv(const vector_t *v);
 bool calc_cvv_cut_vertex_ratio(const vector_t *c1, const vector_t *c2, float* fRatio);
 
-// һõĻ
+// 模型空间的包围盒经 m 变换后，返回 8 个角 transform_check_cvv 结果的交集，不为 0 时包围盒完全在 cvv 之外
+// ndc_min/ndc_max 为透视除法后 x y z 的范围，限制在 cvv 内；有角在近平面之前时 x y 取整个 cvv
+int transform_check_box_cvv(const matrix_t *m, const vector_t *box_min, const vector_t *box_max, vector_t *ndc_min, vector_t *ndc_max);
+
+// 归一化，得到屏幕坐标
 void transform_homogenize(const transform_t *ts, vector_t *y, const vector_t *x);
\ No newline at end of file